@@ -0,0 +1,232 @@
+#include "vkbarriers.hpp"
+
+#include "api/vkfeatures.hpp"
+#include "utils/debug.hpp"
+
+Synchronization2 Synchronization2::Load(
+  VkDevice device,
+  const FeatureSupport& support
+) {
+  Synchronization2 sync2;
+  if(!support.synchronization2) return sync2;
+
+  // The KHR and core versions share their signatures
+  bool core = support.apiVersion >= VK_API_VERSION_1_3;
+
+  sync2.cmdPipelineBarrier2 = reinterpret_cast<PFN_vkCmdPipelineBarrier2KHR>(
+    vkGetDeviceProcAddr(device, core ? "vkCmdPipelineBarrier2" : "vkCmdPipelineBarrier2KHR")
+  );
+  sync2.queueSubmit2 = reinterpret_cast<PFN_vkQueueSubmit2KHR>(
+    vkGetDeviceProcAddr(device, core ? "vkQueueSubmit2" : "vkQueueSubmit2KHR")
+  );
+
+  // Half a feature is no feature
+  if(sync2.cmdPipelineBarrier2 == nullptr || sync2.queueSubmit2 == nullptr) {
+    return Synchronization2();
+  }
+
+  return sync2;
+}
+
+BarrierBatch::BarrierBatch(const Synchronization2& sync2)
+  : sync2(sync2),
+    memoryCount(0),
+    bufferCount(0),
+    imageCount(0)
+  {}
+
+BarrierBatch& BarrierBatch::Memory(
+  VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+  VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+) {
+  ASSERT(memoryCount < MAX_BARRIERS, "Too many memory barriers in one batch");
+
+  VkMemoryBarrier2& barrier = memory[memoryCount++];
+  barrier = {};
+  barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+  barrier.srcStageMask  = srcStage;
+  barrier.srcAccessMask = srcAccess;
+  barrier.dstStageMask  = dstStage;
+  barrier.dstAccessMask = dstAccess;
+
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Buffer(
+  VkBuffer buffer,
+  VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+  VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+) {
+  ASSERT(bufferCount < MAX_BARRIERS, "Too many buffer barriers in one batch");
+
+  VkBufferMemoryBarrier2& barrier = buffers[bufferCount++];
+  barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+  barrier.srcStageMask        = srcStage;
+  barrier.srcAccessMask       = srcAccess;
+  barrier.dstStageMask        = dstStage;
+  barrier.dstAccessMask       = dstAccess;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer              = buffer;
+  barrier.offset              = 0;
+  barrier.size                = VK_WHOLE_SIZE;
+
+  return *this;
+}
+
+BarrierBatch& BarrierBatch::Image(
+  VkImage image,
+  VkImageSubresourceRange range,
+  VkImageLayout oldLayout, VkImageLayout newLayout,
+  VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+  VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+) {
+  ASSERT(imageCount < MAX_BARRIERS, "Too many image barriers in one batch");
+
+  VkImageMemoryBarrier2& barrier = images[imageCount++];
+  barrier = {};
+  barrier.sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+  barrier.srcStageMask        = srcStage;
+  barrier.srcAccessMask       = srcAccess;
+  barrier.dstStageMask        = dstStage;
+  barrier.dstAccessMask       = dstAccess;
+  barrier.oldLayout           = oldLayout;
+  barrier.newLayout           = newLayout;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image               = image;
+  barrier.subresourceRange    = range;
+
+  return *this;
+}
+
+bool BarrierBatch::Empty() {
+  return memoryCount == 0 && bufferCount == 0 && imageCount == 0;
+}
+
+void BarrierBatch::Flush(VkCommandBuffer command) {
+  if(Empty()) return;
+
+  if(sync2.IsEnabled()) {
+    VkDependencyInfo dependency{};
+    dependency.sType                    = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency.memoryBarrierCount       = memoryCount;
+    dependency.pMemoryBarriers          = memory;
+    dependency.bufferMemoryBarrierCount = bufferCount;
+    dependency.pBufferMemoryBarriers    = buffers;
+    dependency.imageMemoryBarrierCount  = imageCount;
+    dependency.pImageMemoryBarriers     = images;
+
+    sync2.cmdPipelineBarrier2(command, &dependency);
+  }
+  else {
+    FlushLegacy(command);
+  }
+
+  memoryCount = 0;
+  bufferCount = 0;
+  imageCount = 0;
+}
+
+// Stages that only exist in synchronization2, and the legacy
+// stages that contain them
+static VkPipelineStageFlags LegacyStages(VkPipelineStageFlags2 stages) {
+  VkPipelineStageFlags legacy = static_cast<VkPipelineStageFlags>(stages & 0xFFFFFFFFull);
+
+  const VkPipelineStageFlags2 transfer =
+    VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_RESOLVE_BIT |
+    VK_PIPELINE_STAGE_2_BLIT_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT;
+  const VkPipelineStageFlags2 vertexInput =
+    VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT | VK_PIPELINE_STAGE_2_VERTEX_ATTRIBUTE_INPUT_BIT;
+
+  if(stages & transfer) legacy |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+  if(stages & vertexInput) legacy |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+  if(stages & VK_PIPELINE_STAGE_2_PRE_RASTERIZATION_SHADERS_BIT) {
+    legacy |=
+      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+      VK_PIPELINE_STAGE_TESSELLATION_CONTROL_SHADER_BIT |
+      VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT |
+      VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT;
+  }
+
+  return legacy;
+}
+
+static VkAccessFlags LegacyAccess(VkAccessFlags2 access) {
+  VkAccessFlags legacy = static_cast<VkAccessFlags>(access & 0xFFFFFFFFull);
+
+  const VkAccessFlags2 reads =
+    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+  if(access & reads) legacy |= VK_ACCESS_SHADER_READ_BIT;
+  if(access & VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT) legacy |= VK_ACCESS_SHADER_WRITE_BIT;
+
+  return legacy;
+}
+
+void BarrierBatch::FlushLegacy(VkCommandBuffer command) {
+  VkMemoryBarrier legacyMemory[MAX_BARRIERS];
+  VkBufferMemoryBarrier legacyBuffers[MAX_BARRIERS];
+  VkImageMemoryBarrier legacyImages[MAX_BARRIERS];
+
+  // One call means one set of stages for everything
+  VkPipelineStageFlags2 srcStages = 0, dstStages = 0;
+
+  for(uint32_t i = 0; i < memoryCount; i++) {
+    legacyMemory[i] = {};
+    legacyMemory[i].sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    legacyMemory[i].srcAccessMask = LegacyAccess(memory[i].srcAccessMask);
+    legacyMemory[i].dstAccessMask = LegacyAccess(memory[i].dstAccessMask);
+
+    srcStages |= memory[i].srcStageMask;
+    dstStages |= memory[i].dstStageMask;
+  }
+
+  for(uint32_t i = 0; i < bufferCount; i++) {
+    legacyBuffers[i] = {};
+    legacyBuffers[i].sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    legacyBuffers[i].srcAccessMask       = LegacyAccess(buffers[i].srcAccessMask);
+    legacyBuffers[i].dstAccessMask       = LegacyAccess(buffers[i].dstAccessMask);
+    legacyBuffers[i].srcQueueFamilyIndex = buffers[i].srcQueueFamilyIndex;
+    legacyBuffers[i].dstQueueFamilyIndex = buffers[i].dstQueueFamilyIndex;
+    legacyBuffers[i].buffer              = buffers[i].buffer;
+    legacyBuffers[i].offset              = buffers[i].offset;
+    legacyBuffers[i].size                = buffers[i].size;
+
+    srcStages |= buffers[i].srcStageMask;
+    dstStages |= buffers[i].dstStageMask;
+  }
+
+  for(uint32_t i = 0; i < imageCount; i++) {
+    legacyImages[i] = {};
+    legacyImages[i].sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    legacyImages[i].srcAccessMask       = LegacyAccess(images[i].srcAccessMask);
+    legacyImages[i].dstAccessMask       = LegacyAccess(images[i].dstAccessMask);
+    legacyImages[i].oldLayout           = images[i].oldLayout;
+    legacyImages[i].newLayout           = images[i].newLayout;
+    legacyImages[i].srcQueueFamilyIndex = images[i].srcQueueFamilyIndex;
+    legacyImages[i].dstQueueFamilyIndex = images[i].dstQueueFamilyIndex;
+    legacyImages[i].image               = images[i].image;
+    legacyImages[i].subresourceRange    = images[i].subresourceRange;
+
+    srcStages |= images[i].srcStageMask;
+    dstStages |= images[i].dstStageMask;
+  }
+
+  // NONE isn't valid there, these are the legacy "nothing"
+  VkPipelineStageFlags src = LegacyStages(srcStages);
+  VkPipelineStageFlags dst = LegacyStages(dstStages);
+  if(src == 0) src = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+  if(dst == 0) dst = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+
+  vkCmdPipelineBarrier(
+    command,
+    src,
+    dst,
+    0,
+    memoryCount, legacyMemory,
+    bufferCount, legacyBuffers,
+    imageCount, legacyImages
+  );
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <cstdint>
+
+struct FeatureSupport;
+
+// synchronization2 entry points, null when the device doesn't have
+// it. 1.3 devices have them in core, 1.2 ones through the extension
+struct Synchronization2 {
+  PFN_vkCmdPipelineBarrier2KHR cmdPipelineBarrier2 = nullptr;
+  PFN_vkQueueSubmit2KHR queueSubmit2 = nullptr;
+
+  static Synchronization2 Load(VkDevice, const FeatureSupport&);
+
+  bool IsEnabled() const { return cmdPipelineBarrier2 != nullptr; }
+};
+
+/*
+  Collects barriers and records them all with one call.
+
+    BarrierBatch barriers(sync2);
+    barriers.Buffer(draws.handle,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT);
+    barriers.Flush(command);
+
+  Every barrier carries its own stage pair, so with synchronization2
+  each one only waits on what it really depends on.
+  Without it, they go into a single vkCmdPipelineBarrier with the
+  union of all the stages, sync2-only flags mapped to the closest
+  legacy ones (BLIT -> TRANSFER, STORAGE_WRITE -> SHADER_WRITE...).
+
+  Nothing is allocated, a batch holds up to MAX_BARRIERS of each kind.
+*/
+class BarrierBatch {
+public:
+  static const uint32_t MAX_BARRIERS = 8;
+
+private:
+  const Synchronization2& sync2;
+
+  VkMemoryBarrier2 memory[MAX_BARRIERS];
+  VkBufferMemoryBarrier2 buffers[MAX_BARRIERS];
+  VkImageMemoryBarrier2 images[MAX_BARRIERS];
+
+  uint32_t memoryCount;
+  uint32_t bufferCount;
+  uint32_t imageCount;
+
+public:
+  BarrierBatch(const Synchronization2&);
+
+  BarrierBatch(const BarrierBatch&) = delete;
+  BarrierBatch& operator=(const BarrierBatch&) = delete;
+
+  BarrierBatch& Memory(
+    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+  );
+
+  // The whole buffer
+  BarrierBatch& Buffer(
+    VkBuffer,
+    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+  );
+
+  BarrierBatch& Image(
+    VkImage,
+    VkImageSubresourceRange,
+    VkImageLayout oldLayout, VkImageLayout newLayout,
+    VkPipelineStageFlags2 srcStage, VkAccessFlags2 srcAccess,
+    VkPipelineStageFlags2 dstStage, VkAccessFlags2 dstAccess
+  );
+
+  bool Empty();
+
+  // Records everything collected and starts over
+  void Flush(VkCommandBuffer);
+
+private:
+  void FlushLegacy(VkCommandBuffer);
+};
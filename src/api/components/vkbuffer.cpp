@@ -0,0 +1,56 @@
+#include "vkbuffer.hpp"
+
+#include "api/vkutils.hpp"
+#include "utils/debug.hpp"
+
+Buffer::Buffer()
+  : handle(VK_NULL_HANDLE), memory(VK_NULL_HANDLE), size(0), mapped(nullptr)
+  {}
+
+Buffer::Buffer(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  VkDeviceSize size,
+  VkBufferUsageFlags usage,
+  VkMemoryPropertyFlags properties
+) : size(size), mapped(nullptr) {
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size        = size;
+  bufferInfo.usage       = usage;
+  // Only the graphics queue touches our buffers
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  VK_ASSERT(vkCreateBuffer(device, &bufferInfo, nullptr, &handle));
+
+  // Buffers don't come with memory, we must ask what they
+  // need and allocate it ourselves
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(device, handle, &requirements);
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize  = requirements.size;
+  allocInfo.memoryTypeIndex = VkUtils::FindMemoryType(
+    physicalDevice,
+    requirements.memoryTypeBits,
+    properties
+  );
+
+  VK_ASSERT(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+  VK_ASSERT(vkBindBufferMemory(device, handle, memory, 0));
+
+  if(properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    VK_ASSERT(vkMapMemory(device, memory, 0, size, 0, &mapped));
+  }
+}
+
+void Buffer::Destroy(VkDevice device) {
+  if(mapped != nullptr) {
+    vkUnmapMemory(device, memory);
+    mapped = nullptr;
+  }
+
+  vkDestroyBuffer(device, handle, nullptr);
+  vkFreeMemory(device, memory, nullptr);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+struct Buffer {
+  VkBuffer handle;
+  VkDeviceMemory memory;
+  VkDeviceSize size;
+
+  // Only set for HOST_VISIBLE buffers, which stay
+  // persistently mapped for their whole lifetime
+  void* mapped;
+
+  Buffer();
+  Buffer(
+    VkDevice device,
+    VkPhysicalDevice physicalDevice,
+    VkDeviceSize size,
+    VkBufferUsageFlags usage,
+    VkMemoryPropertyFlags properties
+  );
+
+  void Destroy(VkDevice device);
+};
@@ -0,0 +1,304 @@
+#include "vkculling.hpp"
+
+#include "utils/debug.hpp"
+
+#include <cstring>
+
+// Mirrors the push constants in cull.comp
+struct CullConstants {
+  float viewProjection[16];
+  float pyramidSize[2];
+  uint32_t objectCount;
+  uint32_t late;
+  float renderScale[2];
+};
+
+OcclusionCuller::OcclusionCuller() : sync2(nullptr) {}
+
+OcclusionCuller::OcclusionCuller(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  const DepthPyramid& pyramid,
+  const Synchronization2* sync2,
+  bool multiDrawIndirect
+) : shaderModule(RESOURCES"shaders/cull.comp.spv", device),
+    sync2(sync2),
+    objectCount(0),
+    pyramidExtent(pyramid.image.extent),
+    depthExtent(pyramid.depthExtent),
+    pyramidImage(pyramid.image.handle),
+    pyramidLevels(pyramid.image.mipLevels),
+    multiDrawIndirect(multiDrawIndirect),
+    needsReset(true) {
+
+  // Objects are written by the CPU whenever the scene changes,
+  // so they just live in host visible memory
+  objects = Buffer(
+    device,
+    physicalDevice,
+    MAX_OBJECTS * sizeof(CullObject),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+  );
+
+  visibility = Buffer(
+    device,
+    physicalDevice,
+    MAX_OBJECTS * sizeof(uint32_t),
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+
+  for(auto& drawBuffer : draws) {
+    drawBuffer = Buffer(
+      device,
+      physicalDevice,
+      MAX_OBJECTS * sizeof(VkDrawIndirectCommand),
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+    );
+  }
+
+  CreateDescriptors(device, pyramid);
+}
+
+void OcclusionCuller::CreateDescriptors(
+  VkDevice device,
+  const DepthPyramid& pyramid
+) {
+  // 0 -> objects, 1 -> visibility, 2 -> draws, 3 -> Hi-Z pyramid
+  VkDescriptorSetLayoutBinding bindings[4]{};
+  for(uint32_t i = 0; i < 4; i++) {
+    bindings[i].binding         = i;
+    bindings[i].descriptorType  = i == 3
+      ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+      : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+  setLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  setLayoutInfo.bindingCount = 4;
+  setLayoutInfo.pBindings    = bindings;
+
+  VK_ASSERT(
+    vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout)
+  );
+
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type            = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  poolSizes[0].descriptorCount = 3 * 2;
+  poolSizes[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[1].descriptorCount = 2;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets       = 2;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes    = poolSizes;
+
+  VK_ASSERT(
+    vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool)
+  );
+
+  VkDescriptorSetLayout setLayouts[2] = { setLayout, setLayout };
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = descriptorPool;
+  allocInfo.descriptorSetCount = 2;
+  allocInfo.pSetLayouts        = setLayouts;
+
+  VK_ASSERT(
+    vkAllocateDescriptorSets(device, &allocInfo, descriptorSets)
+  );
+
+  for(int phase = EARLY; phase <= LATE; phase++) {
+    VkDescriptorBufferInfo bufferInfos[3] = {
+      { objects.handle,     0, VK_WHOLE_SIZE },
+      { visibility.handle,  0, VK_WHOLE_SIZE },
+      { draws[phase].handle, 0, VK_WHOLE_SIZE }
+    };
+
+    VkDescriptorImageInfo pyramidInfo{};
+    pyramidInfo.sampler     = pyramid.sampler;
+    pyramidInfo.imageView   = pyramid.image.view;
+    pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[4]{};
+    for(uint32_t i = 0; i < 4; i++) {
+      writes[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet          = descriptorSets[phase];
+      writes[i].dstBinding      = i;
+      writes[i].descriptorCount = 1;
+      writes[i].descriptorType  = bindings[i].descriptorType;
+
+      if(i == 3) writes[i].pImageInfo  = &pyramidInfo;
+      else       writes[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, 4, writes, 0, nullptr);
+  }
+}
+
+void OcclusionCuller::CreatePipeline(VkDevice device, PipelineBatch& batch) {
+  VkPushConstantRange pushRange{};
+  pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushRange.offset     = 0;
+  pushRange.size       = sizeof(CullConstants);
+
+  VkPipelineLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount         = 1;
+  layoutInfo.pSetLayouts            = &setLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges    = &pushRange;
+
+  VK_ASSERT(
+    vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout)
+  );
+
+  batch.AddCompute(shaderModule.GetModule(), layout, &pipeline);
+}
+
+void OcclusionCuller::SetObjects(const std::vector<CullObject>& sceneObjects) {
+  ASSERT(sceneObjects.size() <= MAX_OBJECTS, "Too many objects to cull");
+
+  objectCount = static_cast<uint32_t>(sceneObjects.size());
+  memcpy(objects.mapped, sceneObjects.data(), objectCount * sizeof(CullObject));
+
+  // Old visibility belongs to other objects, start over
+  needsReset = true;
+}
+
+void OcclusionCuller::Reset(VkCommandBuffer command) {
+  // Nothing is visible before the first frame, so the early pass
+  // draws nothing and the late pass finds out what's on screen
+  vkCmdFillBuffer(command, visibility.handle, 0, VK_WHOLE_SIZE, 0);
+
+  BarrierBatch barriers(*sync2);
+
+  barriers.Buffer(
+    visibility.handle,
+    VK_PIPELINE_STAGE_2_CLEAR_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+  );
+
+  // The pyramid is bound (though not read) by the early pass too,
+  // so it must be in GENERAL even before it's ever been built.
+  // Its old contents are thrown away, nothing to wait for but the
+  // previous frame's reads
+  barriers.Image(
+    pyramidImage,
+    { VK_IMAGE_ASPECT_COLOR_BIT, 0, pyramidLevels, 0, 1 },
+    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+  );
+
+  barriers.Flush(command);
+
+  needsReset = false;
+}
+
+void OcclusionCuller::Cull(
+  VkCommandBuffer command,
+  Phase phase,
+  const float viewProjection[16],
+  VkExtent2D renderExtent
+) {
+  if(needsReset) Reset(command);
+
+  BarrierBatch barriers(*sync2);
+
+  // The draw buffer we're about to overwrite may still be read by
+  // the previous frame's indirect draws: only that has to finish,
+  // there's nothing of theirs to make visible
+  barriers.Buffer(
+    draws[phase].handle,
+    VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_NONE,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+  );
+
+  // Visibility was written by the previous pass, early or late
+  barriers.Buffer(
+    visibility.handle,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+    VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+  );
+
+  barriers.Flush(command);
+
+  CullConstants constants{};
+  memcpy(constants.viewProjection, viewProjection, sizeof(constants.viewProjection));
+  constants.pyramidSize[0] = static_cast<float>(pyramidExtent.width);
+  constants.pyramidSize[1] = static_cast<float>(pyramidExtent.height);
+  constants.objectCount    = objectCount;
+  constants.late           = phase == LATE ? 1 : 0;
+  constants.renderScale[0] = 
+    static_cast<float>(renderExtent.width) / depthExtent.width;
+  constants.renderScale[1] = 
+    static_cast<float>(renderExtent.height) / depthExtent.height;
+
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+  vkCmdBindDescriptorSets(
+    command,
+    VK_PIPELINE_BIND_POINT_COMPUTE,
+    layout,
+    0, 1, &descriptorSets[phase],
+    0, nullptr
+  );
+  vkCmdPushConstants(
+    command,
+    layout,
+    VK_SHADER_STAGE_COMPUTE_BIT,
+    0, sizeof(CullConstants), &constants
+  );
+
+  if(objectCount > 0) {
+    vkCmdDispatch(command, (objectCount + 63) / 64, 1, 1);
+  }
+
+  // Draw commands are consumed by the indirect stage
+  barriers.Buffer(
+    draws[phase].handle,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+    VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT
+  );
+
+  barriers.Flush(command);
+}
+
+void OcclusionCuller::Draw(VkCommandBuffer command, Phase phase) {
+  if(objectCount == 0) return;
+
+  const uint32_t stride = sizeof(VkDrawIndirectCommand);
+
+  if(multiDrawIndirect) {
+    vkCmdDrawIndirect(command, draws[phase].handle, 0, objectCount, stride);
+    return;
+  }
+
+  // Without multiDrawIndirect we're limited to one draw per call
+  for(uint32_t i = 0; i < objectCount; i++) {
+    vkCmdDrawIndirect(command, draws[phase].handle, i * stride, 1, stride);
+  }
+}
+
+void OcclusionCuller::Destroy(VkDevice device) {
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, layout, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+
+  objects.Destroy(device);
+  visibility.Destroy(device);
+  for(auto& drawBuffer : draws) {
+    drawBuffer.Destroy(device);
+  }
+
+  shaderModule.Destroy(device);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include "vkbarriers.hpp"
+#include "vkbuffer.hpp"
+#include "vkhiz.hpp"
+#include "vkpipelinebatch.hpp"
+#include "vkshader.hpp"
+
+#include <vector>
+
+// Mirrors `CullObject` in cull.comp
+struct CullObject {
+  float center[3];
+  float radius;
+  uint32_t vertexCount;
+  uint32_t firstVertex;
+  uint32_t padding[2];
+};
+
+/*
+  GPU driven two-phase occlusion culling.
+  Every frame goes through:
+    1. Cull(EARLY) -> Draw(EARLY): objects visible last frame
+    2. DepthPyramid::Build() over the depth those left behind
+    3. Cull(LATE)  -> Draw(LATE): objects the pyramid says became visible
+  Only objects that pass a test ever get a non-zero instance count, so
+  hidden ones cost the GPU nothing past this compute pass.
+*/
+class OcclusionCuller {
+public:
+  enum Phase { EARLY = 0, LATE = 1 };
+
+  static const uint32_t MAX_OBJECTS = 4096;
+
+private:
+  ShaderModule shaderModule;
+
+  VkDescriptorSetLayout setLayout;
+  VkDescriptorPool descriptorPool;
+  // Phases only differ in which draw buffer they write to
+  VkDescriptorSet descriptorSets[2];
+
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+
+  Buffer objects;
+  // One uint per object, survives across frames
+  Buffer visibility;
+
+  // Owned by the context
+  const Synchronization2* sync2;
+
+  uint32_t objectCount;
+  VkExtent2D pyramidExtent;
+  VkExtent2D depthExtent;
+  VkImage pyramidImage;
+  uint32_t pyramidLevels;
+
+  bool multiDrawIndirect;
+  // Set whenever the visibility history no longer matches the objects
+  bool needsReset;
+
+public:
+  Buffer draws[2];
+
+  OcclusionCuller();
+  OcclusionCuller(
+    VkDevice,
+    VkPhysicalDevice,
+    const DepthPyramid&,
+    const Synchronization2*,
+    bool multiDrawIndirect
+  );
+  void Destroy(VkDevice);
+
+  // Queues the pipeline in `batch`, call it on the culler that stays
+  void CreatePipeline(VkDevice, PipelineBatch& batch);
+
+  // Must not be called while a frame using the objects is in flight
+  void SetObjects(const std::vector<CullObject>&);
+
+  // `viewProjection` is a column-major 4x4 matrix, `renderExtent`
+  // is the part of the depth buffer the scene was rendered into
+  void Cull(
+    VkCommandBuffer,
+    Phase,
+    const float viewProjection[16],
+    VkExtent2D renderExtent
+  );
+  void Draw(VkCommandBuffer, Phase);
+
+private:
+  void CreateDescriptors(VkDevice, const DepthPyramid&);
+  void Reset(VkCommandBuffer);
+};
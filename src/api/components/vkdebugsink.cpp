@@ -0,0 +1,276 @@
+#include "vkdebugsink.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+DebugSink::DebugSink()
+  : enqueuePosition(0),
+    dequeuePosition(0),
+    severities(0),
+    types(0),
+    perIdLimit(0),
+    windowSeconds(1.0f),
+    dropped(0),
+    running(false)
+  {}
+
+DebugSink::~DebugSink() {
+  Stop();
+}
+
+void DebugSink::Start(Settings settings) {
+  if(running) return;
+
+  slots.reset(new Slot[QUEUE_CAPACITY]);
+  for(uint32_t i = 0; i < QUEUE_CAPACITY; i++) {
+    slots[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueuePosition.store(0, std::memory_order_relaxed);
+  dequeuePosition = 0;
+
+  counters.reset(new IdCounter[ID_SLOTS]);
+  for(uint32_t i = 0; i < ID_SLOTS; i++) {
+    counters[i].key.store(0, std::memory_order_relaxed);
+    counters[i].count.store(0, std::memory_order_relaxed);
+    counters[i].suppressed.store(0, std::memory_order_relaxed);
+  }
+
+  SetSeverities(settings.severities);
+  SetTypes(settings.types);
+  SetPerIdLimit(settings.perIdLimit);
+  windowSeconds = settings.windowSeconds;
+
+  running = true;
+  logger = std::thread(&DebugSink::Run, this);
+}
+
+void DebugSink::Stop() {
+  if(!running) return;
+
+  running = false;
+  logger.join();
+}
+
+void DebugSink::SetSeverities(VkDebugUtilsMessageSeverityFlagsEXT value) {
+  severities.store(value, std::memory_order_relaxed);
+}
+
+void DebugSink::SetTypes(VkDebugUtilsMessageTypeFlagsEXT value) {
+  types.store(value, std::memory_order_relaxed);
+}
+
+void DebugSink::SetPerIdLimit(uint32_t value) {
+  perIdLimit.store(value, std::memory_order_relaxed);
+}
+
+static uint64_t HashString(const char* text) {
+  // FNV-1a
+  uint64_t hash = 1469598103934665603ull;
+  for(; *text; text++) {
+    hash = (hash ^ static_cast<uint8_t>(*text)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+bool DebugSink::CountAgainstLimit(uint64_t id) {
+  uint64_t key = id + 1;
+  uint32_t start = static_cast<uint32_t>(key * 0x9E3779B97F4A7C15ull >> 32) % ID_SLOTS;
+
+  // A few probes is plenty, an ID that doesn't find a slot just
+  // isn't rate limited
+  for(uint32_t probe = 0; probe < 8; probe++) {
+    IdCounter& counter = counters[(start + probe) % ID_SLOTS];
+
+    uint64_t current = counter.key.load(std::memory_order_acquire);
+    if(current == 0) {
+      // Claim it, unless another thread just did
+      counter.key.compare_exchange_strong(current, key, std::memory_order_acq_rel);
+      if(current != 0 && current != key) continue;
+    }
+    else if(current != key) {
+      continue;
+    }
+
+    uint32_t count = counter.count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if(count <= perIdLimit.load(std::memory_order_relaxed)) return true;
+
+    counter.suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  return true;
+}
+
+void DebugSink::Push(
+  VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+  VkDebugUtilsMessageTypeFlagsEXT type,
+  const VkDebugUtilsMessengerCallbackDataEXT* data
+) {
+  if(!running.load(std::memory_order_relaxed)) return;
+  if(!(severity & severities.load(std::memory_order_relaxed))) return;
+  if(!(type & types.load(std::memory_order_relaxed))) return;
+
+  // Validation messages have a numeric ID, the rest at most a name
+  uint64_t id = data->messageIdNumber != 0
+    ? static_cast<uint32_t>(data->messageIdNumber)
+    : HashString(data->pMessageIdName ? data->pMessageIdName : data->pMessage);
+
+  if(!CountAgainstLimit(id)) return;
+
+  uint64_t position = enqueuePosition.load(std::memory_order_relaxed);
+  Slot* slot;
+
+  for(;;) {
+    slot = &slots[position % QUEUE_CAPACITY];
+    uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+    int64_t difference =
+      static_cast<int64_t>(sequence) - static_cast<int64_t>(position);
+
+    if(difference == 0) {
+      if(enqueuePosition.compare_exchange_weak(
+        position, position + 1, std::memory_order_relaxed
+      )) break;
+    }
+    else if(difference < 0) {
+      // Full, the logger is behind
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    else {
+      position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->message.severity = severity;
+  slot->message.type = type;
+  // Long messages get cut, the start is what identifies them anyway
+  strncpy(slot->message.text, data->pMessage, MAX_MESSAGE_LENGTH - 1);
+  slot->message.text[MAX_MESSAGE_LENGTH - 1] = '\0';
+
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool DebugSink::Dequeue(Message& message) {
+  Slot& slot = slots[dequeuePosition % QUEUE_CAPACITY];
+  uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+
+  if(sequence != dequeuePosition + 1) return false;
+
+  message = slot.message;
+  slot.sequence.store(dequeuePosition + QUEUE_CAPACITY, std::memory_order_release);
+  dequeuePosition++;
+
+  return true;
+}
+
+void DebugSink::Write(const Message& message) {
+  const char* label = "[INFO]";
+  if(message.severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+    label = "[ERROR]";
+  }
+  else if(message.severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT) {
+    label = message.type & VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
+      ? "[PERF]"
+      : "[WARNING]";
+  }
+  else if(message.severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT) {
+    label = "[VERBOSE]";
+  }
+
+  fprintf(stdout, "%s %s\n", label, message.text);
+}
+
+void DebugSink::ReportSuppressed() {
+  for(uint32_t i = 0; i < ID_SLOTS; i++) {
+    IdCounter& counter = counters[i];
+    if(counter.key.load(std::memory_order_relaxed) == 0) continue;
+
+    uint32_t suppressed = counter.suppressed.exchange(0, std::memory_order_relaxed);
+    counter.count.store(0, std::memory_order_relaxed);
+
+    if(suppressed > 0) {
+      fprintf(stdout, "[DEBUG] Message 0x%llx repeated %u more times\n",
+        static_cast<unsigned long long>(counter.key.load(std::memory_order_relaxed) - 1),
+        suppressed);
+    }
+  }
+
+  uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+  if(lost > 0) {
+    fprintf(stdout, "[DEBUG] %llu messages dropped, queue full\n",
+      static_cast<unsigned long long>(lost));
+  }
+}
+
+void DebugSink::Run() {
+  using Clock = std::chrono::steady_clock;
+
+  auto windowStart = Clock::now();
+  Message message;
+
+  for(;;) {
+    // Read before draining, so nothing pushed before Stop is missed
+    bool stopping = !running.load();
+
+    bool wrote = false;
+    while(Dequeue(message)) {
+      Write(message);
+      wrote = true;
+    }
+
+    std::chrono::duration<float> elapsed = Clock::now() - windowStart;
+    if(stopping || elapsed.count() >= windowSeconds) {
+      ReportSuppressed();
+      windowStart = Clock::now();
+      wrote = true;
+    }
+
+    if(wrote) fflush(stdout);
+    if(stopping) return;
+
+    // Polling keeps producers free of any wake-up call, a few ms of
+    // latency on a log line doesn't matter
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+}
+
+DebugSink::Settings DebugSink::FromEnvironment(Settings settings) {
+  // VULKAN_MESSAGES=<lowest severity shown>
+  if(const char* value = getenv("VULKAN_MESSAGES")) {
+    const VkDebugUtilsMessageSeverityFlagsEXT
+      error   = VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT,
+      warning = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | error,
+      info    = VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT | warning,
+      verbose = VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT | info;
+
+    const struct { const char* name; VkDebugUtilsMessageSeverityFlagsEXT flags; } levels[] = {
+      { "verbose", verbose },
+      { "info",    info },
+      { "warning", warning },
+      { "error",   error },
+      { "none",    0 }
+    };
+
+    for(auto& level : levels) {
+      if(strcmp(value, level.name) == 0) settings.severities = level.flags;
+    }
+  }
+
+  // VULKAN_MESSAGE_TYPES=<comma separated general,validation,performance>
+  if(const char* value = getenv("VULKAN_MESSAGE_TYPES")) {
+    settings.types = 0;
+    if(strstr(value, "general")) {
+      settings.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT;
+    }
+    if(strstr(value, "validation")) {
+      settings.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
+    }
+    if(strstr(value, "performance")) {
+      settings.types |= VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    }
+  }
+
+  return settings;
+}
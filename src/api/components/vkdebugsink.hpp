@@ -0,0 +1,116 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+/*
+  Where validation messages go.
+
+  The debug callback runs inside the driver, on whatever thread made
+  the call, and with INFO and PERFORMANCE messages on it can fire
+  thousands of times a frame. So all it does here is:
+  - drop what the severity/type filters exclude (two atomic loads)
+  - count the message against its ID, and drop it once that ID went
+    over its budget for the current window
+  - copy it into a lock-free queue
+  A background thread empties the queue into stdout, and at the end of
+  every window reports how many of each ID were suppressed.
+
+  Filters can be changed at any time, VULKAN_MESSAGES and
+  VULKAN_MESSAGE_TYPES set the initial ones (see README).
+*/
+class DebugSink {
+public:
+  static const uint32_t QUEUE_CAPACITY = 1024;
+  static const uint32_t MAX_MESSAGE_LENGTH = 1024;
+  // IDs tracked for rate limiting, more than that share budgets
+  static const uint32_t ID_SLOTS = 512;
+
+  struct Settings {
+    VkDebugUtilsMessageSeverityFlagsEXT severities =
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    VkDebugUtilsMessageTypeFlagsEXT types =
+      VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+      VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+      VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    // Messages with the same ID logged per window, the rest are counted
+    uint32_t perIdLimit = 3;
+    float windowSeconds = 1.0f;
+  };
+
+private:
+  struct Message {
+    VkDebugUtilsMessageSeverityFlagBitsEXT severity;
+    VkDebugUtilsMessageTypeFlagsEXT type;
+    char text[MAX_MESSAGE_LENGTH];
+  };
+
+  // Bounded MPMC queue (Vyukov), we only ever have one consumer
+  struct Slot {
+    std::atomic<uint64_t> sequence;
+    Message message;
+  };
+
+  struct IdCounter {
+    // ID + 1, 0 means free
+    std::atomic<uint64_t> key;
+    std::atomic<uint32_t> count;
+    std::atomic<uint32_t> suppressed;
+  };
+
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> enqueuePosition;
+  uint64_t dequeuePosition;
+
+  std::unique_ptr<IdCounter[]> counters;
+
+  std::atomic<uint32_t> severities;
+  std::atomic<uint32_t> types;
+  std::atomic<uint32_t> perIdLimit;
+  float windowSeconds;
+
+  // Lost because the queue was full
+  std::atomic<uint64_t> dropped;
+
+  std::atomic<bool> running;
+  std::thread logger;
+
+public:
+  DebugSink();
+  ~DebugSink();
+
+  DebugSink(const DebugSink&) = delete;
+  DebugSink& operator=(const DebugSink&) = delete;
+
+  // Allocates the queue and starts the logger thread, nothing is
+  // allocated before this so release builds don't pay for it
+  void Start(Settings);
+  // Logs whatever is still queued and joins the thread
+  void Stop();
+
+  void SetSeverities(VkDebugUtilsMessageSeverityFlagsEXT);
+  void SetTypes(VkDebugUtilsMessageTypeFlagsEXT);
+  void SetPerIdLimit(uint32_t);
+
+  // Called from the debug callback, never blocks
+  void Push(
+    VkDebugUtilsMessageSeverityFlagBitsEXT,
+    VkDebugUtilsMessageTypeFlagsEXT,
+    const VkDebugUtilsMessengerCallbackDataEXT*
+  );
+
+  // Applies VULKAN_MESSAGES / VULKAN_MESSAGE_TYPES on top of `settings`
+  static Settings FromEnvironment(Settings settings);
+
+private:
+  bool CountAgainstLimit(uint64_t id);
+  bool Dequeue(Message&);
+  void Write(const Message&);
+  void ReportSuppressed();
+  void Run();
+};
@@ -0,0 +1,213 @@
+#include "vkgpuprofiler.hpp"
+
+#include "api/vkcapabilities.hpp"
+#include "utils/debug.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+GpuProfiler::Scope::Scope(
+  GpuProfiler& profiler,
+  VkCommandBuffer command,
+  const char* name
+) : profiler(profiler), command(command) {
+  index = profiler.Begin(command, name);
+}
+
+GpuProfiler::Scope::~Scope() {
+  profiler.End(command, index);
+}
+
+GpuProfiler::GpuProfiler()
+  : pool(VK_NULL_HANDLE), supported(false), currentFrame(0), logInterval(0.0f)
+  {}
+
+GpuProfiler::GpuProfiler(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  uint32_t queueFamily,
+  uint32_t framesInFlight
+) : pool(VK_NULL_HANDLE),
+    currentFrame(0),
+    frames(framesInFlight),
+    logInterval(0.0f),
+    lastLog(std::chrono::steady_clock::now()) {
+
+  const DeviceCapabilities& capabilities = Capabilities::Get(physicalDevice);
+  const VkPhysicalDeviceProperties& properties = capabilities.properties;
+  const auto& families = capabilities.queueFamilies;
+
+  // Queues that can't write timestamps report 0 valid bits, in which
+  // case every scope is a no-op and every pass reads as 0ms
+  uint32_t validBits = families[queueFamily].timestampValidBits;
+  supported = validBits > 0;
+  timestampPeriod = properties.limits.timestampPeriod;
+  timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  for(auto& frame : frames) {
+    frame.count = 0;
+    frame.pending = false;
+  }
+
+  if(!supported) return;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+  // Begin and end for every scope of every frame
+  poolInfo.queryCount = framesInFlight * MAX_SCOPES * 2;
+
+  VK_ASSERT(vkCreateQueryPool(device, &poolInfo, nullptr, &pool));
+}
+
+bool GpuProfiler::IsSupported() {
+  return supported;
+}
+
+void GpuProfiler::BeginFrame(VkCommandBuffer command, uint32_t frame) {
+  currentFrame = frame;
+
+  auto& queries = frames[frame];
+  queries.names.clear();
+  queries.count = 0;
+  queries.pending = supported;
+
+  if(!supported) return;
+
+  vkCmdResetQueryPool(command, pool, frame * MAX_SCOPES * 2, MAX_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::Begin(
+  VkCommandBuffer command,
+  const char* name,
+  VkPipelineStageFlagBits stage
+) {
+  auto& queries = frames[currentFrame];
+
+  ASSERT(queries.count < MAX_SCOPES, "Too many GPU profiler scopes");
+
+  uint32_t scope = queries.count++;
+  queries.names.push_back(name);
+
+  if(supported) {
+    uint32_t query = (currentFrame * MAX_SCOPES + scope) * 2;
+    vkCmdWriteTimestamp(command, stage, pool, query);
+  }
+
+  return scope;
+}
+
+void GpuProfiler::End(
+  VkCommandBuffer command,
+  uint32_t scope,
+  VkPipelineStageFlagBits stage
+) {
+  if(!supported) return;
+
+  uint32_t query = (currentFrame * MAX_SCOPES + scope) * 2 + 1;
+  vkCmdWriteTimestamp(command, stage, pool, query);
+}
+
+bool GpuProfiler::Collect(VkDevice device, uint32_t frame) {
+  auto& queries = frames[frame];
+
+  if(!queries.pending || queries.count == 0) return false;
+  queries.pending = false;
+
+  uint64_t timestamps[MAX_SCOPES * 2];
+
+  // No WAIT_BIT: the fence already told us the frame is done, and
+  // if for some reason it isn't, we'd rather skip it than stall
+  VkResult result = vkGetQueryPoolResults(
+    device,
+    pool,
+    frame * MAX_SCOPES * 2,
+    queries.count * 2,
+    sizeof(timestamps),
+    timestamps,
+    sizeof(uint64_t),
+    VK_QUERY_RESULT_64_BIT
+  );
+
+  if(result != VK_SUCCESS) return false;
+
+  for(uint32_t i = 0; i < queries.count; i++) {
+    uint64_t ticks =
+      ((timestamps[i * 2 + 1] & timestampMask) - (timestamps[i * 2] & timestampMask))
+      & timestampMask;
+    float ms = static_cast<float>(ticks) * timestampPeriod / 1e6f;
+
+    auto& timing = FindTiming(queries.names[i]);
+    timing.averageMs = timing.lastMs == 0.0f && timing.averageMs == 0.0f
+      ? ms
+      : timing.averageMs * 0.95f + ms * 0.05f;
+    timing.lastMs = ms;
+    if(ms > timing.maxMs) timing.maxMs = ms;
+  }
+
+  if(logInterval <= 0.0f) return true;
+
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<float> elapsed = now - lastLog;
+
+  if(elapsed.count() >= logInterval) {
+    Log();
+    lastLog = now;
+  }
+
+  return true;
+}
+
+GpuTiming& GpuProfiler::FindTiming(const char* name) {
+  // A handful of passes, a linear search is fine
+  for(auto& timing : timings) {
+    if(timing.name == name || strcmp(timing.name, name) == 0) return timing;
+  }
+
+  timings.push_back({ name, 0.0f, 0.0f, 0.0f });
+  return timings.back();
+}
+
+float GpuProfiler::GetPassMs(const char* name) {
+  for(auto& timing : timings) {
+    if(strcmp(timing.name, name) == 0) return timing.lastMs;
+  }
+
+  return 0.0f;
+}
+
+const std::vector<GpuTiming>& GpuProfiler::GetTimings() {
+  return timings;
+}
+
+void GpuProfiler::SetLogInterval(float seconds) {
+  logInterval = seconds;
+}
+
+void GpuProfiler::Log() {
+  auto flags = std::cout.flags();
+  auto precision = std::cout.precision();
+
+  std::cout << "[GPU]";
+  std::cout << std::fixed << std::setprecision(3);
+
+  for(auto& timing : timings) {
+    std::cout
+      << " | " << timing.name << " " << timing.averageMs
+      << "ms (max " << timing.maxMs << ")";
+    // Max is per log interval
+    timing.maxMs = 0.0f;
+  }
+
+  std::cout << "\n";
+
+  std::cout.flags(flags);
+  std::cout.precision(precision);
+}
+
+void GpuProfiler::Destroy(VkDevice device) {
+  if(pool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device, pool, nullptr);
+  }
+}
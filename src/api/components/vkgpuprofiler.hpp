@@ -0,0 +1,106 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <chrono>
+#include <vector>
+
+struct GpuTiming {
+  // Scope names are expected to be string literals
+  const char* name;
+  // Latest measurement and a smoothed average, in milliseconds
+  float lastMs;
+  float averageMs;
+  float maxMs;
+};
+
+/*
+  GPU timestamps around passes of the command buffer.
+  Each frame in flight gets its own range of queries in one pool, so
+  recording a frame never touches queries the GPU may still write.
+  Results are read once the frame's fence has signaled, at which point
+  they're available and vkGetQueryPoolResults doesn't have to wait.
+
+    gpuProfiler.BeginFrame(command, frame);
+    {
+      GpuProfiler::Scope scope(gpuProfiler, command, "hiz");
+      ... record the pass ...
+    }
+*/
+class GpuProfiler {
+public:
+  static const uint32_t MAX_SCOPES = 32;
+
+  class Scope {
+  private:
+    GpuProfiler& profiler;
+    VkCommandBuffer command;
+    uint32_t index;
+  public:
+    Scope(GpuProfiler&, VkCommandBuffer, const char* name);
+    ~Scope();
+  };
+
+private:
+  struct FrameQueries {
+    std::vector<const char*> names;
+    uint32_t count;
+    // Written by a submitted frame and not read back yet
+    bool pending;
+  };
+
+  VkQueryPool pool;
+  bool supported;
+  // Nanoseconds per tick
+  float timestampPeriod;
+  uint64_t timestampMask;
+
+  uint32_t currentFrame;
+  std::vector<FrameQueries> frames;
+  std::vector<GpuTiming> timings;
+
+  float logInterval;
+  std::chrono::steady_clock::time_point lastLog;
+
+public:
+  GpuProfiler();
+  GpuProfiler(
+    VkDevice,
+    VkPhysicalDevice,
+    uint32_t queueFamily,
+    uint32_t framesInFlight
+  );
+  void Destroy(VkDevice);
+
+  bool IsSupported();
+
+  // Reads back what `frame` recorded last time it was used.
+  // Only call once that frame's fence has signaled.
+  // False when there was nothing new to read.
+  bool Collect(VkDevice, uint32_t frame);
+
+  // Resets `frame`'s queries, must be recorded outside a render pass
+  void BeginFrame(VkCommandBuffer, uint32_t frame);
+
+  uint32_t Begin(
+    VkCommandBuffer,
+    const char* name,
+    VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT
+  );
+  void End(
+    VkCommandBuffer,
+    uint32_t scope,
+    VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+  );
+
+  // 0 if the pass was never measured
+  float GetPassMs(const char* name);
+  const std::vector<GpuTiming>& GetTimings();
+
+  // Prints every pass to stdout every `seconds`, 0 disables it
+  void SetLogInterval(float seconds);
+  void Log();
+
+private:
+  GpuTiming& FindTiming(const char* name);
+};
@@ -0,0 +1,258 @@
+#include "vkhiz.hpp"
+
+#include "utils/debug.hpp"
+
+#include <algorithm>
+
+struct HiZConstants {
+  int32_t inputSize[2];
+  int32_t outputSize[2];
+};
+
+static VkExtent2D LevelExtent(VkExtent2D base, uint32_t level) {
+  return {
+    std::max(1u, base.width >> level),
+    std::max(1u, base.height >> level)
+  };
+}
+
+DepthPyramid::DepthPyramid() : sync2(nullptr) {}
+
+DepthPyramid::DepthPyramid(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  const Image& depth,
+  const Synchronization2* sync2
+) : shaderModule(RESOURCES"shaders/hiz.comp.spv", device),
+    sync2(sync2),
+    depthExtent(depth.extent) {
+
+  // Level 0 is already half the resolution of the depth buffer,
+  // a full resolution copy wouldn't tell us anything new
+  VkExtent2D baseExtent = LevelExtent(depth.extent, 1);
+
+  uint32_t mipLevels = 1;
+  while(LevelExtent(baseExtent, mipLevels - 1).width > 1
+     || LevelExtent(baseExtent, mipLevels - 1).height > 1) {
+    mipLevels++;
+  }
+
+  image = Image(
+    device,
+    physicalDevice,
+    baseExtent,
+    VK_FORMAT_R32_SFLOAT,
+    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    VK_IMAGE_ASPECT_COLOR_BIT,
+    mipLevels
+  );
+
+  // Storage images can only be written one level at a time
+  mipViews.resize(mipLevels);
+  for(uint32_t i = 0; i < mipLevels; i++) {
+    mipViews[i] = image.CreateView(device, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+  }
+
+  CreateSampler(device);
+  CreateDescriptors(device, depth.view);
+}
+
+void DepthPyramid::CreateSampler(VkDevice device) {
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType        = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter    = VK_FILTER_NEAREST;
+  samplerInfo.minFilter    = VK_FILTER_NEAREST;
+  samplerInfo.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.minLod       = 0.0f;
+  samplerInfo.maxLod       = VK_LOD_CLAMP_NONE;
+
+  VK_ASSERT(vkCreateSampler(device, &samplerInfo, nullptr, &sampler));
+}
+
+void DepthPyramid::CreateDescriptors(VkDevice device, VkImageView depthView) {
+  // binding 0 -> level we read from
+  // binding 1 -> level we write to
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding         = 0;
+  bindings[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  bindings[1].binding         = 1;
+  bindings[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags      = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+  setLayoutInfo.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  setLayoutInfo.bindingCount = 2;
+  setLayoutInfo.pBindings    = bindings;
+
+  VK_ASSERT(
+    vkCreateDescriptorSetLayout(device, &setLayoutInfo, nullptr, &setLayout)
+  );
+
+  uint32_t levels = image.mipLevels;
+
+  VkDescriptorPoolSize poolSizes[2]{};
+  poolSizes[0].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  poolSizes[0].descriptorCount = levels;
+  poolSizes[1].type            = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  poolSizes[1].descriptorCount = levels;
+
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets       = levels;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes    = poolSizes;
+
+  VK_ASSERT(
+    vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool)
+  );
+
+  std::vector<VkDescriptorSetLayout> setLayouts(levels, setLayout);
+  descriptorSets.resize(levels);
+
+  VkDescriptorSetAllocateInfo allocInfo{};
+  allocInfo.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool     = descriptorPool;
+  allocInfo.descriptorSetCount = levels;
+  allocInfo.pSetLayouts        = setLayouts.data();
+
+  VK_ASSERT(
+    vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data())
+  );
+
+  for(uint32_t i = 0; i < levels; i++) {
+    // The first level reads straight from the depth buffer,
+    // the others from the level right above them
+    VkDescriptorImageInfo source{};
+    source.sampler     = sampler;
+    source.imageView   = i == 0 ? depthView : mipViews[i - 1];
+    source.imageLayout = i == 0
+      ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+      : VK_IMAGE_LAYOUT_GENERAL;
+
+    VkDescriptorImageInfo destination{};
+    destination.imageView   = mipViews[i];
+    destination.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet          = descriptorSets[i];
+    writes[0].dstBinding      = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo      = &source;
+
+    writes[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet          = descriptorSets[i];
+    writes[1].dstBinding      = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    writes[1].pImageInfo      = &destination;
+
+    vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+  }
+}
+
+void DepthPyramid::CreatePipeline(VkDevice device, PipelineBatch& batch) {
+  VkPushConstantRange pushRange{};
+  pushRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  pushRange.offset     = 0;
+  pushRange.size       = sizeof(HiZConstants);
+
+  VkPipelineLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  layoutInfo.setLayoutCount         = 1;
+  layoutInfo.pSetLayouts            = &setLayout;
+  layoutInfo.pushConstantRangeCount = 1;
+  layoutInfo.pPushConstantRanges    = &pushRange;
+
+  VK_ASSERT(
+    vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout)
+  );
+
+  batch.AddCompute(shaderModule.GetModule(), layout, &pipeline);
+}
+
+void DepthPyramid::Build(VkCommandBuffer command) {
+  // Last frame's contents are useless, so we transition from
+  // UNDEFINED and let the driver discard them. We still wait on
+  // the previous frame's culling, which might be reading them
+  BarrierBatch barriers(*sync2);
+
+  barriers.Image(
+    image.handle,
+    { VK_IMAGE_ASPECT_COLOR_BIT, 0, image.mipLevels, 0, 1 },
+    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_NONE,
+    VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT
+  );
+  barriers.Flush(command);
+
+  vkCmdBindPipeline(command, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+  for(uint32_t i = 0; i < image.mipLevels; i++) {
+    VkExtent2D input  = i == 0
+      ? depthExtent
+      : LevelExtent(image.extent, i - 1);
+    VkExtent2D output = LevelExtent(image.extent, i);
+
+    HiZConstants constants{
+      { (int32_t) input.width,  (int32_t) input.height },
+      { (int32_t) output.width, (int32_t) output.height }
+    };
+
+    vkCmdBindDescriptorSets(
+      command,
+      VK_PIPELINE_BIND_POINT_COMPUTE,
+      layout,
+      0, 1, &descriptorSets[i],
+      0, nullptr
+    );
+
+    vkCmdPushConstants(
+      command,
+      layout,
+      VK_SHADER_STAGE_COMPUTE_BIT,
+      0, sizeof(HiZConstants), &constants
+    );
+
+    // 8x8 workgroups, rounded up
+    vkCmdDispatch(
+      command,
+      (output.width + 7) / 8,
+      (output.height + 7) / 8,
+      1
+    );
+
+    // The next level (and the culling pass) reads this one
+    barriers.Image(
+      image.handle,
+      { VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1 },
+      VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+      VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT
+    );
+    barriers.Flush(command);
+  }
+}
+
+void DepthPyramid::Destroy(VkDevice device) {
+  vkDestroyPipeline(device, pipeline, nullptr);
+  vkDestroyPipelineLayout(device, layout, nullptr);
+  vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+  vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+  vkDestroySampler(device, sampler, nullptr);
+
+  for(auto& view : mipViews) {
+    vkDestroyImageView(device, view, nullptr);
+  }
+
+  image.Destroy(device);
+  shaderModule.Destroy(device);
+}
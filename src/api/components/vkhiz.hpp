@@ -0,0 +1,54 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include "vkbarriers.hpp"
+#include "vkimage.hpp"
+#include "vkpipelinebatch.hpp"
+#include "vkshader.hpp"
+
+#include <vector>
+
+/*
+  Hierarchical-Z pyramid: a mip chain built from the depth buffer
+  where each texel holds the farthest depth of the area it covers.
+  An object whose nearest point is behind that depth is hidden, and
+  coarser levels let us test a whole screen rectangle in 4 fetches.
+*/
+class DepthPyramid {
+private:
+  ShaderModule shaderModule;
+
+  VkDescriptorSetLayout setLayout;
+  VkDescriptorPool descriptorPool;
+  // One per level, each reading the level above it
+  std::vector<VkDescriptorSet> descriptorSets;
+
+  VkPipelineLayout layout;
+  VkPipeline pipeline;
+
+  // Owned by the context
+  const Synchronization2* sync2;
+
+public:
+  VkExtent2D depthExtent;
+  Image image;
+  std::vector<VkImageView> mipViews;
+  // Nearest sampler, we only ever texelFetch() from the pyramid
+  VkSampler sampler;
+
+  DepthPyramid();
+  DepthPyramid(VkDevice, VkPhysicalDevice, const Image& depth, const Synchronization2*);
+  void Destroy(VkDevice);
+
+  // Queues the pipeline in `batch`, call it on the pyramid that stays
+  void CreatePipeline(VkDevice, PipelineBatch& batch);
+
+  // Expects the depth buffer in SHADER_READ_ONLY_OPTIMAL, leaves
+  // the whole pyramid in GENERAL, readable by compute shaders
+  void Build(VkCommandBuffer);
+
+private:
+  void CreateSampler(VkDevice);
+  void CreateDescriptors(VkDevice, VkImageView depthView);
+};
@@ -0,0 +1,83 @@
+#include "vkimage.hpp"
+
+#include "api/vkutils.hpp"
+#include "utils/debug.hpp"
+
+Image::Image()
+  : handle(VK_NULL_HANDLE), memory(VK_NULL_HANDLE), view(VK_NULL_HANDLE),
+    format(VK_FORMAT_UNDEFINED), extent({}), mipLevels(0)
+  {}
+
+Image::Image(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  VkExtent2D extent,
+  VkFormat format,
+  VkImageUsageFlags usage,
+  VkImageAspectFlags aspect,
+  uint32_t mipLevels
+) : format(format), extent(extent), mipLevels(mipLevels) {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType         = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType     = VK_IMAGE_TYPE_2D;
+  imageInfo.format        = format;
+  imageInfo.extent        = { extent.width, extent.height, 1 };
+  imageInfo.mipLevels     = mipLevels;
+  imageInfo.arrayLayers   = 1;
+  imageInfo.samples       = VK_SAMPLE_COUNT_1_BIT;
+  // OPTIMAL lets the driver lay the texels out however it wants,
+  // we never read these images from the CPU anyway
+  imageInfo.tiling        = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage         = usage;
+  imageInfo.sharingMode   = VK_SHARING_MODE_EXCLUSIVE;
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  VK_ASSERT(vkCreateImage(device, &imageInfo, nullptr, &handle));
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(device, handle, &requirements);
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.allocationSize  = requirements.size;
+  allocInfo.memoryTypeIndex = VkUtils::FindMemoryType(
+    physicalDevice,
+    requirements.memoryTypeBits,
+    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+  );
+
+  VK_ASSERT(vkAllocateMemory(device, &allocInfo, nullptr, &memory));
+  VK_ASSERT(vkBindImageMemory(device, handle, memory, 0));
+
+  view = CreateView(device, aspect, 0, mipLevels);
+}
+
+VkImageView Image::CreateView(
+  VkDevice device,
+  VkImageAspectFlags aspect,
+  uint32_t baseMip,
+  uint32_t levelCount
+) {
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image    = handle;
+  viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  viewInfo.format   = format;
+
+  viewInfo.subresourceRange.aspectMask     = aspect;
+  viewInfo.subresourceRange.baseMipLevel   = baseMip;
+  viewInfo.subresourceRange.levelCount     = levelCount;
+  viewInfo.subresourceRange.baseArrayLayer = 0;
+  viewInfo.subresourceRange.layerCount     = 1;
+
+  VkImageView imageView;
+  VK_ASSERT(vkCreateImageView(device, &viewInfo, nullptr, &imageView));
+
+  return imageView;
+}
+
+void Image::Destroy(VkDevice device) {
+  vkDestroyImageView(device, view, nullptr);
+  vkDestroyImage(device, handle, nullptr);
+  vkFreeMemory(device, memory, nullptr);
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+struct Image {
+  VkImage handle;
+  VkDeviceMemory memory;
+  // View over every mip level of the image
+  VkImageView view;
+
+  VkFormat format;
+  VkExtent2D extent;
+  uint32_t mipLevels;
+
+  Image();
+  Image(
+    VkDevice device,
+    VkPhysicalDevice physicalDevice,
+    VkExtent2D extent,
+    VkFormat format,
+    VkImageUsageFlags usage,
+    VkImageAspectFlags aspect,
+    uint32_t mipLevels = 1
+  );
+
+  VkImageView CreateView(
+    VkDevice device,
+    VkImageAspectFlags aspect,
+    uint32_t baseMip,
+    uint32_t levelCount
+  );
+
+  void Destroy(VkDevice device);
+};
@@ -27,8 +27,27 @@ std::vector<VkPipelineShaderStageCreateInfo> Pipeline::CreateShaderStages() {
   return { vertexInfo, fragInfo };
 }
 
-void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
+void Pipeline::CreateRenderPass(
+  VkDevice device,
+  VkFormat format,
+  VkFormat depthFormat
+) {
+  // Occlusion culling splits the frame in two passes over the same
+  // attachments: the early one clears them and draws whatever was
+  // visible last frame, the late one keeps their contents and draws
+  // what the Hi-Z test found to be newly visible.
+  // Load/store ops and layouts don't affect render pass compatibility,
+  // so both share the same pipeline and framebuffers.
+  renderPass     = BuildRenderPass(device, format, depthFormat, false);
+  lateRenderPass = BuildRenderPass(device, format, depthFormat, true);
+}
 
+VkRenderPass Pipeline::BuildRenderPass(
+  VkDevice device,
+  VkFormat format,
+  VkFormat depthFormat,
+  bool late
+) {
   // We need to create some attachments first,
   // namely: `color` and `depth`
   VkAttachmentDescription colorDescriptor{};
@@ -39,7 +58,10 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   // When attachment is loaded, clear it (could ignore or 
   // load from somewhere else)
   // We're clearing so there's no ghost images
-  colorDescriptor.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  // The late pass loads whatever the early pass drew instead
+  colorDescriptor.loadOp = late 
+    ? VK_ATTACHMENT_LOAD_OP_LOAD 
+    : VK_ATTACHMENT_LOAD_OP_CLEAR;
   // When storing attachment, just store (could also discard)
   colorDescriptor.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
 
@@ -54,11 +76,39 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   // we would've had to be more mindful about the initial state
   //* Images are transitioned `from` and `to` different layouts, 
   //* depending on their usage
-  colorDescriptor.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  colorDescriptor.initialLayout = late
+    ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    : VK_IMAGE_LAYOUT_UNDEFINED;
   // Same thing applies for the final layout. In this case,
-  // this layout is required for images that are going to be
-  // presented, so the attachment will be stored this way
-  colorDescriptor.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  // the scene target gets blitted into the swapchain image
+  // afterwards, so the attachment will be stored this way
+  // (only after the late pass, the early one hands it over as is)
+  colorDescriptor.finalLayout = late
+    ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+    : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  // Depth is cleared to the far plane by the early pass, which then
+  // leaves it readable so the Hi-Z pass can sample it. The late pass
+  // tests against it, but nobody reads it after that
+  VkAttachmentDescription depthDescriptor{};
+  depthDescriptor.format         = depthFormat;
+  depthDescriptor.samples        = VK_SAMPLE_COUNT_1_BIT;
+  depthDescriptor.stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depthDescriptor.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+
+  if(late) {
+    depthDescriptor.loadOp        = VK_ATTACHMENT_LOAD_OP_LOAD;
+    depthDescriptor.storeOp       = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthDescriptor.initialLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    depthDescriptor.finalLayout   = 
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  }
+  else {
+    depthDescriptor.loadOp        = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthDescriptor.storeOp       = VK_ATTACHMENT_STORE_OP_STORE;
+    depthDescriptor.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthDescriptor.finalLayout   = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
 
   /*
     Attachments are described with the `VkAttachmentDescription` struct.
@@ -74,11 +124,16 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   // This will make sure Vulkan will optimize the layout for color attachments
   colorAttachRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
+  VkAttachmentReference depthAttachRef{};
+  depthAttachRef.attachment = 1;
+  depthAttachRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
   // Will extend as we add more attachments
   using std:: vector;
 
   vector<VkAttachmentDescription> attachmentDescriptions {
-    colorDescriptor
+    colorDescriptor,
+    depthDescriptor
   };
 
   vector<VkAttachmentReference> attachmentReferences {
@@ -100,6 +155,8 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   */
   subpassDescription.colorAttachmentCount = attachmentReferences.size();
   subpassDescription.pColorAttachments    = attachmentReferences.data();
+  // There can only be one depth attachment, so no count here
+  subpassDescription.pDepthStencilAttachment = &depthAttachRef;
 
   vector<VkSubpassDescription> subpasses {
     subpassDescription
@@ -123,29 +180,65 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   // We are depending of the output of the color
   // attachment of the previous subpass, because
   // we need it to draw
+  // The depth buffer was last written by the previous frame
+  // and read by its Hi-Z pass, and the color was read by its
+  // upscaling blit, so we wait on those too
   subpassDep.srcStageMask = 
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+    VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+    VK_PIPELINE_STAGE_TRANSFER_BIT;
   
   // We signal which outputs of this subpass are
   // actually dependant on the srcStageMask
   // (if we're just waiting for color, the vertex
   // shader could run in parallel just fine)
   subpassDep.dstStageMask =
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 
   // The AccessMask property is set so to tell
   // Vulkan which memory operations are going to
   // be executed, as to help it optimize (and allow)
   // for such operations without sync problems
 
-  // The srcAccessMask is 0 because the pre-subpass
-  // we're talking about doesn't read from any buffer,
-  // it just fills the image with a color.
-  subpassDep.srcAccessMask = 0;
+  // The srcAccessMask covers the writes we must see before
+  // touching the attachments: the early pass overwrites the
+  // depth left by the previous frame, and the late pass builds
+  // on everything the early pass wrote
+  subpassDep.srcAccessMask = late
+    ? VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT 
+      | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
+    : VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
   // The dstAccessMask, however, WILL write color into
   // the output color attachment, so we specify that
   subpassDep.dstAccessMask = 
-    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  // Once the early pass is done, the Hi-Z compute pass
+  // samples its depth, so it must wait for the depth writes
+  VkSubpassDependency depthReadDep{};
+  depthReadDep.srcSubpass    = 0;
+  depthReadDep.dstSubpass    = VK_SUBPASS_EXTERNAL;
+  depthReadDep.srcStageMask  = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+  depthReadDep.dstStageMask  = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+  depthReadDep.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  depthReadDep.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  // And once the late pass is done, its color gets blitted
+  VkSubpassDependency blitDep{};
+  blitDep.srcSubpass    = 0;
+  blitDep.dstSubpass    = VK_SUBPASS_EXTERNAL;
+  blitDep.srcStageMask  = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  blitDep.dstStageMask  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  blitDep.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  blitDep.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  vector<VkSubpassDependency> dependencies { subpassDep };
+  dependencies.push_back(late ? blitDep : depthReadDep);
 
   // After we've defined our subpasses dependencies,
   // we simply include them in our renderPassInfo
@@ -161,15 +254,26 @@ void Pipeline::CreateRenderPass(VkDevice device, VkFormat format) {
   renderPassInfo.subpassCount = subpasses.size();
   renderPassInfo.pSubpasses   = subpasses.data();
 
-  renderPassInfo.dependencyCount = 1;
-  renderPassInfo.pDependencies = &subpassDep;
+  renderPassInfo.dependencyCount = dependencies.size();
+  renderPassInfo.pDependencies = dependencies.data();
 
+  VkRenderPass pass;
   VK_ASSERT(
-    vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass)
+    vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass)
   );
+
+  return pass;
 }
 
-void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D scissor) {
+void Pipeline::CreatePipeline(
+  VkDevice device,
+  VkViewport viewport,
+  VkRect2D scissor,
+  PipelineBatch& batch
+) {
+  // Compiled along with every other pipeline, the batch keeps all
+  // the state below alive until then and links it together
+  GraphicsPipelineDescription& description = batch.AddGraphics(&pipeline);
 
   /*
     Dynamic states allows us to specifies certain states
@@ -186,7 +290,7 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
     make it so we have many extremely similar pipelines, only differing
     in tiny aspects.
   */
-  std::vector<VkDynamicState> dynamicStates = {
+  description.dynamicStates = {
     VK_DYNAMIC_STATE_VIEWPORT,
     VK_DYNAMIC_STATE_SCISSOR
   };
@@ -198,13 +302,11 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
   */
 
   // Describes dynamic states
-  VkPipelineDynamicStateCreateInfo dynamicStateInfo{};
-  dynamicStateInfo.sType             = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamicStateInfo.pDynamicStates    = dynamicStates.data();
-  dynamicStateInfo.dynamicStateCount = dynamicStates.size();
+  VkPipelineDynamicStateCreateInfo& dynamicStateInfo = description.dynamicState;
+  dynamicStateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
 
   // Describes vertex data
-  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  VkPipelineVertexInputStateCreateInfo& vertexInputInfo = description.vertexInput;
   vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
   // Copied directly from `vulkan-tutorial.com`
   // Bindings: spacing between data and whether the data is per-vertex or per-instance (see instancing)
@@ -212,12 +314,12 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
   vertexInputInfo.vertexAttributeDescriptionCount = 0;
   vertexInputInfo.vertexBindingDescriptionCount   = 0;
 
-  VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+  VkPipelineInputAssemblyStateCreateInfo& inputAssemblyInfo = description.inputAssembly;
   inputAssemblyInfo.sType                  = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
   inputAssemblyInfo.topology               = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssemblyInfo.primitiveRestartEnable = VK_FALSE;
 
-  VkPipelineViewportStateCreateInfo viewportInfo{};
+  VkPipelineViewportStateCreateInfo& viewportInfo = description.viewport;
   viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   /* 
   We'd need to set them up on creation like this if we weren't using
@@ -232,7 +334,7 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
   viewportInfo.viewportCount = 1;
   viewportInfo.scissorCount  = 1;
 
-  VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
+  VkPipelineRasterizationStateCreateInfo& rasterizerInfo = description.rasterizer;
   rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
 
   // If enabled, fragments that don't fall into the near and far plane are clamped
@@ -256,14 +358,21 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
 
   // Deals with Multisampling. We'll come back for it, so for now
   // I'll leave it disabled
-  VkPipelineMultisampleStateCreateInfo multisampleInfo{};
+  VkPipelineMultisampleStateCreateInfo& multisampleInfo = description.multisample;
   multisampleInfo.sType                = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampleInfo.sampleShadingEnable  = VK_FALSE;
   multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-  // We could create a struct for Depth Stencil, but it won't
-  // be necessary for now, and we can just pass in a nullptr
-  //? VkPipelineDepthStencilStateCreateInfo stencilInfo{};
+  // Regular depth testing: closer fragments win, and the depth
+  // they leave behind is what the Hi-Z pyramid is built from
+  VkPipelineDepthStencilStateCreateInfo& depthStencilInfo = description.depthStencil;
+  depthStencilInfo.sType            = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencilInfo.depthTestEnable  = VK_TRUE;
+  depthStencilInfo.depthWriteEnable = VK_TRUE;
+  depthStencilInfo.depthCompareOp   = VK_COMPARE_OP_LESS;
+  // No depth bounds or stencil for now
+  depthStencilInfo.depthBoundsTestEnable = VK_FALSE;
+  depthStencilInfo.stencilTestEnable     = VK_FALSE;
 
   /*
     Ok, let's go.
@@ -290,13 +399,12 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
     VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | 
     VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
   blendingAttachment.blendEnable = VK_FALSE;
+  description.blendAttachments = { blendingAttachment };
 
-  VkPipelineColorBlendStateCreateInfo blendingInfo{};
+  VkPipelineColorBlendStateCreateInfo& blendingInfo = description.blending;
   blendingInfo.sType             = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
   blendingInfo.logicOpEnable     = VK_FALSE; // overrides blendEnable if 
   blendingInfo.logicOp           = VK_LOGIC_OP_COPY;
-  blendingInfo.attachmentCount   = 1;
-  blendingInfo.pAttachments      = &blendingAttachment;
   blendingInfo.blendConstants[0] = 0.0f;
   blendingInfo.blendConstants[1] = 0.0f;
   blendingInfo.blendConstants[2] = 0.0f;
@@ -313,27 +421,16 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
     vkCreatePipelineLayout(device, &layoutInfo, nullptr, &layout)
   );
 
-  auto shaderStages = CreateShaderStages();
+  // Shaders
+  description.stages = CreateShaderStages();
 
-  // FINALLY WE CREATE THE PIPELINE
-  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  // FINALLY WE DESCRIBE THE PIPELINE
+  // The states above are linked in by the batch
+  VkGraphicsPipelineCreateInfo& pipelineInfo = description.info;
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 
-  pipelineInfo.pViewportState      = &viewportInfo;
-  pipelineInfo.pDynamicState       = &dynamicStateInfo;
-  pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-  pipelineInfo.pVertexInputState   = &vertexInputInfo;
-  pipelineInfo.pRasterizationState = &rasterizerInfo;
-  pipelineInfo.pMultisampleState   = &multisampleInfo;
-  pipelineInfo.pColorBlendState    = &blendingInfo;
-
-  // pipelineInfo.pDepthStencilState = nullptr;
   // pipelineInfo.pTessellationState = nullptr;
 
-  // Shaders
-  pipelineInfo.stageCount = shaderStages.size();
-  pipelineInfo.pStages    = shaderStages.data();
-
   pipelineInfo.layout = layout;
   pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass    = 0;
@@ -344,22 +441,14 @@ void Pipeline::CreatePipeline(VkDevice device, VkViewport viewport, VkRect2D sci
 // new one
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  // After all that, we can finally create our dreamed pipeline
-
-  VK_ASSERT(
-    vkCreateGraphicsPipelines(
-      device, 
-      VK_NULL_HANDLE, 
-      1,
-      &pipelineInfo,
-      nullptr,
-      &pipeline
-    )
-  );
+  // After all that, our dreamed pipeline is created by batch.Compile(),
+  // where the driver compiles our shaders for real, usually the most
+  // expensive step of startup
 }
 
 void Pipeline::Destroy(VkDevice device) {
   vkDestroyRenderPass(device, renderPass, nullptr);
+  vkDestroyRenderPass(device, lateRenderPass, nullptr);
   vkDestroyPipelineLayout(device, layout, nullptr);
   vkDestroyPipeline(device, pipeline, nullptr);
   vertexShaderModule.Destroy(device);
@@ -1,7 +1,8 @@
 #pragma once
 
-#include <vulkan/vulkan.h>
+#include "api/vkloader.hpp"
 
+#include "vkpipelinebatch.hpp"
 #include "vkshader.hpp"
 #include "api/vkutils.hpp"
 
@@ -13,15 +14,18 @@ private:
 public:
   VkPipeline pipeline;
   VkRenderPass renderPass;
+  VkRenderPass lateRenderPass;
   VkPipelineLayout layout;
   
   Pipeline();
   Pipeline(VkDevice);
   void Destroy(VkDevice);
 
-  void CreatePipeline(VkDevice, VkViewport, VkRect2D);
-  void CreateRenderPass(VkDevice, VkFormat);
+  // Queues it in `batch`, `pipeline` is only there once it's compiled
+  void CreatePipeline(VkDevice, VkViewport, VkRect2D, PipelineBatch& batch);
+  void CreateRenderPass(VkDevice, VkFormat color, VkFormat depth);
 
 private:
+  VkRenderPass BuildRenderPass(VkDevice, VkFormat, VkFormat, bool late);
   std::vector<VkPipelineShaderStageCreateInfo> CreateShaderStages();  
 };
\ No newline at end of file
@@ -0,0 +1,153 @@
+#include "vkpipelinebatch.hpp"
+#include "utils/debug.hpp"
+#include "utils/jobs.hpp"
+#include "utils/profiler.hpp"
+
+#include <algorithm>
+
+GraphicsPipelineDescription& PipelineBatch::AddGraphics(VkPipeline* target) {
+  graphics.emplace_back();
+  graphicsTargets.push_back(target);
+  return graphics.back();
+}
+
+void PipelineBatch::AddCompute(
+  VkShaderModule module,
+  VkPipelineLayout layout,
+  VkPipeline* target
+) {
+  // Compute pipelines are a lot simpler than graphics ones,
+  // there's only one stage and no fixed function state
+  VkComputePipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType        = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipelineInfo.stage.stage  = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipelineInfo.stage.module = module;
+  pipelineInfo.stage.pName  = "main";
+  pipelineInfo.layout       = layout;
+
+  compute.push_back(pipelineInfo);
+  computeTargets.push_back(target);
+}
+
+uint32_t PipelineBatch::Count() {
+  return static_cast<uint32_t>(graphics.size() + compute.size());
+}
+
+void PipelineBatch::Compile(VkDevice device, VkPipelineCache cache) {
+  // The descriptions won't move anymore
+  std::vector<VkGraphicsPipelineCreateInfo> graphicsInfos;
+  for(auto& description : graphics) {
+    description.dynamicState.pDynamicStates    = description.dynamicStates.data();
+    description.dynamicState.dynamicStateCount = static_cast<uint32_t>(description.dynamicStates.size());
+    description.blending.pAttachments    = description.blendAttachments.data();
+    description.blending.attachmentCount = static_cast<uint32_t>(description.blendAttachments.size());
+
+    VkGraphicsPipelineCreateInfo info = description.info;
+    info.sType               = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.pDynamicState       = &description.dynamicState;
+    info.pVertexInputState   = &description.vertexInput;
+    info.pInputAssemblyState = &description.inputAssembly;
+    info.pViewportState      = &description.viewport;
+    info.pRasterizationState = &description.rasterizer;
+    info.pMultisampleState   = &description.multisample;
+    info.pDepthStencilState  = &description.depthStencil;
+    info.pColorBlendState    = &description.blending;
+    info.stageCount          = static_cast<uint32_t>(description.stages.size());
+    info.pStages             = description.stages.data();
+    graphicsInfos.push_back(info);
+  }
+
+  uint32_t graphicsCount = static_cast<uint32_t>(graphicsInfos.size());
+  uint32_t count = Count();
+
+  std::vector<VkPipeline> graphicsPipelines(graphicsCount);
+  std::vector<VkPipeline> computePipelines(compute.size());
+
+  // Per thread, created on first use. Slot 0 is for threads outside
+  // the job system (the one calling this, when it's one of those)
+  std::vector<VkPipelineCache> caches(Jobs::WorkerCount() + 1, VK_NULL_HANDLE);
+  std::vector<char> initialData;
+  if(cache != VK_NULL_HANDLE) initialData = GetCacheData(device, cache);
+
+  Jobs::ParallelFor(count, GRAIN, [&](uint32_t begin, uint32_t end) {
+    PROFILE_ZONE("PipelineBatch::Compile");
+
+    VkPipelineCache& threadCache = caches[Jobs::WorkerIndex() + 1];
+    if(cache != VK_NULL_HANDLE && threadCache == VK_NULL_HANDLE) {
+      threadCache = CreateCache(device, initialData);
+    }
+
+    // Graphics first, then compute, a chunk may have some of both
+    uint32_t graphicsEnd = std::min(end, graphicsCount);
+    if(begin < graphicsEnd) {
+      VK_ASSERT(
+        vkCreateGraphicsPipelines(
+          device,
+          threadCache,
+          graphicsEnd - begin,
+          graphicsInfos.data() + begin,
+          nullptr,
+          graphicsPipelines.data() + begin
+        )
+      );
+    }
+
+    uint32_t computeBegin = std::max(begin, graphicsCount);
+    if(computeBegin < end) {
+      VK_ASSERT(
+        vkCreateComputePipelines(
+          device,
+          threadCache,
+          end - computeBegin,
+          compute.data() + (computeBegin - graphicsCount),
+          nullptr,
+          computePipelines.data() + (computeBegin - graphicsCount)
+        )
+      );
+    }
+  });
+
+  for(uint32_t i = 0; i < graphicsCount; i++) *graphicsTargets[i] = graphicsPipelines[i];
+  for(size_t i = 0; i < compute.size(); i++) *computeTargets[i] = computePipelines[i];
+
+  std::vector<VkPipelineCache> used;
+  for(VkPipelineCache threadCache : caches) {
+    if(threadCache != VK_NULL_HANDLE) used.push_back(threadCache);
+  }
+
+  if(!used.empty()) {
+    VK_ASSERT(
+      vkMergePipelineCaches(device, cache, static_cast<uint32_t>(used.size()), used.data())
+    );
+    for(VkPipelineCache threadCache : used) vkDestroyPipelineCache(device, threadCache, nullptr);
+  }
+
+  graphics.clear();
+  graphicsTargets.clear();
+  compute.clear();
+  computeTargets.clear();
+}
+
+VkPipelineCache PipelineBatch::CreateCache(VkDevice device, const std::vector<char>& data) {
+  VkPipelineCacheCreateInfo cacheInfo{};
+  cacheInfo.sType           = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = data.size();
+  cacheInfo.pInitialData    = data.empty() ? nullptr : data.data();
+
+  VkPipelineCache cache;
+  VK_ASSERT(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache));
+  return cache;
+}
+
+std::vector<char> PipelineBatch::GetCacheData(VkDevice device, VkPipelineCache cache) {
+  size_t size = 0;
+  VK_ASSERT(vkGetPipelineCacheData(device, cache, &size, nullptr));
+
+  std::vector<char> data(size);
+  if(size > 0) {
+    VK_ASSERT(vkGetPipelineCacheData(device, cache, &size, data.data()));
+    data.resize(size);
+  }
+  return data;
+}
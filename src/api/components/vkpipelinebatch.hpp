@@ -0,0 +1,72 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <deque>
+#include <vector>
+
+// Everything a graphics pipeline points to, kept alive by the batch.
+// Fill in the states, Compile() links them into `info`
+struct GraphicsPipelineDescription {
+  std::vector<VkDynamicState> dynamicStates;
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  VkPipelineVertexInputStateCreateInfo vertexInput{};
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  VkPipelineViewportStateCreateInfo viewport{};
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  VkPipelineMultisampleStateCreateInfo multisample{};
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  std::vector<VkPipelineColorBlendAttachmentState> blendAttachments;
+  VkPipelineColorBlendStateCreateInfo blending{};
+  std::vector<VkPipelineShaderStageCreateInfo> stages;
+
+  // Layout, render pass, subpass... the state pointers are ours
+  VkGraphicsPipelineCreateInfo info{};
+};
+
+/*
+  Every pipeline startup needs, compiled at once.
+
+    PipelineBatch batch;
+    pipeline.CreatePipeline(device, viewport, scissor, batch);
+    depthPyramid.CreatePipeline(device, batch);
+    batch.Compile(device, pipelineCache);
+    // Only now are the pipelines there
+
+  Compiling is where the driver turns SPIR-V into GPU code, by far
+  the slowest part of startup, and it takes any number of threads.
+  Compile() hands the pipelines out to job workers a few at a time
+  (one vkCreate*Pipelines call each). Every thread compiles into a
+  cache of its own, threads sharing one would contend on its lock.
+  These start out as copies of `cache`, and are merged back into it
+  with vkMergePipelineCaches at the end.
+*/
+class PipelineBatch {
+private:
+  // Addresses are handed out, hence the deque
+  std::deque<GraphicsPipelineDescription> graphics;
+  std::vector<VkPipeline*> graphicsTargets;
+
+  std::vector<VkComputePipelineCreateInfo> compute;
+  std::vector<VkPipeline*> computeTargets;
+
+public:
+  // Pipelines per vkCreate*Pipelines call, more means fewer calls
+  // but less to share out
+  static const uint32_t GRAIN = 1;
+
+  // `target` gets the pipeline, and must still be there when compiling
+  GraphicsPipelineDescription& AddGraphics(VkPipeline* target);
+  void AddCompute(VkShaderModule, VkPipelineLayout, VkPipeline* target);
+
+  uint32_t Count();
+
+  // Creates every pipeline added and empties the batch. `cache` can
+  // be VK_NULL_HANDLE, then there are no caches at all
+  void Compile(VkDevice, VkPipelineCache cache);
+
+  // Seeded with `data` (what GetCacheData gave, possibly another
+  // driver's or empty, which the driver checks for itself)
+  static VkPipelineCache CreateCache(VkDevice, const std::vector<char>& data);
+  static std::vector<char> GetCacheData(VkDevice, VkPipelineCache);
+};
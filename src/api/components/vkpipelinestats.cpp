@@ -0,0 +1,215 @@
+#include "vkpipelinestats.hpp"
+
+#include "utils/debug.hpp"
+
+#include <cstring>
+#include <iostream>
+
+PipelineStatistics::Scope::Scope(
+  PipelineStatistics& statistics,
+  VkCommandBuffer command,
+  const char* name
+) : statistics(statistics), command(command) {
+  index = statistics.Begin(command, name);
+}
+
+PipelineStatistics::Scope::~Scope() {
+  statistics.End(command, index);
+}
+
+PipelineStatistics::PipelineStatistics()
+  : pool(VK_NULL_HANDLE),
+    supported(false),
+    enabled(false),
+    active(false),
+    currentFrame(0),
+    logInterval(0.0f)
+  {}
+
+PipelineStatistics::PipelineStatistics(
+  VkDevice device,
+  bool featureEnabled,
+  uint32_t framesInFlight
+) : pool(VK_NULL_HANDLE),
+    supported(featureEnabled),
+    enabled(false),
+    active(false),
+    currentFrame(0),
+    frames(framesInFlight),
+    logInterval(0.0f),
+    lastLog(std::chrono::steady_clock::now()) {
+
+  for(auto& frame : frames) {
+    frame.count = 0;
+    frame.pending = false;
+  }
+
+  if(!supported) return;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType              = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType          = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+  poolInfo.pipelineStatistics = FLAGS;
+  // Unlike timestamps, one query covers a whole scope
+  poolInfo.queryCount         = framesInFlight * MAX_SCOPES;
+
+  VK_ASSERT(vkCreateQueryPool(device, &poolInfo, nullptr, &pool));
+}
+
+bool PipelineStatistics::IsSupported() {
+  return supported;
+}
+
+void PipelineStatistics::SetEnabled(bool value) {
+  enabled = value;
+}
+
+bool PipelineStatistics::IsEnabled() {
+  return enabled;
+}
+
+void PipelineStatistics::BeginFrame(VkCommandBuffer command, uint32_t frame) {
+  currentFrame = frame;
+
+  auto& queries = frames[frame];
+  queries.names.clear();
+  queries.count = 0;
+  queries.pending = supported && enabled;
+
+  if(!queries.pending) return;
+
+  vkCmdResetQueryPool(command, pool, frame * MAX_SCOPES, MAX_SCOPES);
+}
+
+uint32_t PipelineStatistics::Begin(VkCommandBuffer command, const char* name) {
+  auto& queries = frames[currentFrame];
+
+  // Disabled for this frame
+  if(!queries.pending) return UINT32_MAX;
+
+  ASSERT(!active, "Pipeline statistics scopes can't be nested");
+  ASSERT(queries.count < MAX_SCOPES, "Too many pipeline statistics scopes");
+
+  uint32_t scope = queries.count++;
+  queries.names.push_back(name);
+  active = true;
+
+  vkCmdBeginQuery(command, pool, currentFrame * MAX_SCOPES + scope, 0);
+
+  return scope;
+}
+
+void PipelineStatistics::End(VkCommandBuffer command, uint32_t scope) {
+  if(scope == UINT32_MAX) return;
+
+  vkCmdEndQuery(command, pool, currentFrame * MAX_SCOPES + scope);
+  active = false;
+}
+
+bool PipelineStatistics::Collect(VkDevice device, uint32_t frame) {
+  auto& queries = frames[frame];
+
+  if(!queries.pending || queries.count == 0) return false;
+  queries.pending = false;
+
+  uint64_t results[MAX_SCOPES * COUNTER_COUNT];
+
+  // Same as the timestamps, the fence already signaled so there's
+  // nothing to wait for
+  VkResult result = vkGetQueryPoolResults(
+    device,
+    pool,
+    frame * MAX_SCOPES,
+    queries.count,
+    sizeof(results),
+    results,
+    sizeof(uint64_t) * COUNTER_COUNT,
+    VK_QUERY_RESULT_64_BIT
+  );
+
+  if(result != VK_SUCCESS) return false;
+
+  for(uint32_t i = 0; i < queries.count; i++) {
+    uint64_t* counters = &results[i * COUNTER_COUNT];
+
+    auto& pass = FindPass(queries.names[i]);
+    pass.last = PipelineCounters{
+      counters[0], counters[1], counters[2],
+      counters[3], counters[4], counters[5]
+    };
+
+    pass.total.inputVertices       += pass.last.inputVertices;
+    pass.total.inputPrimitives     += pass.last.inputPrimitives;
+    pass.total.vertexInvocations   += pass.last.vertexInvocations;
+    pass.total.clippingPrimitives  += pass.last.clippingPrimitives;
+    pass.total.fragmentInvocations += pass.last.fragmentInvocations;
+    pass.total.computeInvocations  += pass.last.computeInvocations;
+    pass.frames++;
+  }
+
+  if(logInterval <= 0.0f) return true;
+
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<float> elapsed = now - lastLog;
+
+  if(elapsed.count() >= logInterval) {
+    Log();
+    lastLog = now;
+  }
+
+  return true;
+}
+
+PassStatistics& PipelineStatistics::FindPass(const char* name) {
+  for(auto& pass : passes) {
+    if(pass.name == name || strcmp(pass.name, name) == 0) return pass;
+  }
+
+  passes.push_back({ name, {}, {}, 0 });
+  return passes.back();
+}
+
+const std::vector<PassStatistics>& PipelineStatistics::GetPasses() {
+  return passes;
+}
+
+void PipelineStatistics::ResetTotals() {
+  for(auto& pass : passes) {
+    pass.total = {};
+    pass.frames = 0;
+  }
+}
+
+void PipelineStatistics::SetLogInterval(float seconds) {
+  logInterval = seconds;
+}
+
+void PipelineStatistics::Log() {
+  std::cout << "[STATS]";
+
+  // Last frame only, totals are for whoever reset them
+  for(auto& pass : passes) {
+    const auto& c = pass.last;
+    std::cout << " | " << pass.name;
+
+    if(c.computeInvocations > 0) {
+      std::cout << " cs " << c.computeInvocations;
+    }
+    if(c.inputVertices > 0) {
+      std::cout
+        << " verts " << c.inputVertices
+        << " prims " << c.inputPrimitives
+        << " vs " << c.vertexInvocations
+        << " clip " << c.clippingPrimitives
+        << " fs " << c.fragmentInvocations;
+    }
+  }
+
+  std::cout << "\n";
+}
+
+void PipelineStatistics::Destroy(VkDevice device) {
+  if(pool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(device, pool, nullptr);
+  }
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Same order as the bits in PipelineStatistics::FLAGS, which is
+// the order Vulkan writes them in
+struct PipelineCounters {
+  uint64_t inputVertices;
+  uint64_t inputPrimitives;
+  uint64_t vertexInvocations;
+  uint64_t clippingPrimitives;
+  // Pixels shaded, compared against the pixel count it tells us
+  // how much overdraw a pass has
+  uint64_t fragmentInvocations;
+  uint64_t computeInvocations;
+};
+
+struct PassStatistics {
+  // Scope names are expected to be string literals
+  const char* name;
+  PipelineCounters last;
+  // Summed over `frames` frames since the last ResetTotals
+  PipelineCounters total;
+  uint64_t frames;
+};
+
+/*
+  Counts of the work each pass generated on the GPU, the counterpart
+  to GpuProfiler's timings. Works the same way: a range of queries per
+  frame in flight, read back after the frame's fence has signaled.
+
+    PipelineStatistics::Scope stats(pipelineStats, command, "scene.early");
+
+  Unlike timestamps, statistics queries can't be nested, so scopes go
+  around single passes (or single draws), never around the whole frame.
+  It needs the pipelineStatisticsQuery feature, and it's off until
+  SetEnabled(true), in both cases every scope is a no-op.
+*/
+class PipelineStatistics {
+public:
+  static const uint32_t MAX_SCOPES = 16;
+  static const VkQueryPipelineStatisticFlags FLAGS =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+  static const uint32_t COUNTER_COUNT = 6;
+
+  class Scope {
+  private:
+    PipelineStatistics& statistics;
+    VkCommandBuffer command;
+    uint32_t index;
+  public:
+    Scope(PipelineStatistics&, VkCommandBuffer, const char* name);
+    ~Scope();
+  };
+
+private:
+  struct FrameQueries {
+    std::vector<const char*> names;
+    uint32_t count;
+    bool pending;
+  };
+
+  VkQueryPool pool;
+  bool supported;
+  bool enabled;
+  // A query is open, nothing else may begin until it ends
+  bool active;
+
+  uint32_t currentFrame;
+  std::vector<FrameQueries> frames;
+  std::vector<PassStatistics> passes;
+
+  float logInterval;
+  std::chrono::steady_clock::time_point lastLog;
+
+public:
+  PipelineStatistics();
+  PipelineStatistics(
+    VkDevice,
+    bool featureEnabled,
+    uint32_t framesInFlight
+  );
+  void Destroy(VkDevice);
+
+  bool IsSupported();
+  // Takes effect from the next BeginFrame
+  void SetEnabled(bool);
+  bool IsEnabled();
+
+  // Same rules as GpuProfiler::Collect
+  bool Collect(VkDevice, uint32_t frame);
+
+  // Resets `frame`'s queries, must be recorded outside a render pass
+  void BeginFrame(VkCommandBuffer, uint32_t frame);
+
+  // UINT32_MAX when nothing was recorded
+  uint32_t Begin(VkCommandBuffer, const char* name);
+  void End(VkCommandBuffer, uint32_t scope);
+
+  const std::vector<PassStatistics>& GetPasses();
+  void ResetTotals();
+
+  // Prints every pass to stdout every `seconds`, 0 disables it
+  void SetLogInterval(float seconds);
+  void Log();
+
+private:
+  PassStatistics& FindPass(const char* name);
+};
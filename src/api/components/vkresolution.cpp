@@ -0,0 +1,192 @@
+#include "vkresolution.hpp"
+
+#include "utils/debug.hpp"
+#include "utils/math.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+DynamicResolution::DynamicResolution() : sync2(nullptr) {}
+
+DynamicResolution::DynamicResolution(
+  VkDevice device,
+  VkPhysicalDevice physicalDevice,
+  VkExtent2D swapchainExtent,
+  VkFormat format,
+  const Synchronization2* sync2,
+  Settings settings
+) : settings(settings),
+    sync2(sync2),
+    fullExtent(swapchainExtent),
+    filteredMs(0.0f),
+    scale(settings.maxScale),
+    framebuffer(VK_NULL_HANDLE) {
+
+  color = Image(
+    device,
+    physicalDevice,
+    swapchainExtent,
+    format,
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    VK_IMAGE_ASPECT_COLOR_BIT
+  );
+
+  // Linear upscaling looks a lot better, but not every format
+  // supports it
+  VkFormatProperties properties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+
+  blitFilter = 
+    (properties.optimalTilingFeatures 
+      & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)
+    ? VK_FILTER_LINEAR
+    : VK_FILTER_NEAREST;
+
+  Update(0.0f);
+}
+
+void DynamicResolution::CreateFrameBuffer(
+  VkDevice device,
+  VkRenderPass renderPass,
+  VkImageView depthView
+) {
+  VkImageView attachments[] = {
+    color.view,
+    depthView
+  };
+
+  // The framebuffer always covers the whole target, we just
+  // restrict the viewport to the part we're using
+  VkFramebufferCreateInfo frameBufferInfo{};
+  frameBufferInfo.sType           = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  frameBufferInfo.attachmentCount = 2;
+  frameBufferInfo.pAttachments    = attachments;
+  frameBufferInfo.layers          = 1;
+  frameBufferInfo.width           = fullExtent.width;
+  frameBufferInfo.height          = fullExtent.height;
+  frameBufferInfo.renderPass      = renderPass;
+
+  VK_ASSERT(
+    vkCreateFramebuffer(device, &frameBufferInfo, nullptr, &framebuffer)
+  );
+}
+
+void DynamicResolution::SetSettings(Settings newSettings) {
+  settings = newSettings;
+  filteredMs = 0.0f;
+  scale = settings.maxScale;
+
+  Update(0.0f);
+}
+
+void DynamicResolution::Update(float gpuMs) {
+  if(settings.enabled && gpuMs > 0.0f) {
+    filteredMs = filteredMs == 0.0f
+      ? gpuMs
+      : filteredMs * 0.9f + gpuMs * 0.1f;
+
+    // GPU time grows with the pixel count, which is scale squared.
+    // Going down we react right away to avoid dropping frames,
+    // going up we take small steps so we don't oscillate
+    if(filteredMs > settings.targetMs * 0.95f) {
+      scale *= std::sqrt(settings.targetMs / filteredMs);
+    }
+    else if(filteredMs < settings.targetMs * 0.8f) {
+      scale *= 1.02f;
+    }
+
+    scale = MathUtils::clamp(scale, settings.minScale, settings.maxScale);
+  }
+
+  // Snapping to 1/64ths keeps tiny changes from touching the extent
+  float snapped = std::round(scale * 64.0f) / 64.0f;
+
+  renderExtent = {
+    std::max(1u, static_cast<uint32_t>(fullExtent.width * snapped)),
+    std::max(1u, static_cast<uint32_t>(fullExtent.height * snapped))
+  };
+}
+
+void DynamicResolution::SetScale(float value) {
+  scale = MathUtils::clamp(value, settings.minScale, settings.maxScale);
+
+  Update(0.0f);
+}
+
+float DynamicResolution::GetScale() {
+  return scale;
+}
+
+VkViewport DynamicResolution::GetViewport() {
+  return VkViewport{
+    .x = 0.0f,
+    .y = 0.0f,
+    .width = static_cast<float>(renderExtent.width),
+    .height = static_cast<float>(renderExtent.height),
+    .minDepth = 0.0f,
+    .maxDepth = 1.0f
+  };
+}
+
+VkRect2D DynamicResolution::GetScissor() {
+  return VkRect2D{
+    .offset = { 0, 0 },
+    .extent = renderExtent
+  };
+}
+
+void DynamicResolution::Blit(VkCommandBuffer command, VkImage swapchainImage) {
+  BarrierBatch barriers(*sync2);
+  const VkImageSubresourceRange range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+  // Whatever was presented before gets overwritten anyway. The
+  // source stage is the one the acquire semaphore is waited on
+  barriers.Image(
+    swapchainImage,
+    range,
+    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_NONE,
+    VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT
+  );
+  barriers.Flush(command);
+
+  VkImageBlit region{};
+  region.srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.srcOffsets[0]  = { 0, 0, 0 };
+  region.srcOffsets[1]  = {
+    static_cast<int32_t>(renderExtent.width),
+    static_cast<int32_t>(renderExtent.height),
+    1
+  };
+  region.dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+  region.dstOffsets[0]  = { 0, 0, 0 };
+  region.dstOffsets[1]  = {
+    static_cast<int32_t>(fullExtent.width),
+    static_cast<int32_t>(fullExtent.height),
+    1
+  };
+
+  vkCmdBlitImage(
+    command,
+    color.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+    swapchainImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+    1, &region,
+    blitFilter
+  );
+
+  // Presentation is synchronized through the semaphore, so
+  // nothing after this needs to wait on the blit
+  barriers.Image(
+    swapchainImage,
+    range,
+    VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+    VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT,
+    VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE
+  );
+  barriers.Flush(command);
+}
+
+void DynamicResolution::Destroy(VkDevice device) {
+  vkDestroyFramebuffer(device, framebuffer, nullptr);
+  color.Destroy(device);
+}
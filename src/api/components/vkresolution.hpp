@@ -0,0 +1,75 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include "vkbarriers.hpp"
+#include "vkimage.hpp"
+
+/*
+  The scene is no longer rendered straight into the swapchain.
+  It goes into an offscreen target as big as the swapchain, of which
+  we only use the top-left `renderExtent` part, and that part gets
+  upscaled into the swapchain image with a blit.
+  When GPU frame time goes over budget, we shrink `renderExtent`
+  instead of missing the frame, and grow it back once there's room.
+*/
+class DynamicResolution {
+public:
+  struct Settings {
+    bool enabled = true;
+    // GPU time we want each frame to fit in
+    float targetMs = 16.6f;
+    // Fraction of the swapchain extent, per axis
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+  };
+
+private:
+  Settings settings;
+  // Owned by the context
+  const Synchronization2* sync2;
+
+  VkExtent2D fullExtent;
+  VkFilter blitFilter;
+
+  // Smoothed GPU time, a single slow frame shouldn't move us
+  float filteredMs;
+  float scale;
+
+public:
+  Image color;
+  VkFramebuffer framebuffer;
+  VkExtent2D renderExtent;
+
+  DynamicResolution();
+  DynamicResolution(
+    VkDevice,
+    VkPhysicalDevice,
+    VkExtent2D swapchainExtent,
+    VkFormat format,
+    const Synchronization2*,
+    Settings settings
+  );
+  void Destroy(VkDevice);
+
+  // Attachments must match the scene render passes: color, depth
+  void CreateFrameBuffer(VkDevice, VkRenderPass, VkImageView depthView);
+
+  // Starts over from `maxScale` with the new settings
+  void SetSettings(Settings);
+
+  // Feeds the GPU time of a finished frame, picks the next extent
+  void Update(float gpuMs);
+
+  // Forces a scale (within min/max), replays use it with the
+  // settings disabled so Update leaves it alone
+  void SetScale(float);
+
+  float GetScale();
+  VkViewport GetViewport();
+  VkRect2D GetScissor();
+
+  // Expects `color` in TRANSFER_SRC_OPTIMAL, leaves the swapchain
+  // image in PRESENT_SRC_KHR
+  void Blit(VkCommandBuffer, VkImage swapchainImage);
+};
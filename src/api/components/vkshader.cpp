@@ -1,21 +1,92 @@
 #include "vkshader.hpp"
+#include "utils/assetio.hpp"
 #include "utils/file.hpp"
 #include "utils/debug.hpp"
+#include "utils/jobs.hpp"
+#include "utils/startup.hpp"
+
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace {
+  struct Preloaded {
+    Jobs::Counter loaded;
+    std::vector<char> code;
+  };
+
+  std::mutex preloadLock;
+  std::unordered_map<std::string, std::unique_ptr<Preloaded>> preloaded;
+
+  // The preloaded code if there's any, read right now otherwise
+  std::vector<char> TakeSource(const char* path) {
+    std::unique_ptr<Preloaded> entry;
+    {
+      std::lock_guard<std::mutex> guard(preloadLock);
+      auto found = preloaded.find(path);
+      if(found != preloaded.end()) {
+        entry = std::move(found->second);
+        preloaded.erase(found);
+      }
+    }
+
+    if(!entry) return FileUtils::ReadBinary(path);
+
+    Jobs::Wait(entry->loaded);
+    // Failed, let the usual path complain
+    if(entry->code.empty()) return FileUtils::ReadBinary(path);
+    return std::move(entry->code);
+  }
+}
 
 ShaderModule::ShaderModule() {}
 
+void ShaderModule::Preload(const std::vector<const char*>& paths) {
+  std::vector<AssetIO::Request> requests;
+
+  {
+    std::lock_guard<std::mutex> guard(preloadLock);
+    for(const char* path : paths) {
+      auto& entry = preloaded[path];
+      if(entry) continue;
+      entry = std::make_unique<Preloaded>();
+      Preloaded* target = entry.get();
+
+      // The decode step: keep it only if it looks like SPIR-V
+      auto decode = [target](const char* data, size_t size) {
+        const uint32_t SPIRV_MAGIC = 0x07230203;
+        uint32_t magic = 0;
+        if(data == nullptr || size < sizeof(magic) || size % 4 != 0) return;
+        memcpy(&magic, data, sizeof(magic));
+        if(magic == SPIRV_MAGIC) target->code.assign(data, data + size);
+      };
+      requests.push_back({ path, decode, &target->loaded });
+    }
+  }
+
+  AssetIO::GetService().Load(requests);
+}
+
 ShaderModule::ShaderModule(const char* path, VkDevice device) {
-  auto source = FileUtils::ReadBinary(path);
+  // Just the file name, paths are long and all in the same folder
+  const char* name = strrchr(path, '/');
+  STARTUP_PHASE("LoadShader ", name ? name + 1 : path);
 
-  ASSERT(source.size() != 0, "Invalid shader source");
+  *this = ShaderModule(TakeSource(path), device);
+}
+
+ShaderModule::ShaderModule(const std::vector<char>& code, VkDevice device) {
+  ASSERT(code.size() != 0, "Invalid shader source");
 
   VkShaderModuleCreateInfo shaderInfo{};
 
   shaderInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  shaderInfo.codeSize = source.size();
+  shaderInfo.codeSize = code.size();
   // reinterpret_cast<>() -> Basically just a pointer cast, does not 
   // change the data.
-  shaderInfo.pCode = reinterpret_cast<const uint32_t*>(source.data());
+  shaderInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
 
   VK_ASSERT(
     vkCreateShaderModule(
@@ -27,6 +98,11 @@ ShaderModule::ShaderModule(const char* path, VkDevice device) {
   );
 }
 
+Tasks::Task<ShaderModule> ShaderModule::Load(std::string path, VkDevice device) {
+  std::vector<char> code = co_await Tasks::ReadFile(std::move(path));
+  co_return ShaderModule(code, device);
+}
+
 void ShaderModule::Destroy(VkDevice device) {
   vkDestroyShaderModule(device, handle, nullptr);
 }
@@ -1,6 +1,10 @@
 #pragma once
 
-#include "vulkan/vulkan.h"
+#include "api/vkloader.hpp"
+#include "utils/tasks.hpp"
+
+#include <string>
+#include <vector>
 
 class ShaderModule {
 private:
@@ -8,7 +12,16 @@ private:
 public:
   ShaderModule();
   ShaderModule(const char*, VkDevice);
+  // From SPIR-V already in memory
+  ShaderModule(const std::vector<char>& code, VkDevice);
   void Destroy(VkDevice);
 
+  // Starts reading these in the background (see utils/assetio.hpp),
+  // their constructors then only wait for whatever is left
+  static void Preload(const std::vector<const char*>& paths);
+
+  // Reads without blocking, then creates it on a job worker
+  static Tasks::Task<ShaderModule> Load(std::string path, VkDevice);
+
   VkShaderModule& GetModule();
 };
\ No newline at end of file
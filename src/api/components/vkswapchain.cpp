@@ -1,8 +1,9 @@
-#include <vulkan/vulkan.h>
+#include "api/vkloader.hpp"
 
 #include "./vkswapchain.hpp"
 
 #include "../vkcontext.hpp"
+#include "../vkcapabilities.hpp"
 #include "../vkutils.hpp"
 #include "../../utils/math.hpp"
 #include "../../utils/debug.hpp"
@@ -15,12 +16,19 @@ Swapchain::Swapchain()
   : handle(VK_NULL_HANDLE), format(VK_FORMAT_UNDEFINED), extent({}) 
   {}
 
+Swapchain::Swapchain(VkExtent2D extent, VkFormat format)
+  : handle(VK_NULL_HANDLE), format(format), extent(extent)
+  {}
+
 Swapchain::Swapchain(
   GLFWwindow *window, 
   VkDevice device,
   VkPhysicalDevice physicalDevice,
   VkSurfaceKHR surface
 ) {
+  // Whatever we knew about the surface is from before the window
+  // changed, which is why the swapchain is being (re)created
+  Capabilities::InvalidateSurface(surface);
 
   auto swapchainDetails = VkUtils::FindSwapchainSupport(
     physicalDevice,
@@ -105,7 +113,10 @@ Swapchain::Swapchain(
 
   swapchainInfo.minImageCount = imageCount;
   swapchainInfo.imageArrayLayers = 1;
-  swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  // We never render into these directly, the scene target
+  // gets blitted into them (see DynamicResolution)
+  swapchainInfo.imageUsage = 
+    VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 
   auto queueIndices = VkUtils::FindQueueFamilies(
     physicalDevice, 
@@ -173,13 +184,11 @@ Swapchain::Swapchain(
 
 void Swapchain::Destroy(VkDevice device)
 {
-  for(auto& frameBuffer : frameBuffers) {
-    vkDestroyFramebuffer(device, frameBuffer, nullptr);
-  }
-
   for(auto& imageView : imageViews) {
     vkDestroyImageView(device, imageView, nullptr);
   }
+
+  depth.Destroy(device);
 }
 
 void Swapchain::CreateImageViews(VkDevice device) {
@@ -215,38 +224,18 @@ void Swapchain::CreateImageViews(VkDevice device) {
   }
 }
 
-void Swapchain::CreateFrameBuffers(
+void Swapchain::CreateDepthResources(
   VkDevice device,
-  VkRenderPass renderPass
+  VkPhysicalDevice physicalDevice
 ) {
-  // We must create a Framebuffer for each
-  // imageView attachment
-  frameBuffers.resize(imageViews.size());
-
-  for(int i = 0; i < imageViews.size(); i++) {
-    VkImageView attachments[] = {
-      imageViews[i]
-    };
-
-    VkFramebufferCreateInfo frameBufferInfo{};
-    frameBufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-
-    frameBufferInfo.attachmentCount = 1;
-    frameBufferInfo.pAttachments = attachments;
-    frameBufferInfo.layers = 1;
-
-    frameBufferInfo.width = extent.width;
-    frameBufferInfo.height = extent.height;
-
-    frameBufferInfo.renderPass = renderPass;
-
-    VK_ASSERT(
-      vkCreateFramebuffer(
-        device, 
-        &frameBufferInfo, 
-        nullptr,
-        &frameBuffers[i]
-      )
-    );
-  }
-}
\ No newline at end of file
+  // Besides being a depth attachment, the depth buffer is
+  // sampled by the Hi-Z pass to build the occlusion pyramid
+  depth = Image(
+    device,
+    physicalDevice,
+    extent,
+    VkUtils::FindDepthFormat(physicalDevice),
+    VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    VK_IMAGE_ASPECT_DEPTH_BIT
+  );
+}
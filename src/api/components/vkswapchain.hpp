@@ -1,8 +1,10 @@
 #pragma once
 
-#include <vulkan/vulkan.h>
+#include "api/vkloader.hpp"
 #include "GLFW/glfw3.h"
 
+#include "vkimage.hpp"
+
 #include <vector>
 
 struct Swapchain {
@@ -10,11 +12,14 @@ struct Swapchain {
 
   std::vector<VkImage> images;
   std::vector<VkImageView> imageViews;
-  std::vector<VkFramebuffer> frameBuffers;
 
   VkFormat format;
   VkExtent2D extent;
 
+  // A single depth buffer is shared by every swapchain image,
+  // since only one frame is ever rasterizing at a time
+  Image depth;
+
   Swapchain();
   Swapchain(
     GLFWwindow *window,
@@ -22,9 +27,12 @@ struct Swapchain {
     VkPhysicalDevice phyisicalDevice,
     VkSurfaceKHR surface
   );
+  // Headless stand-in: no handle and no images, just the
+  // extent and format the offscreen targets are created with
+  Swapchain(VkExtent2D extent, VkFormat format);
 
   void Destroy(VkDevice device);
 
-  void CreateFrameBuffers(VkDevice, VkRenderPass);
   void CreateImageViews(VkDevice);
+  void CreateDepthResources(VkDevice, VkPhysicalDevice);
 };
\ No newline at end of file
@@ -0,0 +1,148 @@
+#include "vktimeline.hpp"
+#include "utils/debug.hpp"
+#include "utils/jobs.hpp"
+#include "utils/profiler.hpp"
+
+#include <cstdio>
+
+TimelineWaiter::TimelineWaiter()
+  : device(VK_NULL_HANDLE),
+    wake(VK_NULL_HANDLE),
+    wakeValue(0),
+    running(false)
+  {}
+
+TimelineWaiter::~TimelineWaiter() {
+  Stop();
+}
+
+VkSemaphore TimelineWaiter::CreateTimeline(VkDevice device, uint64_t initialValue) {
+  VkSemaphoreTypeCreateInfo typeInfo{};
+  typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+  typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  typeInfo.initialValue = initialValue;
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphoreInfo.pNext = &typeInfo;
+
+  VkSemaphore semaphore;
+  VK_ASSERT(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore));
+  return semaphore;
+}
+
+void TimelineWaiter::Start(VkDevice device) {
+  if(running) return;
+
+  this->device = device;
+  wake = CreateTimeline(device, 0);
+  wakeValue = 0;
+
+  running = true;
+  thread = std::thread(&TimelineWaiter::Run, this);
+}
+
+void TimelineWaiter::Stop() {
+  if(!running) return;
+
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    running = false;
+
+    VkSemaphoreSignalInfo signalInfo{};
+    signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+    signalInfo.semaphore = wake;
+    signalInfo.value = ++wakeValue;
+    VK_ASSERT(vkSignalSemaphore(device, &signalInfo));
+  }
+  thread.join();
+
+  if(!waiting.empty()) {
+    fprintf(stderr, "[TIMELINE] %zu coroutines still waiting at shutdown\n", waiting.size());
+    waiting.clear();
+  }
+
+  vkDestroySemaphore(device, wake, nullptr);
+  wake = VK_NULL_HANDLE;
+}
+
+bool TimelineWaiter::Awaiter::await_ready() {
+  uint64_t current = 0;
+  VK_ASSERT(vkGetSemaphoreCounterValue(owner->device, semaphore, &current));
+  return current >= value;
+}
+
+void TimelineWaiter::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+  owner->Add(Waiting{ semaphore, value, handle });
+}
+
+void TimelineWaiter::Add(const Waiting& entry) {
+  std::lock_guard<std::mutex> guard(lock);
+  ASSERT(running, "TimelineWaiter isn't running (no timeline semaphores?)");
+  waiting.push_back(entry);
+
+  VkSemaphoreSignalInfo signalInfo{};
+  signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO;
+  signalInfo.semaphore = wake;
+  signalInfo.value = ++wakeValue;
+  VK_ASSERT(vkSignalSemaphore(device, &signalInfo));
+}
+
+void TimelineWaiter::Run() {
+  Profiler::SetThreadName("timeline waiter");
+
+  std::vector<VkSemaphore> semaphores;
+  std::vector<uint64_t> values;
+  std::vector<std::coroutine_handle<>> ready;
+
+  while(true) {
+    semaphores.clear();
+    values.clear();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if(!running) return;
+
+      // Anything added from now on signals past this
+      semaphores.push_back(wake);
+      values.push_back(wakeValue + 1);
+
+      for(const Waiting& entry : waiting) {
+        semaphores.push_back(entry.semaphore);
+        values.push_back(entry.value);
+      }
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+    waitInfo.semaphoreCount = static_cast<uint32_t>(semaphores.size());
+    waitInfo.pSemaphores = semaphores.data();
+    waitInfo.pValues = values.data();
+
+    VK_ASSERT(vkWaitSemaphores(device, &waitInfo, UINT64_MAX));
+
+    ready.clear();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+
+      for(size_t i = 0; i < waiting.size();) {
+        uint64_t current = 0;
+        VK_ASSERT(vkGetSemaphoreCounterValue(device, waiting[i].semaphore, &current));
+
+        if(current >= waiting[i].value) {
+          ready.push_back(waiting[i].handle);
+          waiting[i] = waiting.back();
+          waiting.pop_back();
+        }
+        else {
+          i++;
+        }
+      }
+    }
+
+    for(std::coroutine_handle<> handle : ready) {
+      // Post, never here: this thread is only for waiting on the GPU
+      Jobs::Post([handle]() { handle.resume(); });
+    }
+  }
+}
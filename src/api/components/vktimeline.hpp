@@ -0,0 +1,74 @@
+#pragma once
+
+#include "api/vkloader.hpp"
+
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  Resumes coroutines (see utils/tasks.hpp) once a timeline semaphore
+  reaches a value, on a job worker:
+
+    co_await context.timelines.Wait(uploadsDone, uploadValue);
+
+  One thread sleeps in vkWaitSemaphores on everything awaited, all at
+  once. It also waits on a timeline of its own, which Wait() signals
+  to make it pick up the new semaphore.
+
+  Needs timeline semaphores (core in 1.2), the context only starts it
+  when the device has them.
+*/
+class TimelineWaiter {
+private:
+  struct Waiting {
+    VkSemaphore semaphore;
+    uint64_t value;
+    std::coroutine_handle<> handle;
+  };
+
+  VkDevice device;
+  VkSemaphore wake;
+  // Last value `wake` was signalled to
+  uint64_t wakeValue;
+
+  std::mutex lock;
+  std::vector<Waiting> waiting;
+  bool running;
+  std::thread thread;
+
+public:
+  struct Awaiter {
+    TimelineWaiter* owner;
+    VkSemaphore semaphore;
+    uint64_t value;
+
+    bool await_ready();
+    void await_suspend(std::coroutine_handle<>);
+    void await_resume() {}
+  };
+
+  TimelineWaiter();
+  ~TimelineWaiter();
+
+  TimelineWaiter(const TimelineWaiter&) = delete;
+  TimelineWaiter& operator=(const TimelineWaiter&) = delete;
+
+  void Start(VkDevice);
+  // Before the device goes. Coroutines still waiting are never resumed
+  void Stop();
+
+  bool IsRunning() { return running; }
+
+  Awaiter Wait(VkSemaphore semaphore, uint64_t value) {
+    return Awaiter{ this, semaphore, value };
+  }
+
+  static VkSemaphore CreateTimeline(VkDevice, uint64_t initialValue);
+
+private:
+  void Add(const Waiting&);
+  void Run();
+};
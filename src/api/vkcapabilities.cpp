@@ -0,0 +1,148 @@
+#include "vkcapabilities.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Entries are heap allocated so references handed out survive
+// other entries being added
+struct CapabilityCache {
+    std::mutex mutex;
+    std::map<VkPhysicalDevice, std::unique_ptr<DeviceCapabilities>> devices;
+    std::map<
+        std::pair<VkPhysicalDevice, VkSurfaceKHR>,
+        std::unique_ptr<SurfaceCapabilities>
+    > surfaces;
+};
+
+static CapabilityCache& GetCache() {
+    static CapabilityCache cache;
+    return cache;
+}
+
+static std::unique_ptr<DeviceCapabilities> QueryDevice(VkPhysicalDevice device) {
+    std::unique_ptr<DeviceCapabilities> capabilities(new DeviceCapabilities());
+
+    vkGetPhysicalDeviceProperties(device, &capabilities->properties);
+    vkGetPhysicalDeviceFeatures(device, &capabilities->features);
+    vkGetPhysicalDeviceMemoryProperties(device, &capabilities->memory);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, nullptr);
+    capabilities->queueFamilies.resize(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(
+        device, &familyCount, capabilities->queueFamilies.data()
+    );
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    capabilities->extensions.resize(extensionCount);
+    vkEnumerateDeviceExtensionProperties(
+        device, nullptr, &extensionCount, capabilities->extensions.data()
+    );
+
+    if(VkUtils::IsVerbose()) {
+        std::cout << "Queried capabilities of "
+                  << capabilities->properties.deviceName << "\n";
+    }
+
+    return capabilities;
+}
+
+static std::unique_ptr<SurfaceCapabilities> QuerySurface(
+    VkPhysicalDevice device,
+    VkSurfaceKHR surface,
+    uint32_t familyCount
+) {
+    std::unique_ptr<SurfaceCapabilities> capabilities(new SurfaceCapabilities());
+    SwapchainSupport& support = capabilities->swapchain;
+
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+        device, surface, &support.capabilites
+    );
+
+    uint32_t formatCount = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, nullptr);
+    support.formats.resize(formatCount);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(
+        device, surface, &formatCount, support.formats.data()
+    );
+
+    uint32_t modeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &modeCount, nullptr);
+    support.presentModes.resize(modeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(
+        device, surface, &modeCount, support.presentModes.data()
+    );
+
+    capabilities->presentSupport.resize(familyCount, VK_FALSE);
+    for(uint32_t i = 0; i < familyCount; i++) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(
+            device, i, surface, &capabilities->presentSupport[i]
+        );
+    }
+
+    return capabilities;
+}
+
+// Expects the lock to be held
+static const DeviceCapabilities& GetDevice(
+    CapabilityCache& cache,
+    VkPhysicalDevice device
+) {
+    auto& entry = cache.devices[device];
+    if(!entry) entry = QueryDevice(device);
+    return *entry;
+}
+
+const DeviceCapabilities& Capabilities::Get(VkPhysicalDevice device) {
+    CapabilityCache& cache = GetCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    return GetDevice(cache, device);
+}
+
+const SurfaceCapabilities& Capabilities::Get(
+    VkPhysicalDevice device,
+    VkSurfaceKHR surface
+) {
+    CapabilityCache& cache = GetCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    auto& entry = cache.surfaces[{ device, surface }];
+    if(!entry) {
+        uint32_t familyCount = static_cast<uint32_t>(
+            GetDevice(cache, device).queueFamilies.size()
+        );
+        entry = QuerySurface(device, surface, familyCount);
+    }
+    return *entry;
+}
+
+bool Capabilities::HasExtension(VkPhysicalDevice device, const char* extension) {
+    for(auto& available : Get(device).extensions) {
+        if(strcmp(extension, available.extensionName) == 0) return true;
+    }
+    return false;
+}
+
+void Capabilities::InvalidateSurface(VkSurfaceKHR surface) {
+    CapabilityCache& cache = GetCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    for(auto it = cache.surfaces.begin(); it != cache.surfaces.end();) {
+        if(it->first.second == surface) it = cache.surfaces.erase(it);
+        else ++it;
+    }
+}
+
+void Capabilities::Clear() {
+    CapabilityCache& cache = GetCache();
+    std::lock_guard<std::mutex> lock(cache.mutex);
+
+    cache.surfaces.clear();
+    cache.devices.clear();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "vkloader.hpp"
+
+#include "vkutils.hpp"
+
+#include <vector>
+
+// Everything about a physical device that never changes
+struct DeviceCapabilities {
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory;
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    std::vector<VkExtensionProperties> extensions;
+};
+
+// What a device can do with one surface, changes along with the
+// window (extent, and formats when it moves to another monitor)
+struct SurfaceCapabilities {
+    SwapchainSupport swapchain;
+    // Indexed by queue family
+    std::vector<VkBool32> presentSupport;
+};
+
+/*
+    Queries every device and (device, surface) pair once, and answers
+    from memory after that. Device selection, logical device creation
+    and swapchain creation all ask the same questions, some of them
+    per candidate device.
+
+    Device entries live until `Clear()`, which has to happen before
+    the instance goes: handles can be reused by the next one.
+    Surface entries also go whenever the surface changes under us,
+    the Swapchain drops its surface's entry before (re)creating.
+
+    Returned references stay valid until the entry is dropped, copy
+    what you need to keep. Thread safe.
+*/
+namespace Capabilities {
+    const DeviceCapabilities& Get(VkPhysicalDevice device);
+    const SurfaceCapabilities& Get(VkPhysicalDevice device, VkSurfaceKHR surface);
+
+    bool HasExtension(VkPhysicalDevice device, const char* extension);
+
+    // Drops every entry for `surface`, the next Get queries again
+    void InvalidateSurface(VkSurfaceKHR surface);
+    void Clear();
+}
@@ -0,0 +1,146 @@
+#include "vkcapture.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+using std::vector;
+
+CaptureWriter::CaptureWriter() : file( nullptr ), header{}, remaining( 0 ) {}
+
+CaptureWriter::~CaptureWriter()
+{
+  Close();
+}
+
+bool CaptureWriter::Open( const char* path, uint32_t frames, VkExtent2D extent,
+                          const char* deviceName,
+                          const vector<CullObject>& scene )
+{
+  Close();
+
+  file = fopen( path, "wb" );
+  if ( file == nullptr ) return false;
+
+  header = {};
+  memcpy( header.magic, MAGIC, sizeof( MAGIC ) );
+  header.version = VERSION;
+  header.width = extent.width;
+  header.height = extent.height;
+  strncpy( header.deviceName, deviceName, sizeof( header.deviceName ) - 1 );
+
+  // Rewritten with the real frame count on Close
+  fwrite( &header, sizeof( header ), 1, file );
+
+  remaining = frames;
+  WriteScene( scene );
+
+  return true;
+}
+
+void CaptureWriter::Close()
+{
+  if ( file == nullptr ) return;
+
+  uint8_t end = CAPTURE_END;
+  fwrite( &end, sizeof( end ), 1, file );
+
+  fseek( file, 0, SEEK_SET );
+  fwrite( &header, sizeof( header ), 1, file );
+
+  fclose( file );
+  file = nullptr;
+}
+
+bool CaptureWriter::IsOpen()
+{
+  return file != nullptr;
+}
+
+void CaptureWriter::WriteScene( const vector<CullObject>& objects )
+{
+  if ( file == nullptr ) return;
+
+  uint8_t command = CAPTURE_SCENE;
+  uint32_t count = static_cast<uint32_t>( objects.size() );
+
+  fwrite( &command, sizeof( command ), 1, file );
+  fwrite( &count, sizeof( count ), 1, file );
+  fwrite( objects.data(), sizeof( CullObject ), count, file );
+}
+
+void CaptureWriter::WriteFrame( float renderScale, float gpuMs )
+{
+  if ( file == nullptr ) return;
+
+  uint8_t command = CAPTURE_FRAME;
+
+  fwrite( &command, sizeof( command ), 1, file );
+  fwrite( &renderScale, sizeof( renderScale ), 1, file );
+  fwrite( &gpuMs, sizeof( gpuMs ), 1, file );
+
+  header.frameCount++;
+  if ( --remaining == 0 ) Close();
+}
+
+CaptureReader::CaptureReader( const char* path ) : header{}
+{
+  file = fopen( path, "rb" );
+  if ( file == nullptr ) {
+    throw std::runtime_error( std::string( "Could not open capture " ) + path );
+  }
+
+  bool valid = fread( &header, sizeof( header ), 1, file ) == 1
+               && memcmp( header.magic, CaptureWriter::MAGIC,
+                          sizeof( header.magic ) ) == 0;
+
+  if ( !valid || header.version != CaptureWriter::VERSION ) {
+    fclose( file );
+    throw std::runtime_error( std::string( "Not a version " )
+                              + std::to_string( CaptureWriter::VERSION )
+                              + " capture: " + path );
+  }
+
+  header.deviceName[sizeof( header.deviceName ) - 1] = '\0';
+}
+
+CaptureReader::~CaptureReader()
+{
+  fclose( file );
+}
+
+const CaptureHeader& CaptureReader::GetHeader()
+{
+  return header;
+}
+
+bool CaptureReader::Next( Command& command )
+{
+  uint8_t type;
+  if ( fread( &type, sizeof( type ), 1, file ) != 1 ) return false;
+
+  command.type = static_cast<CaptureCommand>( type );
+
+  switch ( command.type ) {
+    case CAPTURE_SCENE: {
+      uint32_t count;
+      if ( fread( &count, sizeof( count ), 1, file ) != 1 ) return false;
+      if ( count > OcclusionCuller::MAX_OBJECTS ) return false;
+
+      command.objects.resize( count );
+      return fread( command.objects.data(), sizeof( CullObject ), count, file )
+             == count;
+    }
+    case CAPTURE_FRAME:
+      return fread( &command.renderScale, sizeof( float ), 1, file ) == 1
+             && fread( &command.gpuMs, sizeof( float ), 1, file ) == 1;
+    default:
+      // END, or something a newer version wrote
+      return false;
+  }
+}
+
+void CaptureReader::Rewind()
+{
+  fseek( file, sizeof( CaptureHeader ), SEEK_SET );
+}
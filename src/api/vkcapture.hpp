@@ -0,0 +1,104 @@
+#pragma once
+
+#include "vkloader.hpp"
+
+#include "components/vkculling.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+/*
+    Engine level command stream, for replaying a run somewhere else.
+
+    What gets captured is what drives the Renderer, not Vulkan calls:
+    the scene every time it changes and, for every frame, the render
+    scale it was drawn at. Replaying that on a fresh headless Renderer
+    (tools/replay.cpp) records the exact same command buffers, so a
+    slow stretch from the field can be rerun on a build machine as
+    many times as needed.
+
+    File layout, little endian:
+        CaptureHeader
+        commands, each a uint8 CaptureCommand followed by its payload:
+            SCENE   uint32 count, count * CullObject
+            FRAME   float renderScale, float gpuMs
+        END
+*/
+enum CaptureCommand : uint8_t {
+    CAPTURE_END = 0,
+    CAPTURE_SCENE = 1,
+    CAPTURE_FRAME = 2
+};
+
+struct CaptureHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    // Written when the capture is closed, 0 if it never was
+    uint32_t frameCount;
+    // Where it was captured, for reports
+    char deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+};
+
+class CaptureWriter {
+public:
+    static constexpr char MAGIC[4] = { 'L', 'V', 'K', 'C' };
+    static constexpr uint32_t VERSION = 1;
+
+private:
+    FILE* file;
+    CaptureHeader header;
+    // Frames left to capture
+    uint32_t remaining;
+
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    CaptureWriter( const CaptureWriter& ) = delete;
+    CaptureWriter& operator=( const CaptureWriter& ) = delete;
+
+    // Captures the next `frames` frames, `scene` is what's being
+    // rendered right now. False if the file couldn't be created
+    bool Open( const char* path, uint32_t frames, VkExtent2D extent,
+               const char* deviceName,
+               const std::vector<CullObject>& scene );
+    void Close();
+
+    bool IsOpen();
+
+    void WriteScene( const std::vector<CullObject>& objects );
+    // Closes the file once the last frame is in
+    void WriteFrame( float renderScale, float gpuMs );
+};
+
+class CaptureReader {
+public:
+    struct Command {
+        CaptureCommand type;
+        std::vector<CullObject> objects;
+        float renderScale;
+        float gpuMs;
+    };
+
+private:
+    FILE* file;
+    CaptureHeader header;
+
+public:
+    // Throws if the file is missing or isn't a capture
+    CaptureReader( const char* path );
+    ~CaptureReader();
+
+    CaptureReader( const CaptureReader& ) = delete;
+    CaptureReader& operator=( const CaptureReader& ) = delete;
+
+    const CaptureHeader& GetHeader();
+
+    // False at the end of the stream, a truncated file ends it too
+    bool Next( Command& command );
+    // Back to the first command, for looping replays
+    void Rewind();
+};
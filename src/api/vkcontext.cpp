@@ -1,55 +1,201 @@
 #include "vkcontext.hpp"
 
-#include <vulkan/vulkan.h>
+#include "vkloader.hpp"
 
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <limits>
-#include <set>
 #include <stdexcept>
+#include <string>
 
 #include "utils/debug.hpp"
+#include "utils/file.hpp"
 #include "utils/math.hpp"
+#include "utils/startup.hpp"
+#include "vkcapabilities.hpp"
+#include "vkfeatures.hpp"
 #include "vkutils.hpp"
+#include "./components/vkpipelinebatch.hpp"
+#include "./components/vkshader.hpp"
 #include "./components/vkswapchain.hpp"
 
-VulkanContext::VulkanContext( GLFWwindow* window )
+// Every shader CreateResources ends up loading, read while the
+// instance and device are being created
+static void PreloadShaders()
 {
+  ShaderModule::Preload( {
+      RESOURCES "shaders/basic.vert.spv",
+      RESOURCES "shaders/basic.frag.spv",
+      RESOURCES "shaders/cull.comp.spv",
+      RESOURCES "shaders/hiz.comp.spv",
+  } );
+}
+
+VulkanContext::VulkanContext( GLFWwindow* window ) : headless( false )
+{
+  STARTUP_PHASE( "VulkanContext" );
+
+  PreloadShaders();
   CreateInstance();
   CreateDebugMessenger();
   CreateSurface( window );
   PickPhysicalDevice();
   CreateLogicalDevice();
 
-  pipeline = Pipeline( device );
-  swapchain = Swapchain(
-    window,
-    device,
-    physicalDevice,
-    surface
-  );
+  {
+    STARTUP_PHASE( "Swapchain" );
+    swapchain = Swapchain(
+      window,
+      device,
+      physicalDevice,
+      surface
+    );
+  }
+
+  CreateResources();
+}
+
+VulkanContext::VulkanContext( VkExtent2D extent )
+    : surface( VK_NULL_HANDLE ), headless( true )
+{
+  STARTUP_PHASE( "VulkanContext" );
 
-  pipeline.CreateRenderPass( device, swapchain.format );
-  pipeline.CreatePipeline( device, GetViewport(), GetScissor() );
+  PreloadShaders();
+  CreateInstance();
+  CreateDebugMessenger();
+  PickPhysicalDevice();
+  CreateLogicalDevice();
+
+  // UNORM rather than SRGB, it's never presented, and it supports
+  // everything the offscreen target needs on every implementation
+  swapchain = Swapchain( extent, VK_FORMAT_R8G8B8A8_UNORM );
+
+  CreateResources();
+}
 
-  swapchain.CreateImageViews(device);
-  swapchain.CreateFrameBuffers(device, pipeline.renderPass);
+// PIPELINE_CACHE=<file> keeps compiled pipelines from one run to the
+// next, null when not set
+static const char* PipelineCachePath()
+{
+  return getenv( "PIPELINE_CACHE" );
+}
+
+void VulkanContext::CreateResources()
+{
+  {
+    STARTUP_PHASE( "PipelineCache" );
+    const char* path = PipelineCachePath();
+    pipelineCache = PipelineBatch::CreateCache(
+        device, path ? FileUtils::ReadBinary( path ) : std::vector<char>() );
+  }
+
+  // Every pipeline is queued here as its component is created, and
+  // all of them are compiled together at the end
+  PipelineBatch pipelines;
+
+  {
+    STARTUP_PHASE( "Pipeline" );
+    pipeline = Pipeline( device );
+  }
+
+  {
+    STARTUP_PHASE( "CreateDepthResources" );
+    swapchain.CreateDepthResources( device, physicalDevice );
+  }
+
+  {
+    STARTUP_PHASE( "CreateRenderPass" );
+    pipeline.CreateRenderPass( device, swapchain.format, swapchain.depth.format );
+  }
+
+  {
+    STARTUP_PHASE( "CreatePipeline" );
+    pipeline.CreatePipeline( device, GetViewport(), GetScissor(), pipelines );
+  }
+
+  {
+    STARTUP_PHASE( "CreateImageViews" );
+    swapchain.CreateImageViews(device);
+  }
+
+  {
+    STARTUP_PHASE( "DynamicResolution" );
+    resolution = DynamicResolution(
+      device,
+      physicalDevice,
+      swapchain.extent,
+      swapchain.format,
+      &sync2,
+      DynamicResolution::Settings()
+    );
+    resolution.CreateFrameBuffer( device, pipeline.renderPass, swapchain.depth.view );
+  }
+
+  {
+    STARTUP_PHASE( "DepthPyramid" );
+    depthPyramid = DepthPyramid( device, physicalDevice, swapchain.depth, &sync2 );
+    depthPyramid.CreatePipeline( device, pipelines );
+  }
+
+  {
+    STARTUP_PHASE( "OcclusionCuller" );
+    culler = OcclusionCuller(
+      device,
+      physicalDevice,
+      depthPyramid,
+      &sync2,
+      enabledFeatures.multiDrawIndirect == VK_TRUE
+    );
+    culler.CreatePipeline( device, pipelines );
+  }
+
+  {
+    STARTUP_PHASE( "CompilePipelines" );
+    pipelines.Compile( device, pipelineCache );
+  }
 }
 
 VulkanContext::~VulkanContext()
 {
-  if ( useValidationLayers ) {
+  if ( validationEnabled ) {
     VkUtils::DestroyDebugMessenger( instance, debugMessenger, nullptr );
   }
 
+  resolution.Destroy( device );
+  culler.Destroy( device );
+  depthPyramid.Destroy( device );
   pipeline.Destroy( device );
   swapchain.Destroy( device );
+  timelines.Stop();
+
+  if ( const char* path = PipelineCachePath() ) {
+    std::vector<char> data = PipelineBatch::GetCacheData( device, pipelineCache );
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+  }
+  vkDestroyPipelineCache( device, pipelineCache, nullptr );
 
   vkDestroyDevice( device, nullptr );
-  vkDestroySurfaceKHR( instance, surface, nullptr );
+  if ( !headless ) {
+    vkDestroySurfaceKHR( instance, surface, nullptr );
+  }
   vkDestroyInstance( instance, nullptr );
+
+  // The next instance may hand out the same handles
+  Capabilities::Clear();
+
+  // Last, so messages about the teardown itself still make it out
+  debugSink.Stop();
 }
 
 void VulkanContext::CreateInstance()
 {
+  STARTUP_PHASE( "CreateInstance" );
+
+  // Opens libvulkan, nothing Vulkan can be called before this
+  Loader::Initialize();
+
   VkApplicationInfo appInfo{};
   appInfo.pApplicationName = "My Vulkan App";
   appInfo.applicationVersion = VK_MAKE_VERSION( 1, 0, 0 );
@@ -57,43 +203,68 @@ void VulkanContext::CreateInstance()
   appInfo.pEngineName = "My Engine";
   appInfo.engineVersion = VK_MAKE_VERSION( 1, 0, 0 );
 
-  appInfo.apiVersion = VK_API_VERSION_1_0;
+  // As new as the loader allows, each device then gets
+  // min(this, its own version), see Features::Negotiate
+  apiVersion = Features::InstanceVersion();
+  appInfo.apiVersion = apiVersion;
   appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
 
   VkInstanceCreateInfo instanceInfo{};
   instanceInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
   instanceInfo.pApplicationInfo = &appInfo;
 
-  // Setting up debugging
+  // Validation only exists in debug builds, in release this whole
+  // block is compiled out and the instance is created bare
+  validationEnabled = false;
   VkDebugUtilsMessengerCreateInfoEXT dMessenger{};
-  PopulateDebugMessenger( dMessenger );
-  instanceInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&dMessenger;
-  //
 
-  auto extensions = VkUtils::GetExtensions();
+  if ( useValidationLayers ) {
+    if ( VkUtils::IsVerbose() ) VkUtils::ListLayers();
 
-  instanceInfo.enabledExtensionCount = extensions.size();
-  instanceInfo.ppEnabledExtensionNames = extensions.data();
+    activeLayers = VkUtils::GetLayers();
+    validationEnabled = !activeLayers.empty();
 
-#ifndef NDEBUG
-  VkUtils::ListLayers();
-#endif
+    if ( validationEnabled ) {
+      debugSink.Start( DebugSink::FromEnvironment( DebugSink::Settings() ) );
 
-  activeLayers = VkUtils::GetLayers();
+      // Chained so instance creation and destruction are covered too,
+      // the messenger only exists in between
+      PopulateDebugMessenger( dMessenger );
+      instanceInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT*)&dMessenger;
+    }
+    else {
+      fprintf( stderr, "[WARNING] No validation layers found, running without\n" );
+    }
+  }
 
   instanceInfo.enabledLayerCount = activeLayers.size();
   instanceInfo.ppEnabledLayerNames = activeLayers.data();
 
+  auto extensions = VkUtils::GetExtensions( headless, validationEnabled );
+
+  instanceInfo.enabledExtensionCount = extensions.size();
+  instanceInfo.ppEnabledExtensionNames = extensions.data();
+
+  // Loads the driver(s), which can take longer than everything else
+  STARTUP_PHASE( "vkCreateInstance" );
   VK_ASSERT( vkCreateInstance( &instanceInfo, nullptr, &instance ) );
+
+  Loader::LoadInstance( instance );
 }
 
 void VulkanContext::CreateSurface( GLFWwindow* window )
 {
+  STARTUP_PHASE( "CreateSurface" );
+
   VK_ASSERT( glfwCreateWindowSurface( instance, window, nullptr, &surface ) );
 }
 
 void VulkanContext::CreateDebugMessenger()
 {
+  if ( !validationEnabled ) return;
+
+  STARTUP_PHASE( "CreateDebugMessenger" );
+
   VkDebugUtilsMessengerCreateInfoEXT info{};
   PopulateDebugMessenger( info );
 
@@ -113,21 +284,30 @@ void VulkanContext::PopulateDebugMessenger(
   debugMessenger.sType = 
     VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
   debugMessenger.pfnUserCallback = VkUtils::DebugCallback;
+  // Everything we might want to see, the sink filters at runtime.
+  // VERBOSE is very chatty even when filtered, so it's only
+  // subscribed to when it was asked for from the start
   debugMessenger.messageSeverity = 
     VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT
     | VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT
     | VK_DEBUG_UTILS_MESSAGE_SEVERITY_INFO_BIT_EXT;
 
+  auto sinkSettings = DebugSink::FromEnvironment( DebugSink::Settings() );
+  debugMessenger.messageSeverity |= sinkSettings.severities
+    & VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT;
+
   debugMessenger.messageType = 
     VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT
     | VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT
     | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT;
-  debugMessenger.pUserData = nullptr;
+  debugMessenger.pUserData = &debugSink;
   debugMessenger.pNext = nullptr;
 }
 
 void VulkanContext::PickPhysicalDevice()
 {
+  STARTUP_PHASE( "PickPhysicalDevice" );
+
   physicalDevice = VK_NULL_HANDLE;
   uint32_t physicalDeviceCount = 0;
   vkEnumeratePhysicalDevices( 
@@ -149,54 +329,78 @@ void VulkanContext::PickPhysicalDevice()
     physicalDevices.data() 
   );
 
-  for ( auto device : physicalDevices ) {
-    if ( VkUtils::IsDeviceSuitable( device, surface ) ) {
-      physicalDevice = device;
-      break;
+  std::vector<DeviceCandidate> candidates;
+  for ( uint32_t i = 0; i < physicalDeviceCount; i++ ) {
+    candidates.push_back(
+      VkUtils::RateDevice( physicalDevices[i], i, surface, apiVersion ) );
+  }
+
+  const DeviceCandidate* chosen = nullptr;
+  const std::string& selector = VkUtils::GetDeviceSelector();
+
+  if ( !selector.empty() ) {
+    for ( auto& candidate : candidates ) {
+      if ( VkUtils::MatchesDevice( candidate, selector ) ) {
+        chosen = &candidate;
+        break;
+      }
+    }
+  }
+  else {
+    // Ties go to whichever came first, like before
+    for ( auto& candidate : candidates ) {
+      if ( candidate.suitable
+           && ( chosen == nullptr || candidate.score > chosen->score ) ) {
+        chosen = &candidate;
+      }
     }
   }
 
-  if ( physicalDevice == VK_NULL_HANDLE ) {
+  VkUtils::PrintDevices( candidates, chosen );
+
+  // Asked for something specific, falling back would hide that
+  // the benchmark ran somewhere else
+  if ( !selector.empty() && chosen == nullptr ) {
+    throw std::runtime_error( "VULKAN_DEVICE=\"" + selector
+                              + "\" matches no device" );
+  }
+  if ( !selector.empty() && !chosen->suitable ) {
+    throw std::runtime_error( std::string( chosen->properties.deviceName )
+                              + " was selected but is not suitable" );
+  }
+
+  if ( chosen == nullptr ) {
     throw std::runtime_error( "No suitable Physical Devices found" );
   }
+
+  physicalDevice = chosen->device;
 }
 
 void VulkanContext::CreateLogicalDevice()
 {
+  STARTUP_PHASE( "CreateLogicalDevice" );
+
   familyIndices = VkUtils::FindQueueFamilies( 
     physicalDevice, 
     surface
   );
 
-  // Since we have multiple queues, we must provide an
-  // array of queue infos.
-  // As shown in LearnVulkan.com, a `set` is a nice way
-  // to make this more compact AND remove duplicate indices
-  // (which is likely to happen with `graphics` and `present`)
+  // Several queues per family, each role at its own priority,
+  // see QueueSet
+  queues.Plan( physicalDevice, familyIndices, QueueSet::Settings() );
+  const auto& queueCreateInfos = queues.GetCreateInfos();
 
-  using std::set;
   using std::vector;
 
-  vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+  // Nothing to present to when headless, so no swapchain extension
+  NegotiatedFeatures features = Features::Negotiate(
+      physicalDevice, apiVersion,
+      headless ? vector<const char*>() : DEVICE_EXTENSIONS );
 
-  set<uint32_t> uniqueQueueFamilies = { 
-    familyIndices.graphics.value(), 
-    familyIndices.present.value() 
-  };
+  enabledFeatures = features.core;
+  support = features.support;
 
-  float queuePriority = 1.0f;
-  for ( uint32_t queueFamily : uniqueQueueFamilies ) {
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = queueFamily;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
-
-    queueCreateInfos.push_back( queueCreateInfo );
-  }
-
-  // They are all initialized to VK_FALSE like this
-  VkPhysicalDeviceFeatures features{};
+  if ( VkUtils::IsVerbose() ) Features::Print( support );
 
   // Device
   VkDeviceCreateInfo deviceInfo{};
@@ -206,17 +410,25 @@ void VulkanContext::CreateLogicalDevice()
   deviceInfo.queueCreateInfoCount
       = static_cast<uint32_t>( queueCreateInfos.size() );
   deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
-  deviceInfo.pEnabledFeatures = &features;
 
-  deviceInfo.enabledExtensionCount = static_cast<uint32_t>(
-      DEVICE_EXTENSIONS.size() );  // We'll come back for these
-  deviceInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS.data();
+  // 1.2+ devices take every feature through the chain, including
+  // the 1.0 ones, and then pEnabledFeatures must be null
+  if ( features.chain.Empty() ) {
+    deviceInfo.pEnabledFeatures = &features.core;
+  }
+  else {
+    deviceInfo.pNext = features.chain.Head();
+  }
+
+  deviceInfo.enabledExtensionCount
+      = static_cast<uint32_t>( features.extensions.size() );
+  deviceInfo.ppEnabledExtensionNames = features.extensions.data();
 
   // In modern Vulkan, Device layers are ignored, as there's
   // no longer a distinction between Device and Instance layers
   // It is still, however, a good idea to set them as it allows for
   // backwards compatibility
-  if ( useValidationLayers ) {
+  if ( validationEnabled ) {
     deviceInfo.enabledLayerCount = activeLayers.size();
     deviceInfo.ppEnabledLayerNames = activeLayers.data();
   }
@@ -226,19 +438,17 @@ void VulkanContext::CreateLogicalDevice()
 
   VK_ASSERT( vkCreateDevice( physicalDevice, &deviceInfo, nullptr, &device ) );
 
-  vkGetDeviceQueue( 
-    device, 
-    familyIndices.graphics.value(),
-    0 /* because we're only using one queue for this family */,
-    &graphicsQueue
-  );
+  // Straight to the driver from now on, skipping the loader
+  Loader::LoadDevice( device );
 
-  vkGetDeviceQueue( 
-    device, 
-    familyIndices.present.value(),
-    0 /* because we're only using one queue for this family */,
-    &presentQueue
-  );
+  sync2 = Synchronization2::Load( device, support );
+  if ( support.timelineSemaphore ) timelines.Start( device );
+
+  queues.Retrieve( device );
+  graphicsQueue = queues.Get( QueueRole::GRAPHICS ).handle;
+  presentQueue = queues.GetPresent();
+
+  if ( VkUtils::IsVerbose() ) queues.Print();
 }
 
 VkViewport VulkanContext::GetViewport()
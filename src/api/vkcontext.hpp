@@ -1,10 +1,18 @@
 #pragma once
 
-#include <vulkan/vulkan.h>
+#include "vkloader.hpp"
 #include "GLFW/glfw3.h"
 
 #include "components/vkswapchain.hpp"
 #include "components/vkpipeline.hpp"
+#include "components/vkhiz.hpp"
+#include "components/vkculling.hpp"
+#include "components/vkresolution.hpp"
+#include "components/vkdebugsink.hpp"
+#include "components/vkbarriers.hpp"
+#include "components/vktimeline.hpp"
+#include "vkfeatures.hpp"
+#include "vkqueues.hpp"
 
 #include <vector>
 
@@ -28,33 +36,67 @@ public:
     VkDevice device;
     Swapchain swapchain;
     Pipeline pipeline;
+    DepthPyramid depthPyramid;
+    OcclusionCuller culler;
+    DynamicResolution resolution;
 
     // Queues
+    // Every queue, by role. Those two are the frame's, the first
+    // graphics queue and the present family's first queue: lock them
+    // through `queues` when other threads may be submitting too
+    QueueSet queues;
     VkQueue graphicsQueue;
     VkQueue presentQueue;
 
     QueueFamilyIndices familyIndices;
 
     VkInstance instance;
+    // What the instance was created with
+    uint32_t apiVersion;
     VkPhysicalDevice physicalDevice;
     VkSurfaceKHR surface;
 
+    // No window, surface or swapchain: frames are rendered into the
+    // offscreen target only (see Renderer and the benchmark tool)
+    bool headless;
+
+    // Optional features we turned on at device creation
+    VkPhysicalDeviceFeatures enabledFeatures;
+    // Same, as flags, along with the 1.2/1.3 ones (see vkfeatures.hpp)
+    FeatureSupport support;
+    // Null entry points when synchronization2 isn't enabled, the
+    // components then fall back to the legacy barriers
+    Synchronization2 sync2;
+    // co_await timelines.Wait(semaphore, value), only running with
+    // timeline semaphores
+    TimelineWaiter timelines;
+    // Every pipeline compiled so far, see PipelineBatch
+    VkPipelineCache pipelineCache;
+
     // std::vector<VkFramebuffer> frameBuffers;
     // std::vector<VkImageView> imageViews;
 private:
     // Debug
+    // Only ever true in debug builds, and only if the layers are there
+    bool validationEnabled;
     VkDebugUtilsMessengerEXT debugMessenger;
+    // Validation messages are logged from here, off the driver's thread
+    DebugSink debugSink;
     std::vector<const char*> activeLayers;
 
 public:
     VulkanContext() = delete;
     VulkanContext(GLFWwindow* window);
+    // Headless, for machines without a display (or a GPU, lavapipe works)
+    VulkanContext(VkExtent2D extent);
     ~VulkanContext();
 
     VkViewport GetViewport();
     VkRect2D GetScissor();
 
 private:
+    void CreateResources();
+
     void CreateInstance();
     void PickPhysicalDevice();
     void CreateLogicalDevice();
@@ -0,0 +1,174 @@
+#include "vkfeatures.hpp"
+#include "vkcapabilities.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+uint32_t Features::InstanceVersion() {
+    // Only 1.1+ loaders have it, and a 1.0 loader refuses
+    // anything but 1.0
+    auto enumerateVersion = reinterpret_cast<PFN_vkEnumerateInstanceVersion>(
+        vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion")
+    );
+    if(enumerateVersion == nullptr) return VK_API_VERSION_1_0;
+
+    uint32_t version = VK_API_VERSION_1_0;
+    if(enumerateVersion(&version) != VK_SUCCESS) return VK_API_VERSION_1_0;
+
+    return std::min(version, static_cast<uint32_t>(VK_API_VERSION_1_3));
+}
+
+static VkBool32 Supported(VkBool32 feature) {
+    return feature == VK_TRUE ? VK_TRUE : VK_FALSE;
+}
+
+NegotiatedFeatures Features::Negotiate(
+    VkPhysicalDevice device,
+    uint32_t instanceVersion,
+    const std::vector<const char*>& requiredExtensions
+) {
+    const DeviceCapabilities& capabilities = Capabilities::Get(device);
+
+    uint32_t version = std::min(instanceVersion, capabilities.properties.apiVersion);
+    version = VK_MAKE_API_VERSION(
+        0, VK_API_VERSION_MAJOR(version), VK_API_VERSION_MINOR(version), 0
+    );
+
+    NegotiatedFeatures result{};
+    result.extensions = requiredExtensions;
+    result.support.apiVersion = version;
+
+    { // Core 1.0
+        const VkPhysicalDeviceFeatures& supported = capabilities.features;
+
+        // Lets the culling pass issue all its indirect draws in one call,
+        // it falls back to one call per object when this is missing
+        result.core.multiDrawIndirect = Supported(supported.multiDrawIndirect);
+
+        // Per pass vertex/fragment/compute counts (see PipelineStatistics)
+        result.core.pipelineStatisticsQuery =
+            Supported(supported.pipelineStatisticsQuery);
+
+        result.support.multiDrawIndirect = result.core.multiDrawIndirect;
+        result.support.pipelineStatisticsQuery = result.core.pipelineStatisticsQuery;
+    }
+
+    if(version < VK_API_VERSION_1_2) return result;
+
+    // Ask for everything we might enable...
+    FeatureChain query;
+    auto& query2 = query.Add<VkPhysicalDeviceFeatures2>(
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2
+    );
+    auto& query12 = query.Add<VkPhysicalDeviceVulkan12Features>(
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    );
+
+    VkPhysicalDeviceVulkan13Features* query13 = nullptr;
+    VkPhysicalDeviceSynchronization2FeaturesKHR* querySync2 = nullptr;
+    VkPhysicalDeviceDynamicRenderingFeaturesKHR* queryDynamic = nullptr;
+
+    if(version >= VK_API_VERSION_1_3) {
+        query13 = &query.Add<VkPhysicalDeviceVulkan13Features>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES
+        );
+    }
+    else {
+        if(Capabilities::HasExtension(device, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+            querySync2 = &query.Add<VkPhysicalDeviceSynchronization2FeaturesKHR>(
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR
+            );
+        }
+        if(Capabilities::HasExtension(device, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+            queryDynamic = &query.Add<VkPhysicalDeviceDynamicRenderingFeaturesKHR>(
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR
+            );
+        }
+    }
+
+    vkGetPhysicalDeviceFeatures2(device, &query2);
+
+    // ...then build a chain with only those that came back supported
+    auto& features2 = result.chain.Add<VkPhysicalDeviceFeatures2>(
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2
+    );
+    features2.features = result.core;
+
+    auto& vulkan12 = result.chain.Add<VkPhysicalDeviceVulkan12Features>(
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    );
+    vulkan12.timelineSemaphore = Supported(query12.timelineSemaphore);
+    vulkan12.bufferDeviceAddress = Supported(query12.bufferDeviceAddress);
+
+    // All or nothing, bindless needs every one of these
+    bool indexing =
+        query12.descriptorIndexing == VK_TRUE &&
+        query12.runtimeDescriptorArray == VK_TRUE &&
+        query12.descriptorBindingPartiallyBound == VK_TRUE &&
+        query12.descriptorBindingVariableDescriptorCount == VK_TRUE &&
+        query12.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+
+    if(indexing) {
+        vulkan12.descriptorIndexing = VK_TRUE;
+        vulkan12.runtimeDescriptorArray = VK_TRUE;
+        vulkan12.descriptorBindingPartiallyBound = VK_TRUE;
+        vulkan12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+        vulkan12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    }
+
+    result.support.timelineSemaphore = vulkan12.timelineSemaphore == VK_TRUE;
+    result.support.bufferDeviceAddress = vulkan12.bufferDeviceAddress == VK_TRUE;
+    result.support.descriptorIndexing = indexing;
+
+    if(query13 != nullptr) {
+        auto& vulkan13 = result.chain.Add<VkPhysicalDeviceVulkan13Features>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES
+        );
+        vulkan13.synchronization2 = Supported(query13->synchronization2);
+        vulkan13.dynamicRendering = Supported(query13->dynamicRendering);
+
+        result.support.synchronization2 = vulkan13.synchronization2 == VK_TRUE;
+        result.support.dynamicRendering = vulkan13.dynamicRendering == VK_TRUE;
+        return result;
+    }
+
+    // 1.2, the same through extensions
+    if(querySync2 != nullptr && querySync2->synchronization2 == VK_TRUE) {
+        result.chain.Add<VkPhysicalDeviceSynchronization2FeaturesKHR>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR
+        ).synchronization2 = VK_TRUE;
+        result.extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        result.support.synchronization2 = true;
+    }
+
+    if(queryDynamic != nullptr && queryDynamic->dynamicRendering == VK_TRUE) {
+        result.chain.Add<VkPhysicalDeviceDynamicRenderingFeaturesKHR>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR
+        ).dynamicRendering = VK_TRUE;
+        result.extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+        result.support.dynamicRendering = true;
+    }
+
+    return result;
+}
+
+void Features::Print(const FeatureSupport& support) {
+    const struct { const char* name; bool enabled; } flags[] = {
+        { "multiDrawIndirect", support.multiDrawIndirect },
+        { "pipelineStatistics", support.pipelineStatisticsQuery },
+        { "timelineSemaphore", support.timelineSemaphore },
+        { "synchronization2", support.synchronization2 },
+        { "dynamicRendering", support.dynamicRendering },
+        { "descriptorIndexing", support.descriptorIndexing },
+        { "bufferDeviceAddress", support.bufferDeviceAddress }
+    };
+
+    printf("[FEATURES] Vulkan %u.%u |",
+        VK_API_VERSION_MAJOR(support.apiVersion),
+        VK_API_VERSION_MINOR(support.apiVersion));
+
+    for(auto& flag : flags) {
+        if(flag.enabled) printf(" %s", flag.name);
+    }
+    printf("\n");
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "vkloader.hpp"
+
+#include <memory>
+#include <vector>
+
+/*
+    A pNext chain of Vulkan feature structs that owns its links.
+
+        FeatureChain chain;
+        auto& features2 = chain.Add<VkPhysicalDeviceFeatures2>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2);
+        auto& vulkan12 = chain.Add<VkPhysicalDeviceVulkan12Features>(
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+
+    Structs come back zeroed, in the order they were added, the first
+    one being the head. Their addresses never change, so the chain
+    can be moved around freely while Vulkan holds pointers into it.
+*/
+class FeatureChain {
+private:
+    std::vector<std::shared_ptr<void>> links;
+    VkBaseOutStructure* tail;
+
+public:
+    FeatureChain() : tail(nullptr) {}
+
+    template<typename T>
+    T& Add(VkStructureType type) {
+        std::shared_ptr<T> link = std::make_shared<T>();
+        link->sType = type;
+        link->pNext = nullptr;
+
+        VkBaseOutStructure* base = reinterpret_cast<VkBaseOutStructure*>(link.get());
+        if(tail != nullptr) tail->pNext = base;
+        tail = base;
+
+        links.push_back(link);
+        return *link;
+    }
+
+    // Null while empty
+    void* Head() {
+        return links.empty() ? nullptr : links.front().get();
+    }
+
+    bool Empty() {
+        return links.empty();
+    }
+};
+
+// What the device was created with, for the rest of the engine to
+// check before taking a faster path
+struct FeatureSupport {
+    // min(instance, device), without the patch number
+    uint32_t apiVersion;
+
+    bool multiDrawIndirect;
+    bool pipelineStatisticsQuery;
+
+    bool timelineSemaphore;
+    bool synchronization2;
+    bool dynamicRendering;
+    // Runtime sized, partially bound, non-uniformly indexed
+    // sampled image arrays
+    bool descriptorIndexing;
+    bool bufferDeviceAddress;
+};
+
+struct NegotiatedFeatures {
+    // Goes into VkDeviceCreateInfo::pNext, headed by a
+    // VkPhysicalDeviceFeatures2. Empty on 1.0 devices
+    FeatureChain chain;
+    // For 1.0 devices, which only take pEnabledFeatures
+    VkPhysicalDeviceFeatures core;
+    // The required ones plus whatever the features above need
+    std::vector<const char*> extensions;
+
+    FeatureSupport support;
+};
+
+namespace Features {
+    // Highest version the loader takes, capped at the newest we
+    // know about (1.3)
+    uint32_t InstanceVersion();
+
+    /*
+        Turns on every optional feature we make use of that `device`
+        has, and nothing else: features that are enabled but unused
+        can still cost (robustness checks, for one).
+        Vulkan 1.2 and 1.3 devices get them through the core structs.
+        1.2 devices also get synchronization2 and dynamic rendering
+        through their extensions. 1.1 and older only get core 1.0
+        features.
+    */
+    NegotiatedFeatures Negotiate(
+        VkPhysicalDevice device,
+        uint32_t instanceVersion,
+        const std::vector<const char*>& requiredExtensions
+    );
+
+    // "[FEATURES] 1.3 | timeline sync2 ..." to stdout
+    void Print(const FeatureSupport&);
+}
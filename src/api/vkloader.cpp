@@ -0,0 +1,73 @@
+#include "vkloader.hpp"
+
+#include <dlfcn.h>
+
+#include <stdexcept>
+
+#define VK_LOADER_DEFINE(name) PFN_##name name = nullptr;
+
+PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr = nullptr;
+VK_LOADER_GLOBAL_FUNCTIONS(VK_LOADER_DEFINE)
+VK_LOADER_INSTANCE_FUNCTIONS(VK_LOADER_DEFINE)
+VK_LOADER_DEVICE_FUNCTIONS(VK_LOADER_DEFINE)
+
+#undef VK_LOADER_DEFINE
+
+// Never closed, the function pointers live as long as the process
+static void* library = nullptr;
+
+void Loader::Initialize() {
+    if(library != nullptr) return;
+
+    const char* names[] = {
+#ifdef __APPLE__
+        "libvulkan.1.dylib",
+        "libvulkan.dylib",
+        "libMoltenVK.dylib"
+#else
+        "libvulkan.so.1",
+        // Only there with the development package installed
+        "libvulkan.so"
+#endif
+    };
+
+    for(const char* name : names) {
+        library = dlopen(name, RTLD_NOW | RTLD_LOCAL);
+        if(library != nullptr) break;
+    }
+
+    if(library == nullptr) {
+        throw std::runtime_error("Couldn't find the Vulkan loader (libvulkan)");
+    }
+
+    vkGetInstanceProcAddr = reinterpret_cast<PFN_vkGetInstanceProcAddr>(
+        dlsym(library, "vkGetInstanceProcAddr")
+    );
+
+    if(vkGetInstanceProcAddr == nullptr) {
+        throw std::runtime_error("The Vulkan loader has no vkGetInstanceProcAddr");
+    }
+
+    #define VK_LOADER_GLOBAL(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(nullptr, #name));
+    VK_LOADER_GLOBAL_FUNCTIONS(VK_LOADER_GLOBAL)
+    #undef VK_LOADER_GLOBAL
+}
+
+void Loader::LoadInstance(VkInstance instance) {
+    // Device functions too, as trampolines until LoadDevice
+    #define VK_LOADER_INSTANCE(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetInstanceProcAddr(instance, #name));
+    VK_LOADER_INSTANCE_FUNCTIONS(VK_LOADER_INSTANCE)
+    VK_LOADER_DEVICE_FUNCTIONS(VK_LOADER_INSTANCE)
+    #undef VK_LOADER_INSTANCE
+}
+
+void Loader::LoadDevice(VkDevice device) {
+    // Null for extensions the device wasn't created with (no
+    // swapchain functions headless)
+    #define VK_LOADER_DEVICE(name) \
+        name = reinterpret_cast<PFN_##name>(vkGetDeviceProcAddr(device, #name));
+    VK_LOADER_DEVICE_FUNCTIONS(VK_LOADER_DEVICE)
+    #undef VK_LOADER_DEVICE
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+// Built with VK_NO_PROTOTYPES (see CMakeLists.txt): every Vulkan
+// function below is a pointer we fill in ourselves, include this
+// instead of <vulkan/vulkan.h> to call them
+#include <vulkan/vulkan.h>
+
+// Don't need an instance
+#define VK_LOADER_GLOBAL_FUNCTIONS(X) \
+    X(vkCreateInstance) \
+    X(vkEnumerateInstanceExtensionProperties) \
+    X(vkEnumerateInstanceLayerProperties)
+
+#define VK_LOADER_INSTANCE_FUNCTIONS(X) \
+    X(vkDestroyInstance) \
+    X(vkEnumeratePhysicalDevices) \
+    X(vkEnumerateDeviceExtensionProperties) \
+    X(vkGetPhysicalDeviceProperties) \
+    X(vkGetPhysicalDeviceProperties2) \
+    X(vkGetPhysicalDeviceFeatures) \
+    X(vkGetPhysicalDeviceFeatures2) \
+    X(vkGetPhysicalDeviceFormatProperties) \
+    X(vkGetPhysicalDeviceMemoryProperties) \
+    X(vkGetPhysicalDeviceQueueFamilyProperties) \
+    X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+    X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+    X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+    X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+    X(vkDestroySurfaceKHR) \
+    X(vkCreateDevice) \
+    X(vkGetDeviceProcAddr)
+
+#define VK_LOADER_DEVICE_FUNCTIONS(X) \
+    X(vkDestroyDevice) \
+    X(vkDeviceWaitIdle) \
+    X(vkGetDeviceQueue) \
+    X(vkQueueSubmit) \
+    X(vkAllocateMemory) \
+    X(vkFreeMemory) \
+    X(vkMapMemory) \
+    X(vkUnmapMemory) \
+    X(vkCreateBuffer) \
+    X(vkDestroyBuffer) \
+    X(vkGetBufferMemoryRequirements) \
+    X(vkBindBufferMemory) \
+    X(vkCreateImage) \
+    X(vkDestroyImage) \
+    X(vkGetImageMemoryRequirements) \
+    X(vkBindImageMemory) \
+    X(vkCreateImageView) \
+    X(vkDestroyImageView) \
+    X(vkCreateSampler) \
+    X(vkDestroySampler) \
+    X(vkCreateShaderModule) \
+    X(vkDestroyShaderModule) \
+    X(vkCreateRenderPass) \
+    X(vkDestroyRenderPass) \
+    X(vkCreateFramebuffer) \
+    X(vkDestroyFramebuffer) \
+    X(vkCreatePipelineLayout) \
+    X(vkDestroyPipelineLayout) \
+    X(vkCreatePipelineCache) \
+    X(vkDestroyPipelineCache) \
+    X(vkGetPipelineCacheData) \
+    X(vkMergePipelineCaches) \
+    X(vkCreateGraphicsPipelines) \
+    X(vkCreateComputePipelines) \
+    X(vkDestroyPipeline) \
+    X(vkCreateDescriptorSetLayout) \
+    X(vkDestroyDescriptorSetLayout) \
+    X(vkCreateDescriptorPool) \
+    X(vkDestroyDescriptorPool) \
+    X(vkAllocateDescriptorSets) \
+    X(vkUpdateDescriptorSets) \
+    X(vkCreateQueryPool) \
+    X(vkDestroyQueryPool) \
+    X(vkGetQueryPoolResults) \
+    X(vkCreateCommandPool) \
+    X(vkDestroyCommandPool) \
+    X(vkAllocateCommandBuffers) \
+    X(vkBeginCommandBuffer) \
+    X(vkEndCommandBuffer) \
+    X(vkResetCommandBuffer) \
+    X(vkCreateFence) \
+    X(vkDestroyFence) \
+    X(vkResetFences) \
+    X(vkWaitForFences) \
+    X(vkCreateSemaphore) \
+    X(vkDestroySemaphore) \
+    X(vkWaitSemaphores) \
+    X(vkSignalSemaphore) \
+    X(vkGetSemaphoreCounterValue) \
+    X(vkCmdBeginRenderPass) \
+    X(vkCmdEndRenderPass) \
+    X(vkCmdBindPipeline) \
+    X(vkCmdBindDescriptorSets) \
+    X(vkCmdPushConstants) \
+    X(vkCmdSetViewport) \
+    X(vkCmdSetScissor) \
+    X(vkCmdDispatch) \
+    X(vkCmdDrawIndirect) \
+    X(vkCmdFillBuffer) \
+    X(vkCmdBlitImage) \
+    X(vkCmdPipelineBarrier) \
+    X(vkCmdResetQueryPool) \
+    X(vkCmdBeginQuery) \
+    X(vkCmdEndQuery) \
+    X(vkCmdWriteTimestamp) \
+    X(vkCreateSwapchainKHR) \
+    X(vkDestroySwapchainKHR) \
+    X(vkGetSwapchainImagesKHR) \
+    X(vkAcquireNextImageKHR) \
+    X(vkQueuePresentKHR)
+
+#define VK_LOADER_DECLARE(name) extern PFN_##name name;
+
+extern PFN_vkGetInstanceProcAddr vkGetInstanceProcAddr;
+VK_LOADER_GLOBAL_FUNCTIONS(VK_LOADER_DECLARE)
+VK_LOADER_INSTANCE_FUNCTIONS(VK_LOADER_DECLARE)
+VK_LOADER_DEVICE_FUNCTIONS(VK_LOADER_DECLARE)
+
+#undef VK_LOADER_DECLARE
+
+/*
+    We don't link against the Vulkan loader, we open it at runtime
+    and fetch every function ourselves, in three steps:
+
+        Loader::Initialize();          // vkCreateInstance & co.
+        vkCreateInstance(...);
+        Loader::LoadInstance(instance);
+        vkCreateDevice(...);
+        Loader::LoadDevice(device);
+
+    Device functions come from vkGetDeviceProcAddr, which hands out
+    the driver's own entry points. The ones exported by the loader
+    are trampolines that look the device's dispatch table up first,
+    on every call, which adds up when recording thousands of
+    commands a frame.
+    Timeline semaphore functions are core 1.2, null before that.
+    Until LoadDevice, device functions are those trampolines, so
+    they work with any device of the instance. After it, they only
+    work with that device: there is a single device at a time.
+*/
+namespace Loader {
+    // Opens the loader library, throws if there isn't one.
+    // Does nothing the second time
+    void Initialize();
+
+    void LoadInstance(VkInstance);
+    void LoadDevice(VkDevice);
+}
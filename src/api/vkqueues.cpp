@@ -0,0 +1,221 @@
+#include "vkqueues.hpp"
+#include "vkcapabilities.hpp"
+#include "components/vkbarriers.hpp"
+
+#include "utils/debug.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+QueueSet::QueueSet() : presentFamily(0) {
+    for(auto& counter : next) counter = 0;
+}
+
+// A family with `wanted` and none of `unwanted`
+static bool FindFamily(
+    const std::vector<VkQueueFamilyProperties>& families,
+    VkQueueFlags wanted,
+    VkQueueFlags unwanted,
+    uint32_t& family
+) {
+    for(uint32_t i = 0; i < families.size(); i++) {
+        VkQueueFlags flags = families[i].queueFlags;
+        if((flags & wanted) == wanted && (flags & unwanted) == 0) {
+            family = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void QueueSet::Plan(
+    VkPhysicalDevice device,
+    const QueueFamilyIndices& indices,
+    Settings settings
+) {
+    const auto& families = Capabilities::Get(device).queueFamilies;
+
+    queues.clear();
+    for(auto& role : roles) role.clear();
+    createInfos.clear();
+    priorities.clear();
+
+    uint32_t graphicsFamily = indices.graphics.value();
+    presentFamily = indices.present.value();
+
+    // Dedicated families first. Graphics queues do compute and
+    // transfer too, so there's always something to fall back to
+    uint32_t computeFamily = graphicsFamily;
+    FindFamily(families, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT, computeFamily);
+
+    uint32_t transferFamily = computeFamily;
+    FindFamily(
+        families,
+        VK_QUEUE_TRANSFER_BIT,
+        VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT,
+        transferFamily
+    );
+
+    const struct { QueueRole role; uint32_t family; uint32_t count; float priority; } requests[] = {
+        { QueueRole::GRAPHICS, graphicsFamily, settings.graphicsQueues, settings.graphicsPriority },
+        { QueueRole::COMPUTE,  computeFamily,  settings.computeQueues,  settings.computePriority },
+        { QueueRole::TRANSFER, transferFamily, settings.transferQueues, settings.transferPriority }
+    };
+
+    // In order, graphics gets the first queues of its family
+    for(auto& request : requests) {
+        auto& role = roles[static_cast<uint32_t>(request.role)];
+        uint32_t familySize = families[request.family].queueCount;
+
+        for(uint32_t i = 0; i < std::max(request.count, 1u); i++) {
+            role.push_back(Allocate(request.family, request.priority, familySize));
+        }
+    }
+
+    // Present gets queue 0 of its family, which needs at least that
+    bool presentPlanned = false;
+    for(auto& queue : queues) {
+        if(queue->family == presentFamily) presentPlanned = true;
+    }
+    if(!presentPlanned) {
+        Allocate(presentFamily, settings.graphicsPriority, families[presentFamily].queueCount);
+    }
+
+    // One create info per family, found through its queue 0
+    for(auto& queue : queues) {
+        if(queue->index == 0) {
+            priorities.emplace_back();
+            createInfos.push_back(VkDeviceQueueCreateInfo{});
+            createInfos.back().sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+            createInfos.back().queueFamilyIndex = queue->family;
+        }
+    }
+
+    for(uint32_t i = 0; i < createInfos.size(); i++) {
+        for(auto& queue : queues) {
+            if(queue->family == createInfos[i].queueFamilyIndex) {
+                priorities[i].push_back(queue->priority);
+            }
+        }
+        createInfos[i].queueCount = static_cast<uint32_t>(priorities[i].size());
+        createInfos[i].pQueuePriorities = priorities[i].data();
+    }
+}
+
+SharedQueue* QueueSet::Allocate(uint32_t family, float priority, uint32_t familySize) {
+    std::vector<SharedQueue*> taken;
+    for(auto& queue : queues) {
+        if(queue->family == family) taken.push_back(queue.get());
+    }
+
+    // Out of queues, share the least shared of those handed out
+    if(taken.size() >= familySize) {
+        SharedQueue* shared = taken.front();
+        uint32_t sharedCount = UINT32_MAX;
+        for(SharedQueue* queue : taken) {
+            uint32_t users = 0;
+            for(auto& role : roles) {
+                for(SharedQueue* used : role) users += used == queue;
+            }
+            if(users < sharedCount) {
+                shared = queue;
+                sharedCount = users;
+            }
+        }
+        return shared;
+    }
+
+    queues.push_back(std::make_unique<SharedQueue>());
+    SharedQueue* queue = queues.back().get();
+    queue->family = family;
+    queue->index = static_cast<uint32_t>(taken.size());
+    queue->priority = priority;
+    return queue;
+}
+
+const std::vector<VkDeviceQueueCreateInfo>& QueueSet::GetCreateInfos() {
+    return createInfos;
+}
+
+void QueueSet::Retrieve(VkDevice device) {
+    for(auto& queue : queues) {
+        vkGetDeviceQueue(device, queue->family, queue->index, &queue->handle);
+    }
+}
+
+SharedQueue& QueueSet::Get(QueueRole role, uint32_t i) {
+    auto& queues = roles[static_cast<uint32_t>(role)];
+    ASSERT(i < queues.size(), "No such queue for this role");
+    return *queues[i];
+}
+
+uint32_t QueueSet::Count(QueueRole role) {
+    return static_cast<uint32_t>(roles[static_cast<uint32_t>(role)].size());
+}
+
+uint32_t QueueSet::Family(QueueRole role) {
+    return Get(role).family;
+}
+
+VkQueue QueueSet::GetPresent() {
+    for(auto& queue : queues) {
+        if(queue->family == presentFamily && queue->index == 0) return queue->handle;
+    }
+    return VK_NULL_HANDLE;
+}
+
+SharedQueue* QueueSet::LockFree(QueueRole role) {
+    auto& queues = roles[static_cast<uint32_t>(role)];
+    uint32_t size = static_cast<uint32_t>(queues.size());
+
+    // Threads submitting together start from different queues
+    uint32_t start = next[static_cast<uint32_t>(role)].fetch_add(1, std::memory_order_relaxed);
+
+    for(uint32_t i = 0; i < size; i++) {
+        SharedQueue* queue = queues[(start + i) % size];
+        if(queue->lock.try_lock()) return queue;
+    }
+
+    // All busy
+    SharedQueue* queue = queues[start % size];
+    queue->lock.lock();
+    return queue;
+}
+
+VkResult QueueSet::Submit(
+    QueueRole role,
+    uint32_t count,
+    const VkSubmitInfo* submits,
+    VkFence fence
+) {
+    SharedQueue* queue = LockFree(role);
+    std::lock_guard<std::mutex> guard(queue->lock, std::adopt_lock);
+    return vkQueueSubmit(queue->handle, count, submits, fence);
+}
+
+VkResult QueueSet::Submit(
+    QueueRole role,
+    uint32_t count,
+    const VkSubmitInfo2* submits,
+    VkFence fence,
+    const Synchronization2& sync2
+) {
+    ASSERT(sync2.IsEnabled(), "VkSubmitInfo2 without synchronization2");
+
+    SharedQueue* queue = LockFree(role);
+    std::lock_guard<std::mutex> guard(queue->lock, std::adopt_lock);
+    return sync2.queueSubmit2(queue->handle, count, submits, fence);
+}
+
+void QueueSet::Print() {
+    const char* names[QUEUE_ROLE_COUNT] = { "graphics", "compute", "transfer" };
+
+    printf("[QUEUES]");
+    for(uint32_t r = 0; r < QUEUE_ROLE_COUNT; r++) {
+        printf("%s %s:", r == 0 ? "" : " |", names[r]);
+        for(SharedQueue* queue : roles[r]) {
+            printf(" %u.%u (%.2f)", queue->family, queue->index, queue->priority);
+        }
+    }
+    printf("\n");
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "vkloader.hpp"
+
+#include "vkutils.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+struct Synchronization2;
+
+enum class QueueRole : uint32_t {
+    GRAPHICS = 0,
+    // Async compute, on a family without graphics when there is one
+    COMPUTE = 1,
+    // Uploads, on a transfer-only family (the DMA engines) when there is one
+    TRANSFER = 2
+};
+
+const uint32_t QUEUE_ROLE_COUNT = 3;
+
+// A VkQueue must only be used by one thread at a time, that's what
+// `lock` is for. Queues that had to be shared between roles (the
+// family didn't have enough) share it too
+struct SharedQueue {
+    VkQueue handle = VK_NULL_HANDLE;
+    uint32_t family = 0;
+    uint32_t index = 0;
+    float priority = 0.0f;
+
+    std::mutex lock;
+};
+
+/*
+    Every queue the device is created with, by role.
+
+        queues.Plan(physicalDevice, familyIndices, settings);
+        deviceInfo.pQueueCreateInfos = queues.GetCreateInfos().data();
+        vkCreateDevice(...);
+        queues.Retrieve(device);
+
+        // From any thread
+        queues.Submit(QueueRole::TRANSFER, 1, &submitInfo, fence);
+        queues.Submit(QueueRole::TRANSFER, 1, &submitInfo2, fence, sync2);
+
+    Each role asks for a number of queues at its own priority, taken
+    from the family that suits it best. When a family runs out, the
+    extra ones alias queues it already handed out.
+
+    Submit never goes through a lock shared by every queue: it deals
+    out the role's queues in turn, and takes the first one no other
+    thread is using. With as many queues as submitting threads, none
+    of them ever waits on another. Only when they're all busy does it
+    wait, on the one it was dealt.
+
+    Graphics queue 0 is the one frames are submitted and presented
+    on, lock it (`Get(GRAPHICS).lock`) to use it directly.
+*/
+class QueueSet {
+public:
+    struct Settings {
+        // More than one lets that many threads submit at once
+        uint32_t graphicsQueues = 2;
+        uint32_t computeQueues = 1;
+        uint32_t transferQueues = 1;
+
+        // The frame comes first, async work fills the gaps
+        float graphicsPriority = 1.0f;
+        float computePriority = 0.5f;
+        float transferPriority = 0.25f;
+    };
+
+private:
+    // Addresses are handed out, hence the pointers
+    std::vector<std::unique_ptr<SharedQueue>> queues;
+    std::vector<SharedQueue*> roles[QUEUE_ROLE_COUNT];
+    std::atomic<uint32_t> next[QUEUE_ROLE_COUNT];
+
+    // One per family in use, pointing into `priorities`
+    std::vector<VkDeviceQueueCreateInfo> createInfos;
+    std::vector<std::vector<float>> priorities;
+
+    uint32_t presentFamily;
+
+public:
+    QueueSet();
+
+    QueueSet(const QueueSet&) = delete;
+    QueueSet& operator=(const QueueSet&) = delete;
+
+    // Picks families and queue indices, before device creation
+    void Plan(VkPhysicalDevice, const QueueFamilyIndices&, Settings);
+
+    // Valid until the next Plan
+    const std::vector<VkDeviceQueueCreateInfo>& GetCreateInfos();
+
+    // After device creation
+    void Retrieve(VkDevice);
+
+    SharedQueue& Get(QueueRole, uint32_t i = 0);
+    uint32_t Count(QueueRole);
+    uint32_t Family(QueueRole);
+
+    // Queue 0 of the present family
+    VkQueue GetPresent();
+
+    // vkQueueSubmit on whichever of the role's queues is free
+    VkResult Submit(QueueRole, uint32_t count, const VkSubmitInfo*, VkFence);
+    // Same with vkQueueSubmit2, the device must have synchronization2
+    VkResult Submit(QueueRole, uint32_t count, const VkSubmitInfo2*, VkFence, const Synchronization2&);
+
+    // "[QUEUES] graphics: 0.0 (1.00) 0.1 (1.00) | compute: ..." to stdout
+    void Print();
+
+private:
+    SharedQueue* Allocate(uint32_t family, float priority, uint32_t familySize);
+
+    // Returns the role's queue to submit to, already locked
+    SharedQueue* LockFree(QueueRole);
+};
@@ -0,0 +1,488 @@
+#include "vkrenderer.hpp"
+
+#include "vkloader.hpp"
+
+#include "utils/debug.hpp"
+#include "utils/profiler.hpp"
+#include "utils/startup.hpp"
+
+#include <mutex>
+
+using std::vector;
+
+Renderer::Renderer( GLFWwindow* window )
+    : context( window ),
+      gpuProfiler( context.device, context.physicalDevice,
+                   context.familyIndices.graphics.value(),
+                   MAX_FRAMES_IN_FLIGHT ),
+      pipelineStats( context.device,
+                     context.enabledFeatures.pipelineStatisticsQuery == VK_TRUE,
+                     MAX_FRAMES_IN_FLIGHT ),
+      currentFrame( 0 ),
+      timings{}
+{
+  Init();
+}
+
+Renderer::Renderer( VkExtent2D extent )
+    : context( extent ),
+      gpuProfiler( context.device, context.physicalDevice,
+                   context.familyIndices.graphics.value(),
+                   MAX_FRAMES_IN_FLIGHT ),
+      pipelineStats( context.device,
+                     context.enabledFeatures.pipelineStatisticsQuery == VK_TRUE,
+                     MAX_FRAMES_IN_FLIGHT ),
+      currentFrame( 0 ),
+      timings{}
+{
+  Init();
+}
+
+void Renderer::Init()
+{
+  STARTUP_PHASE( "Renderer" );
+
+  CreateCommandPool();
+  AllocateCommandBuffers();
+  CreateSyncObjects();
+}
+
+Renderer::~Renderer()
+{
+  for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+    vkDestroySemaphore( context.device, imageAvailableSemaphores[i], nullptr );
+    vkDestroySemaphore( context.device, renderFinishedSemaphores[i], nullptr );
+    vkDestroyFence    ( context.device, inFlightFences[i], nullptr );
+  }
+
+  gpuProfiler.Destroy( context.device );
+  pipelineStats.Destroy( context.device );
+
+  // All commandBuffers contained on this commandPool get freed
+  // automatically
+  vkDestroyCommandPool( context.device, commandPool, nullptr );
+}
+
+void Renderer::SetScene( const vector<CullObject>& objects )
+{
+  context.culler.SetObjects( objects );
+
+  scene = objects;
+  capture.WriteScene( scene );
+}
+
+bool Renderer::StartCapture( const char* path, uint32_t frames )
+{
+  if ( frames == 0 ) return false;
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties( context.physicalDevice, &properties );
+
+  return capture.Open( path, frames, context.swapchain.extent,
+                       properties.deviceName, scene );
+}
+
+bool Renderer::IsCapturing()
+{
+  return capture.IsOpen();
+}
+
+const FrameTimings& Renderer::GetFrameTimings()
+{
+  return timings;
+}
+
+GpuProfiler& Renderer::GetGpuProfiler()
+{
+  return gpuProfiler;
+}
+
+PipelineStatistics& Renderer::GetPipelineStatistics()
+{
+  return pipelineStats;
+}
+
+float Renderer::CollectFrame( uint32_t frame )
+{
+  // The fence also means this frame's timestamps and statistics
+  // are ready, so reading them back doesn't stall
+  pipelineStats.Collect( context.device, frame );
+
+  if ( !gpuProfiler.Collect( context.device, frame ) ) return -1.0f;
+
+  return gpuProfiler.GetPassMs( "frame" );
+}
+
+float Renderer::Render()
+{
+  PROFILE_ZONE( "Render" );
+
+  // We wait for the last frame to have finished
+  // We pass in an array of Fences, as well as it's size
+  // The last two params refer to if we want to wait for all fences in
+  // the array, and the timeout for each
+  uint64_t start = Profiler::Now();
+  {
+    PROFILE_ZONE( "WaitForFences" );
+    vkWaitForFences( context.device, 1, &inFlightFences[currentFrame],
+                     VK_TRUE, UINT64_MAX );
+  }
+  timings.fenceWaitMs = ( Profiler::Now() - start ) / 1e6f;
+  // Since Fences are host sync objects, it's up to us to reset them
+  vkResetFences( context.device, 1, &inFlightFences[currentFrame] );
+
+  float gpuMs = CollectFrame( currentFrame );
+  context.resolution.Update( gpuMs );
+
+  // The scale this frame is about to be drawn at
+  capture.WriteFrame( context.resolution.GetScale(), gpuMs );
+
+  uint32_t imageIndex = 0;
+
+  // We acquire the next image index and store it
+  // We pass in the device, the swapchain and the timeout
+  // We can also pass in two sync objects - a semaphore and a fence -
+  // for the API to signal after the image is done loading.
+  start = Profiler::Now();
+  if ( !context.headless ) {
+    PROFILE_ZONE( "AcquireNextImage" );
+    vkAcquireNextImageKHR( context.device, context.swapchain.handle,
+                           UINT64_MAX, imageAvailableSemaphores[currentFrame],
+                           VK_NULL_HANDLE, &imageIndex );
+  }
+  timings.acquireMs = ( Profiler::Now() - start ) / 1e6f;
+
+  vkResetCommandBuffer( commandBuffers[currentFrame], 0 );
+  RecordCommand( commandBuffers[currentFrame], imageIndex );
+
+  // We prepare to submit the command buffer
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+  // We specify which semaphores we're waiting on, as well
+  // as which stages of the pipeline to wait
+  // In our example, we want to write out color, so we must wait
+  // for that stage to become available
+
+  // The swapchain image is only touched by the upscaling blit,
+  // so everything before it can run while we wait for the image
+  VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
+  VkPipelineStageFlags waitStages[]
+      = { VK_PIPELINE_STAGE_TRANSFER_BIT };
+
+  // Headless, there's no image to wait for and no one to signal
+  uint32_t semaphoreCount = context.headless ? 0 : 1;
+
+  submitInfo.waitSemaphoreCount = semaphoreCount;
+  submitInfo.pWaitSemaphores = waitSemaphores;
+  submitInfo.pWaitDstStageMask = waitStages;
+
+  // We submit an array of our command buffers
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+
+  // We also pass in semaphores to be signaled when the
+  // render finishes
+  VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+
+  submitInfo.signalSemaphoreCount = semaphoreCount;
+  submitInfo.pSignalSemaphores = signalSemaphores;
+
+  // We finally submit to the queue, passing in which queue to submit it to,
+  // an array of submit infos and a fence to be signaled when execution
+  // finishes
+  // Other threads may be submitting to the same queue
+  SharedQueue& queue = context.queues.Get( QueueRole::GRAPHICS );
+
+  {
+    PROFILE_ZONE( "QueueSubmit" );
+    std::lock_guard<std::mutex> guard( queue.lock );
+    if ( context.sync2.IsEnabled() ) {
+      SubmitSynchronization2( semaphoreCount == 1 );
+    }
+    else {
+      VK_ASSERT( vkQueueSubmit( context.graphicsQueue, 1, &submitInfo,
+                                inFlightFences[currentFrame] ) );
+    }
+  }
+
+  start = Profiler::Now();
+  if ( !context.headless ) {
+    // After we rendered onto the attachment, we must
+    // present it back to the swapchain in order to
+    // see the results
+    VkPresentInfoKHR presentInfo{};
+    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    // We wait on the semaphores that the QueueSubmit
+    // will signal when done
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = signalSemaphores;
+
+    // We pass in the image index...
+    presentInfo.pImageIndices = &imageIndex;
+
+    // ...and the swapchains
+    VkSwapchainKHR swapchains[] = { context.swapchain.handle };
+    presentInfo.swapchainCount = 1;
+    presentInfo.pSwapchains = swapchains;
+
+    // If we had used multiple swapchains, we
+    // would pass and array of VkResults to
+    // verify the output of each one
+    // Not necessary when using just one swapchain
+    // presentInfo.pResults = nullptr;
+
+    // After that, we're finally ready to show
+    // the world what we've done
+    PROFILE_ZONE( "QueuePresent" );
+    std::lock_guard<std::mutex> guard( queue.lock );
+    VK_ASSERT( vkQueuePresentKHR( context.graphicsQueue, &presentInfo ) );
+  }
+  timings.presentMs = ( Profiler::Now() - start ) / 1e6f;
+
+  currentFrame = ( currentFrame + 1 ) % MAX_FRAMES_IN_FLIGHT;
+
+  return gpuMs;
+}
+
+vector<float> Renderer::Finish()
+{
+  vkDeviceWaitIdle( context.device );
+
+  // `currentFrame` is the oldest frame still waiting to be read
+  vector<float> gpuTimes;
+  for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+    float gpuMs = CollectFrame( ( currentFrame + i ) % MAX_FRAMES_IN_FLIGHT );
+    if ( gpuMs >= 0.0f ) gpuTimes.push_back( gpuMs );
+  }
+
+  return gpuTimes;
+}
+
+void Renderer::SubmitSynchronization2( bool useSemaphores )
+{
+  // Same submission as the legacy path, but the acquire wait is
+  // scoped to the blit alone rather than every transfer
+  VkSemaphoreSubmitInfo wait{};
+  wait.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  wait.semaphore = imageAvailableSemaphores[currentFrame];
+  wait.stageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+
+  VkSemaphoreSubmitInfo signal{};
+  signal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO;
+  signal.semaphore = renderFinishedSemaphores[currentFrame];
+  signal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+
+  VkCommandBufferSubmitInfo commandInfo{};
+  commandInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO;
+  commandInfo.commandBuffer = commandBuffers[currentFrame];
+
+  VkSubmitInfo2 submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+  submitInfo.waitSemaphoreInfoCount = useSemaphores ? 1 : 0;
+  submitInfo.pWaitSemaphoreInfos = &wait;
+  submitInfo.commandBufferInfoCount = 1;
+  submitInfo.pCommandBufferInfos = &commandInfo;
+  submitInfo.signalSemaphoreInfoCount = useSemaphores ? 1 : 0;
+  submitInfo.pSignalSemaphoreInfos = &signal;
+
+  VK_ASSERT( context.sync2.queueSubmit2( context.graphicsQueue, 1, &submitInfo,
+                                         inFlightFences[currentFrame] ) );
+}
+
+void Renderer::RecordFrame()
+{
+  // The command buffer can't be reset while the GPU may still be
+  // executing it, the fence is left signaled for the next Render
+  vkWaitForFences( context.device, 1, &inFlightFences[currentFrame],
+                   VK_TRUE, UINT64_MAX );
+
+  vkResetCommandBuffer( commandBuffers[currentFrame], 0 );
+  RecordCommand( commandBuffers[currentFrame], 0 );
+}
+
+void Renderer::CreateCommandPool()
+{
+  VkCommandPoolCreateInfo commandPoolInfo{};
+  commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  // These flags allow us to specify how we're going to use the
+  // command buffers
+  // Since we're going to be re-recording them each frame, we specify
+  // the CREATE_RESET bit, as to make Vulkan optimize for frequent records
+  commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  commandPoolInfo.queueFamilyIndex = context.familyIndices.graphics.value();
+
+  VK_ASSERT( vkCreateCommandPool( context.device, &commandPoolInfo, nullptr,
+                                  &commandPool ) );
+}
+
+void Renderer::AllocateCommandBuffers()
+{
+  VkCommandBufferAllocateInfo commandBufferInfo{};
+  commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  // A Command Buffer's level can be:
+  // - PRIMARY: It's passed directly to the command queue
+  // - SECONDARY: Can only be called from primary command
+  commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  commandBufferInfo.commandPool = commandPool;
+
+  commandBuffers.resize( MAX_FRAMES_IN_FLIGHT );
+  // Here we specify the ammount of command buffers we will
+  // allocate VkAllocateCommandBuffers
+  commandBufferInfo.commandBufferCount = commandBuffers.size();
+  VK_ASSERT(
+    vkAllocateCommandBuffers(
+      context.device,
+      &commandBufferInfo,
+      commandBuffers.data()
+    )
+  );
+}
+
+void Renderer::RecordCommand( VkCommandBuffer& command, uint32_t imageIndex )
+{
+  PROFILE_ZONE( "RecordCommand" );
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  // /* Optional */ beginInfo.flags            = 0; // Specify usage, won't
+  // matter for us right now
+  // /* Optional */ beginInfo.pInheritanceInfo = nullptr; // Specify primary
+  // buffer to inherit (only for secondary buffers)
+
+  VK_ASSERT( vkBeginCommandBuffer( command, &beginInfo ) );
+
+  gpuProfiler.BeginFrame( command, currentFrame );
+  pipelineStats.BeginFrame( command, currentFrame );
+
+  // Scopes write a timestamp when created and another when they
+  // go out of scope, so each block below is one measured pass.
+  // Statistics scopes can't nest, so they only go around passes
+  {
+    GpuProfiler::Scope frameScope( gpuProfiler, command, "frame" );
+
+    VkExtent2D renderExtent = context.resolution.renderExtent;
+
+    // First we draw what was visible last frame...
+    {
+      GpuProfiler::Scope scope( gpuProfiler, command, "cull.early" );
+      PipelineStatistics::Scope stats( pipelineStats, command, "cull.early" );
+      context.culler.Cull( command, OcclusionCuller::EARLY, viewProjection.Data(),
+                           renderExtent );
+    }
+    {
+      GpuProfiler::Scope scope( gpuProfiler, command, "scene.early" );
+      PipelineStatistics::Scope stats( pipelineStats, command, "scene.early" );
+      RecordScenePass( command, OcclusionCuller::EARLY );
+    }
+
+    // ...then use its depth to find out what else became visible
+    {
+      GpuProfiler::Scope scope( gpuProfiler, command, "hiz" );
+      PipelineStatistics::Scope stats( pipelineStats, command, "hiz" );
+      context.depthPyramid.Build( command );
+    }
+    {
+      GpuProfiler::Scope scope( gpuProfiler, command, "cull.late" );
+      PipelineStatistics::Scope stats( pipelineStats, command, "cull.late" );
+      context.culler.Cull( command, OcclusionCuller::LATE, viewProjection.Data(),
+                           renderExtent );
+    }
+    {
+      GpuProfiler::Scope scope( gpuProfiler, command, "scene.late" );
+      PipelineStatistics::Scope stats( pipelineStats, command, "scene.late" );
+      RecordScenePass( command, OcclusionCuller::LATE );
+    }
+
+    // The scene was rendered at whatever resolution we could afford,
+    // stretch it over the swapchain image
+    if ( !context.headless ) {
+      GpuProfiler::Scope scope( gpuProfiler, command, "upscale" );
+      context.resolution.Blit( command,
+                               context.swapchain.images[imageIndex] );
+    }
+  }
+
+  VK_ASSERT( vkEndCommandBuffer( command ) );
+}
+
+void Renderer::RecordScenePass( VkCommandBuffer& command,
+                                OcclusionCuller::Phase phase )
+{
+  VkRenderPassBeginInfo passBeginInfo{};
+  passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  // Render area
+  // It covers the whole target even when rendering at a lower
+  // resolution, so the unused part is cleared to the far plane
+  // and never looks like an occluder to the Hi-Z pass
+  passBeginInfo.renderArea.extent = context.swapchain.extent;
+  passBeginInfo.renderArea.offset = { 0, 0 };
+  //
+  passBeginInfo.renderPass = phase == OcclusionCuller::EARLY
+                                 ? context.pipeline.renderPass
+                                 : context.pipeline.lateRenderPass;
+  passBeginInfo.framebuffer = context.resolution.framebuffer;
+
+  // One per attachment, the late pass loads them instead
+  // so the values are just ignored there
+  VkClearValue clearValues[2]{};
+  clearValues[0].color = { { 0.2f, 0.2f, 0.2f, 1.0f } };
+  clearValues[1].depthStencil = { 1.0f, 0 };
+
+  passBeginInfo.clearValueCount = 2;
+  passBeginInfo.pClearValues = clearValues;
+
+  // The last parameter has to do with wheter we're gonna use secondary
+  // command buffers or not.
+  // If yes, we should use VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+  // If not, we should use VK_SUBPASS_CONTENTS_INLINE
+  vkCmdBeginRenderPass( command, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+
+  // All drawing commands begin with vkCmd*** and all return void
+  vkCmdBindPipeline( command, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                     context.pipeline.pipeline );
+
+  // VkViewport viewports[] = { GetViewport() };
+  // VkRect2D scissors[] = { GetScissor() };
+
+  VkViewport viewport = context.resolution.GetViewport();
+  vkCmdSetViewport( command, 0, 1, &viewport );
+
+  VkRect2D scissor = context.resolution.GetScissor();
+  vkCmdSetScissor( command, 0, 1, &scissor );
+
+  /* Draw parameters now come from the culling pass, one
+     VkDrawIndirectCommand per object:
+      vertexCount: number of vertices (baked into shader, for now)
+      instanceCount: 1 if the object survived culling, 0 otherwise
+      firstVertex: starting vertex (defines lowest value of gl_VertexIndex)
+      firstInstance: index of the object (defines lowest value of
+     gl_InstanceIndex) */
+  context.culler.Draw( command, phase );
+
+  vkCmdEndRenderPass( command );
+}
+
+void Renderer::CreateSyncObjects()
+{
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  // We add this flag so that the fence will start as signaled
+  // This is to prevent and infinite wait time in our loop, since
+  // we wait for this fence to signal in order to proceed
+  fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
+  renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
+  inFlightFences.resize( MAX_FRAMES_IN_FLIGHT );
+
+  for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
+    VK_ASSERT( vkCreateSemaphore( context.device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i] ) );
+    VK_ASSERT( vkCreateSemaphore( context.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i] ) );
+    VK_ASSERT( vkCreateFence    ( context.device, &fenceInfo, nullptr, &inFlightFences[i] ) );
+  }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include "vkloader.hpp"
+#include "GLFW/glfw3.h"
+
+#include "vkcapture.hpp"
+#include "vkcontext.hpp"
+#include "components/vkculling.hpp"
+#include "components/vkgpuprofiler.hpp"
+#include "components/vkpipelinestats.hpp"
+#include "utils/math.hpp"
+
+#include <vector>
+
+// Where the last Render call spent its time, in milliseconds
+struct FrameTimings {
+    float fenceWaitMs;
+    float acquireMs;
+    float presentMs;
+};
+
+/*
+    Everything needed to get frames out of a VulkanContext: command
+    buffers, sync objects and the frame recording itself.
+    It used to live in main.cpp, it was moved here so the app and the
+    benchmark tool render exactly the same frames.
+
+    Built with a window it presents every frame, built with just an
+    extent it runs headless and stops at the offscreen target.
+*/
+class Renderer {
+public:
+    /*
+        Frames in Flight refers to how the CPU can process a frame
+        while the GPU is rendering another one. If it weren't for
+        these, the CPU would have to idle while the GPU renders the
+        last frame. We can make it so that the CPU keeps working.
+        This improves performance, however, can introduce latency
+        if we were to allow too many frames to be in flight.
+        2 is a good number.
+    */
+    static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+
+    VulkanContext context;
+
+private:
+    /*
+        If we're processing future frames, we can't just use the
+        same objects as the current frame is, as Vulkan is reading
+        and writing to them. We must create multiple sync objects
+        and commands buffers, in order to leave the objects being
+        used alone
+    */
+    std::vector<VkSemaphore> imageAvailableSemaphores, renderFinishedSemaphores;
+    std::vector<VkFence> inFlightFences;
+
+    VkCommandPool commandPool;
+    std::vector<VkCommandBuffer> commandBuffers;
+
+    // Timestamps around every pass, read back once a frame's
+    // fence tells us the GPU is done with it
+    GpuProfiler gpuProfiler;
+    // Same, but counting work instead of timing it, off by default
+    PipelineStatistics pipelineStats;
+
+    uint32_t currentFrame;
+
+    FrameTimings timings;
+
+    // Kept so a capture can start with what's on screen
+    std::vector<CullObject> scene;
+    CaptureWriter capture;
+
+    // There's no camera yet, our triangle is already in clip space
+    const MathUtils::mat4 viewProjection;
+
+public:
+    Renderer() = delete;
+    Renderer(GLFWwindow* window);
+    // Headless
+    Renderer(VkExtent2D extent);
+    ~Renderer();
+
+    void SetScene(const std::vector<CullObject>& objects);
+
+    // Returns the GPU time of the frame it had to wait for, or a
+    // negative value when that frame's timestamps weren't available
+    float Render();
+
+    // Waits for the frames still in flight, returns their GPU times
+    // oldest first (same rules as Render)
+    std::vector<float> Finish();
+
+    // Records the current frame's command buffer without submitting
+    // it, so recording can be measured on its own
+    void RecordFrame();
+
+    const FrameTimings& GetFrameTimings();
+
+    // Writes the scene and the next `frames` frames to `path`, for
+    // tools/replay.cpp. False if the file couldn't be created
+    bool StartCapture(const char* path, uint32_t frames);
+    bool IsCapturing();
+
+    GpuProfiler& GetGpuProfiler();
+    PipelineStatistics& GetPipelineStatistics();
+
+private:
+    void Init();
+
+    void CreateCommandPool();
+    void AllocateCommandBuffers();
+    void CreateSyncObjects();
+
+    float CollectFrame(uint32_t frame);
+
+    void RecordCommand(VkCommandBuffer& command, uint32_t imageIndex);
+    void RecordScenePass(VkCommandBuffer& command, OcclusionCuller::Phase phase);
+
+    // vkQueueSubmit2 version of the frame submission, when the
+    // context has synchronization2. The graphics queue must be locked
+    void SubmitSynchronization2(bool useSemaphores);
+};
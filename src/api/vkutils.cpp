@@ -1,19 +1,57 @@
-#include <vulkan/vulkan.h>
+#include "vkloader.hpp"
 
 #include "vkutils.hpp"
+#include "vkcapabilities.hpp"
 #include "vkcontext.hpp"
+#include "components/vkdebugsink.hpp"
 #include "utils/debug.hpp"
+#include "utils/startup.hpp"
 
+#include <algorithm>
 #include <stdexcept>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 
-std::vector<const char*> VkUtils::GetExtensions() {
-    uint32_t extensionCount = 0;
-    auto extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
-    std::vector<const char*> exts(extensions, extensions + extensionCount);
+static bool& Verbosity() {
+#ifdef NDEBUG
+    static bool verbose = false;
+#else
+    static bool verbose = true;
+#endif
+    // Read once, the first time anyone asks
+    static bool fromEnvironment = [] {
+        if(const char* value = getenv("VULKAN_VERBOSE")) {
+            verbose = strcmp(value, "0") != 0;
+        }
+        return true;
+    }();
+    (void)fromEnvironment;
+
+    return verbose;
+}
 
-    if(useValidationLayers) {
+bool VkUtils::IsVerbose() {
+    return Verbosity();
+}
+
+void VkUtils::SetVerbose(bool verbose) {
+    Verbosity() = verbose;
+}
+
+std::vector<const char*> VkUtils::GetExtensions(bool headless, bool debugUtils) {
+    std::vector<const char*> exts;
+
+    // GLFW may not even be initialized when running headless
+    if(!headless) {
+        uint32_t extensionCount = 0;
+        auto extensions = glfwGetRequiredInstanceExtensions(&extensionCount);
+        exts.assign(extensions, extensions + extensionCount);
+    }
+
+    if(debugUtils) {
         exts.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
@@ -21,6 +59,8 @@ std::vector<const char*> VkUtils::GetExtensions() {
 }
 
 void VkUtils::ListLayers() {
+    STARTUP_PHASE("ListLayers");
+
     uint32_t layerCount = 0;
     vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
     std::vector<VkLayerProperties> layerProperties(layerCount);
@@ -32,6 +72,8 @@ void VkUtils::ListLayers() {
 }
 
 std::vector<const char*> VkUtils::GetLayers() {
+    STARTUP_PHASE("EnumerateLayers");
+
     uint32_t layerCount = 0;
 
     vkEnumerateInstanceLayerProperties(&layerCount, nullptr);
@@ -45,39 +87,17 @@ std::vector<const char*> VkUtils::GetLayers() {
             }
         }
     }
-    
-    throw std::runtime_error("No Validation Layers found");
+
+    return {};
 }
 
 bool DeviceSupportsExtensions(VkPhysicalDevice device) {
-    uint32_t extensionCount;
-
-    vkEnumerateDeviceExtensionProperties(
-        device, nullptr, &extensionCount, nullptr
-    );
-
-    std::vector<VkExtensionProperties> 
-        availableExtensions(extensionCount);
-
-    VK_ASSERT(
-        vkEnumerateDeviceExtensionProperties(
-            device, 
-            nullptr, 
-            &extensionCount, 
-            availableExtensions.data()
-        )
-    );
-
     for(auto& requiredExtension : DEVICE_EXTENSIONS) {
-        bool found = false;
-        for(auto& availableExtension : availableExtensions) {
-            if(strcmp(requiredExtension, availableExtension.extensionName) == 0) {
-                printf("\t- Found extension %s\n", requiredExtension);
-                found = true;
-                break;
-            }
+        if(!Capabilities::HasExtension(device, requiredExtension)) return false;
+
+        if(VkUtils::IsVerbose()) {
+            printf("\t- Found extension %s\n", requiredExtension);
         }
-        if(!found) return false;
     }
 
     return true;
@@ -88,15 +108,20 @@ bool VkUtils::IsDeviceSuitable(
     VkSurfaceKHR surface
 ) {
     // Properties are basic things like name, device type and API version
-    VkPhysicalDeviceProperties properties;
-    // Features are additional stuff like VR support, geometry shaders and so on
-    VkPhysicalDeviceFeatures features;
-
-    vkGetPhysicalDeviceProperties(device, &properties);
-    vkGetPhysicalDeviceFeatures(device, &features);
+    const VkPhysicalDeviceProperties& properties =
+        Capabilities::Get(device).properties;
     
     // Get queue families
     auto queueFamilies = VkUtils::FindQueueFamilies(device, surface);
+
+    // Headless, all we need is somewhere to submit graphics work
+    if(surface == VK_NULL_HANDLE) {
+        if(VkUtils::IsVerbose()) {
+            std::cout << "Available GPU: " << properties.deviceName << "\n";
+        }
+        return queueFamilies.IsComplete();
+    }
+
     bool extensionsSupported = DeviceSupportsExtensions(device);
 
     bool swapchainAdequate = false;
@@ -109,114 +134,277 @@ bool VkUtils::IsDeviceSuitable(
             !swapchainDetails.presentModes.empty();
     }
 
-#ifndef NDEBUG
-    std::cout << "Available GPU: " << properties.deviceName << "\n";
-    std::cout << "Device " << 
-        (extensionsSupported ? "" : "DOES NOT ")
-    << "support extensions\n";
-#endif
+    if(VkUtils::IsVerbose()) {
+        std::cout << "Available GPU: " << properties.deviceName << "\n";
+        std::cout << "Device " << 
+            (extensionsSupported ? "" : "DOES NOT ")
+        << "support extensions\n";
+    }
 
-    // We want a discrete GPU with geometry shader support, we could make this
-    // more complex if we wanted, like a ranking system between available devices
+    // Only what we can't run without, which of the suitable devices
+    // we prefer is up to RateDevice
     return 
         extensionsSupported &&
         swapchainAdequate   &&
         queueFamilies.IsComplete();
 }
 
-int times = 1, reqs = 1;
-QueueFamilyIndices VkUtils::FindQueueFamilies(
+static uint64_t DeviceTypeRank(VkPhysicalDeviceType type) {
+    switch(type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return 4;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return 3;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return 2;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return 1;
+        default:                                     return 0;
+    }
+}
+
+static const char* DeviceTypeName(VkPhysicalDeviceType type) {
+    switch(type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   return "discrete";
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: return "integrated";
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    return "virtual";
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            return "cpu";
+        default:                                     return "other";
+    }
+}
+
+DeviceCandidate VkUtils::RateDevice(
     VkPhysicalDevice device,
-    VkSurfaceKHR surface
+    uint32_t index,
+    VkSurfaceKHR surface,
+    uint32_t instanceVersion
 ) {
-    static optional<QueueFamilyIndices> indices;
+    DeviceCandidate candidate{};
+    candidate.device = device;
+    candidate.index = index;
 
-#ifndef NDEBUG
-    std::cout << "Requested for queue families " << reqs++ << " times\n";
-#endif
+    const DeviceCapabilities& capabilities = Capabilities::Get(device);
+    candidate.properties = capabilities.properties;
 
-    // Prevents recalculations
-    if(indices.has_value()) return indices.value();
+    // The UUID stays the same across reboots and driver updates,
+    // unlike the index, so it's what scripts should select by
+    if(instanceVersion >= VK_API_VERSION_1_1
+        && candidate.properties.apiVersion >= VK_API_VERSION_1_1) {
+        VkPhysicalDeviceIDProperties id{};
+        id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
 
-#ifndef NDEBUG
-    std::cout << "Searched for queue families " << times++ << " times\n";
-#endif
+        VkPhysicalDeviceProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties.pNext = &id;
 
-    QueueFamilyIndices _indices;
-    uint32_t queueFamilyCount;
+        vkGetPhysicalDeviceProperties2(device, &properties);
 
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+        memcpy(candidate.uuid, id.deviceUUID, VK_UUID_SIZE);
+        candidate.hasUuid = true;
+    }
 
-    int i = 0;
-    for(auto& queueFamily : queueFamilies) {
-        if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-            _indices.graphics = i;
-        }
+    const VkPhysicalDeviceMemoryProperties& memory = capabilities.memory;
 
-        VkBool32 presentSupport = VK_FALSE;
-        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-        if(presentSupport == VK_TRUE) {
-            _indices.present = i;
+    for(uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+        if(memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+            candidate.localMemory += memory.memoryHeaps[i].size;
         }
+    }
+
+    candidate.suitable = VkUtils::IsDeviceSuitable(device, surface);
+    if(!candidate.suitable) return candidate;
+
+    const VkPhysicalDeviceFeatures& features = capabilities.features;
 
-        if(_indices.IsComplete()) break;
-        i++;
+    uint64_t optionalFeatures =
+        (features.multiDrawIndirect == VK_TRUE ? 1 : 0) +
+        (features.pipelineStatisticsQuery == VK_TRUE ? 1 : 0);
+
+    // Each level only breaks ties of the one above it:
+    // type, then features, then memory in MB (capped, 10TB is plenty)
+    uint64_t memoryMB = std::min<uint64_t>(candidate.localMemory >> 20, 9999999);
+
+    candidate.score =
+        DeviceTypeRank(candidate.properties.deviceType) * 100000000 +
+        optionalFeatures * 10000000 +
+        memoryMB;
+
+    return candidate;
+}
+
+static std::string& DeviceSelector() {
+    static std::string selector = [] {
+        const char* value = getenv("VULKAN_DEVICE");
+        return std::string(value ? value : "");
+    }();
+    return selector;
+}
+
+const std::string& VkUtils::GetDeviceSelector() {
+    return DeviceSelector();
+}
+
+void VkUtils::SetDeviceSelector(const std::string& selector) {
+    DeviceSelector() = selector;
+}
+
+static std::string UuidString(const uint8_t uuid[VK_UUID_SIZE]) {
+    char text[VK_UUID_SIZE * 2 + 5];
+    char* out = text;
+
+    for(uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+        // Same grouping as every other tool prints them in
+        if(i == 4 || i == 6 || i == 8 || i == 10) *out++ = '-';
+        out += snprintf(out, 3, "%02x", uuid[i]);
     }
 
-    indices.emplace(_indices);
+    return std::string(text, out);
+}
+
+bool VkUtils::MatchesDevice(
+    const DeviceCandidate& candidate,
+    const std::string& selector
+) {
+    if(selector.empty()) return false;
+
+    // Index
+    if(selector.find_first_not_of("0123456789") == std::string::npos) {
+        return strtoul(selector.c_str(), nullptr, 10) == candidate.index;
+    }
+
+    std::string lower;
+    for(char c : selector) {
+        if(c != '-') lower += static_cast<char>(tolower(c));
+    }
 
-    return indices.value();
+    // UUID
+    if(lower.size() == VK_UUID_SIZE * 2
+        && lower.find_first_not_of("0123456789abcdef") == std::string::npos) {
+        if(!candidate.hasUuid) return false;
+
+        std::string uuid = UuidString(candidate.uuid);
+        uuid.erase(std::remove(uuid.begin(), uuid.end(), '-'), uuid.end());
+        return uuid == lower;
+    }
+
+    // Name
+    std::string name, pattern;
+    for(const char* c = candidate.properties.deviceName; *c; c++) {
+        name += static_cast<char>(tolower(*c));
+    }
+    for(char c : selector) pattern += static_cast<char>(tolower(c));
+
+    return name.find(pattern) != std::string::npos;
 }
 
-SwapchainSupport VkUtils::FindSwapchainSupport(
+void VkUtils::PrintDevices(
+    const std::vector<DeviceCandidate>& candidates,
+    const DeviceCandidate* chosen
+) {
+    for(auto& candidate : candidates) {
+        fprintf(stderr, "[DEVICE] %c %u: %s (%s, %lluMB",
+            &candidate == chosen ? '*' : ' ',
+            candidate.index,
+            candidate.properties.deviceName,
+            DeviceTypeName(candidate.properties.deviceType),
+            static_cast<unsigned long long>(candidate.localMemory >> 20));
+
+        if(candidate.suitable) {
+            fprintf(stderr, ", score %llu",
+                static_cast<unsigned long long>(candidate.score));
+        }
+        else {
+            fprintf(stderr, ", unsuitable");
+        }
+
+        if(candidate.hasUuid) {
+            fprintf(stderr, ", uuid %s", UuidString(candidate.uuid).c_str());
+        }
+        fprintf(stderr, ")\n");
+    }
+}
+
+QueueFamilyIndices VkUtils::FindQueueFamilies(
     VkPhysicalDevice device,
     VkSurfaceKHR surface
 ) {
-    static optional<SwapchainSupport> _support;
+    QueueFamilyIndices indices;
 
-    if(_support.has_value()) return _support.value();
+    const auto& queueFamilies = Capabilities::Get(device).queueFamilies;
+    const SurfaceCapabilities* surfaceCapabilities =
+        surface != VK_NULL_HANDLE ? &Capabilities::Get(device, surface) : nullptr;
 
-    SwapchainSupport support{};
+    for(uint32_t i = 0; i < queueFamilies.size(); i++) {
+        if(queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+            indices.graphics = i;
+        }
 
-    { // Surface capabilities
-        vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
-            device, surface, &support.capabilites
-        );
+        if(surfaceCapabilities != nullptr) {
+            if(surfaceCapabilities->presentSupport[i] == VK_TRUE) {
+                indices.present = i;
+            }
+        }
+        else if(indices.graphics.has_value()) {
+            // Headless, nothing is ever presented, the graphics
+            // queue stands in so the rest of the code doesn't care
+            indices.present = indices.graphics.value();
+        }
+
+        if(indices.IsComplete()) break;
     }
 
-    { // Surface Formats
-        uint32_t formatCount;
-        vkGetPhysicalDeviceSurfaceFormatsKHR(
-            device, surface, &formatCount, nullptr
-        );
-
-        if(formatCount != 0) {
-            support.formats.resize(formatCount);
-            vkGetPhysicalDeviceSurfaceFormatsKHR(
-                device, surface, &formatCount, support.formats.data()
-            );
-        }
+    return indices;
+}
+
+SwapchainSupport VkUtils::FindSwapchainSupport(
+    VkPhysicalDevice device,
+    VkSurfaceKHR surface
+) {
+    return Capabilities::Get(device, surface).swapchain;
+}
+
+uint32_t VkUtils::FindMemoryType(
+    VkPhysicalDevice device,
+    uint32_t typeFilter,
+    VkMemoryPropertyFlags properties
+) {
+    const VkPhysicalDeviceMemoryProperties& memoryProperties =
+        Capabilities::Get(device).memory;
+
+    // `typeFilter` is a bitmask of the memory types a resource
+    // can live in, we pick the first of those that has all the
+    // properties we asked for
+    for(uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        bool allowed = typeFilter & (1 << i);
+        bool matches = 
+            (memoryProperties.memoryTypes[i].propertyFlags & properties) 
+            == properties;
+
+        if(allowed && matches) return i;
     }
 
-    { // Present Modes
-        uint32_t modeCount;
-        vkGetPhysicalDeviceSurfacePresentModesKHR(
-            device, surface, &modeCount, nullptr
-        );
-
-        if(modeCount != 0) {
-            support.presentModes.resize(modeCount);
-            vkGetPhysicalDeviceSurfacePresentModesKHR(
-                device, surface, &modeCount, support.presentModes.data()
-            );
+    throw std::runtime_error("No suitable memory type found");
+}
+
+VkFormat VkUtils::FindDepthFormat(VkPhysicalDevice device) {
+    // The depth buffer is also read by the Hi-Z compute pass,
+    // so the format must support sampling as well
+    const VkFormatFeatureFlags required = 
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT |
+        VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+
+    const VkFormat candidates[] = {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_D24_UNORM_S8_UINT
+    };
+
+    for(auto format : candidates) {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(device, format, &properties);
+
+        if((properties.optimalTilingFeatures & required) == required) {
+            return format;
         }
     }
 
-    _support.emplace(support);
-
-    return support;
+    throw std::runtime_error("No suitable depth format found");
 }
 
 void VkUtils::RecordCmdBuffer(VkCommandBuffer&, uint32_t imageIndex) {
@@ -232,11 +420,11 @@ VKAPI_ATTR VkBool32 VKAPI_CALL VkUtils::DebugCallback(
     const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData,
     void* pUserData) 
 {
-    const auto WARNING = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT;
-
-    if(messageSeverity > WARNING) {
-        std::cout << "[ERROR] " << pCallbackData->pMessage << "\n";
-    }
+    // Runs inside the driver, printing here would stall whatever
+    // Vulkan call triggered the message, so we just queue it
+    static_cast<DebugSink*>(pUserData)->Push(
+        messageSeverity, messageType, pCallbackData
+    );
 
     return VK_FALSE;
 }
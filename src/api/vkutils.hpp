@@ -1,11 +1,12 @@
 #pragma once
 
-#include <vulkan/vulkan.h>
+#include "vkloader.hpp"
 #include "GLFW/glfw3.h"
 
 #include "utils/option.hpp"
 
 #include <vector>
+#include <string>
 #include <iostream>
 
 using std::experimental::optional;
@@ -26,17 +27,77 @@ struct SwapchainSupport {
     std::vector<VkPresentModeKHR> presentModes;
 };
 
+// One entry per physical device, see VkUtils::RateDevice
+struct DeviceCandidate {
+    VkPhysicalDevice device;
+    // Position in vkEnumeratePhysicalDevices' list
+    uint32_t index;
+    VkPhysicalDeviceProperties properties;
+    // Only known when both the instance and the device are 1.1+
+    bool hasUuid;
+    uint8_t uuid[VK_UUID_SIZE];
+    // Sum of the DEVICE_LOCAL heaps
+    VkDeviceSize localMemory;
+    // Can run us at all: queues, extensions, swapchain
+    bool suitable;
+    // Higher is better, 0 when not suitable
+    uint64_t score;
+};
+
 namespace VkUtils {
-    std::vector<const char*> GetExtensions();
+    // Headless contexts don't need GLFW's surface extensions
+    std::vector<const char*> GetExtensions(bool headless, bool debugUtils);
+    // Empty when none of VALIDATION_LAYERS is installed
     std::vector<const char*> GetLayers();
 
+    // Device selection diagnostics. On by default in debug builds,
+    // VULKAN_VERBOSE=0/1 overrides it
+    bool IsVerbose();
+    void SetVerbose(bool);
+
+    // A null `surface` means headless: no present or swapchain support needed
     bool IsDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface);
 
+    /*
+        Scores a device for PickPhysicalDevice, most important first:
+        - type: discrete > integrated > virtual > CPU
+        - optional features we make use of (multiDrawIndirect,
+          pipelineStatisticsQuery)
+        - device local memory
+    */
+    DeviceCandidate RateDevice(
+        VkPhysicalDevice device,
+        uint32_t index,
+        VkSurfaceKHR surface,
+        uint32_t instanceVersion
+    );
+
+    // Explicit device choice, overrides the scores. Either an index,
+    // a UUID (dashes optional) or part of the name, case insensitive.
+    // VULKAN_DEVICE sets it, empty means pick the best scoring one
+    const std::string& GetDeviceSelector();
+    void SetDeviceSelector(const std::string&);
+    bool MatchesDevice(const DeviceCandidate&, const std::string& selector);
+
+    // One line per candidate to stderr, marking the one picked
+    void PrintDevices(
+        const std::vector<DeviceCandidate>&,
+        const DeviceCandidate* chosen
+    );
+
     QueueFamilyIndices FindQueueFamilies(VkPhysicalDevice device, VkSurfaceKHR surface);
     SwapchainSupport FindSwapchainSupport(VkPhysicalDevice device, VkSurfaceKHR surface);
 
     void ListLayers();
 
+    uint32_t FindMemoryType(
+        VkPhysicalDevice device,
+        uint32_t typeFilter,
+        VkMemoryPropertyFlags properties
+    );
+
+    VkFormat FindDepthFormat(VkPhysicalDevice device);
+
     void RecordCmdBuffer(VkCommandBuffer&, uint32_t imageIndex);
 
     // Debug message callback
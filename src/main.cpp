@@ -1,302 +1,325 @@
-#include <vulkan/vulkan.h>
+#include "api/vkloader.hpp"
 
-#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <utility>
 
 #include "GLFW/glfw3.h"
-#include "api/vkcontext.hpp"
-#include "utils/debug.hpp"
+#include "api/vkrenderer.hpp"
+#include "api/components/vkculling.hpp"
+#include "utils/framestats.hpp"
+#include "utils/jobs.hpp"
+#include "utils/profiler.hpp"
+#include "utils/spsc.hpp"
+#include "utils/startup.hpp"
+
+// Everything the render thread needs to know about a frame, decided
+// on the main thread. Simulation results go in here as they come
+struct FramePacket {
+  uint64_t frame = 0;
+  // Last packet, the render thread finishes up and exits
+  bool quit = false;
+};
 
-using std::vector;
+// How far the main thread may run ahead of rendering, in frames
+const uint32_t MAX_PACKETS_IN_FLIGHT = 2;
 
 class VulkanApp {
  private:
   GLFWwindow* window;
-  VulkanContext context;
+  Renderer renderer;
 
-  /*
-      Frames in Flight refers to how the CPU can process a frame
-      while the GPU is rendering another one. If it weren't for
-      these, the CPU would have to idle while the GPU renders the
-      last frame. We can make it so that the CPU keeps working.
-      This improves performance, however, can introduce latency
-      if we were to allow too many frames to be in flight.
-      2 is a good number.
-  */
-  const int MAX_FRAMES_IN_FLIGHT = 2;
+  // FRAME_STATS_LOG=<file> appends the summaries and hitches there
+  // instead of stdout, HITCH_MULTIPLE=<x> changes what counts as one
+  FILE* frameStatsLog;
+  FrameStats::Monitor frameStats;
+  uint64_t frameCount;
 
-  /*
-      If we're processing future frames, we can't just use the
-      same objects as the current frame is, as Vulkan is reading
-      and writing to them. We must create multiple sync objects
-      and commands buffers, in order to leave the objects being
-      used alone
-  */
-  vector<VkSemaphore> imageAvailableSemaphores, renderFinishedSemaphores;
-  vector<VkFence> inFlightFences;
+  // CAPTURE="<first frame>,<frame count>,<file>" writes those frames
+  // out for tools/replay.cpp
+  unsigned long long captureFirst, captureCount;
+  char capturePath[256];
 
-  VkCommandPool commandPool;
-  vector<VkCommandBuffer> commandBuffers;
-
-  uint32_t currentFrame;
+  // Main thread -> render thread
+  SpscQueue<FramePacket, MAX_PACKETS_IN_FLIGHT> packets;
+  std::thread renderThread;
+  // Main thread only
+  uint64_t framesSent;
 
  public:
   VulkanApp( const char* title, int width, int height )
-      : window( glfwCreateWindow( width, height, title, nullptr, nullptr ) ),
-        context( window ),
-        currentFrame( 0 ),
-        renderFinishedSemaphores( MAX_FRAMES_IN_FLIGHT ),
-        imageAvailableSemaphores( MAX_FRAMES_IN_FLIGHT ),
-        commandBuffers( MAX_FRAMES_IN_FLIGHT )
+      : window( OpenWindow( title, width, height ) ),
+        renderer( window ),
+        frameStatsLog( OpenFrameStatsLog() ),
+        frameStats( GetFrameStatsSettings(), frameStatsLog ),
+        frameCount( 0 ),
+        captureFirst( 0 ),
+        captureCount( 0 ),
+        capturePath{},
+        framesSent( 0 )
   {
-    CreateCommandPool();
-    AllocateCommandBuffers();
-    CreateSyncObjects();
+    {
+      STARTUP_PHASE( "CreateScene" );
+      CreateScene();
+    }
+
+    // PIPELINE_STATS=1 counts the vertices, primitives and shader
+    // invocations of every pass, fragment invocations show overdraw
+    const char* stats = getenv( "PIPELINE_STATS" );
+    if ( stats != nullptr && strcmp( stats, "0" ) != 0 ) {
+      auto& pipelineStats = renderer.GetPipelineStatistics();
+      if ( pipelineStats.IsSupported() ) {
+        pipelineStats.SetEnabled( true );
+        pipelineStats.SetLogInterval( 5.0f );
+      }
+      else {
+        fprintf( stderr, "[STATS] Pipeline statistics queries not supported\n" );
+      }
+    }
+
+#ifndef NDEBUG
+    renderer.GetGpuProfiler().SetLogInterval( 5.0f );
+#endif
+
+    if ( const char* capture = getenv( "CAPTURE" ) ) {
+      if ( sscanf( capture, "%llu,%llu,%255s", &captureFirst, &captureCount,
+                   capturePath ) != 3 || captureCount == 0 ) {
+        fprintf( stderr, "[CAPTURE] Invalid CAPTURE \"%s\"\n", capture );
+        captureCount = 0;
+      }
+    }
   }
 
   ~VulkanApp()
   {
-    for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
-      vkDestroySemaphore( context.device, imageAvailableSemaphores[i], nullptr );
-      vkDestroySemaphore( context.device, renderFinishedSemaphores[i], nullptr );
-      vkDestroyFence    ( context.device, inFlightFences[i], nullptr );
-    }
-
-    // All commandBuffers contained on this commandPool get freed
-    // automatically
-    vkDestroyCommandPool( context.device, commandPool, nullptr );
+    if ( frameStatsLog != stdout ) fclose( frameStatsLog );
 
     glfwDestroyWindow( window );
     glfwTerminate();
   }
 
+  /*
+    Two threads from here on. This one handles window events and
+    everything else that decides what a frame is, then hands it over
+    as a FramePacket. The render thread turns packets into frames.
+    A fence wait or a slow present only ever blocks the render
+    thread, the window keeps responding, and at most
+    MAX_PACKETS_IN_FLIGHT frames get decided ahead of rendering.
+  */
   void Run()
   {
-    while ( !glfwWindowShouldClose( window ) ) {
+    {
+      // Part of startup too, drivers tend to defer work until
+      // things are first used
+      STARTUP_PHASE( "FirstFrame" );
       glfwPollEvents();
-      Render();
-      currentFrame = ( currentFrame + 1 ) % MAX_FRAMES_IN_FLIGHT;
+      renderer.Render();
     }
-    vkDeviceWaitIdle( context.device );
+    // Shaders loaded from here on aren't startup
+    Startup::End();
+    ReportStartup();
+
+    renderThread = std::thread( &VulkanApp::RenderLoop, this );
+
+    while ( !glfwWindowShouldClose( window ) ) {
+      {
+        PROFILE_ZONE( "PollEvents" );
+        glfwPollEvents();
+      }
+
+      FramePacket packet;
+      packet.frame = framesSent++;
+      Send( std::move( packet ) );
+    }
+
+    FramePacket quit;
+    quit.quit = true;
+    Send( std::move( quit ) );
+
+    renderThread.join();
   }
 
-  void Render()
+ private:
+  // Waits for room, handling events meanwhile: the render thread
+  // posts an empty event whenever it takes a packet out
+  void Send( FramePacket&& packet )
   {
-    // We wait for the last frame to have finished
-    // We pass in an array of Fences, as well as it's size
-    // The last two params refer to if we want to wait for all fences in
-    // the array, and the timeout for each
-    vkWaitForFences( context.device, 1, &inFlightFences[currentFrame], VK_TRUE,
-                     UINT64_MAX );
-    // Since Fences are host sync objects, it's up to us to reset them
-    vkResetFences( context.device, 1, &inFlightFences[currentFrame] );
-
-    uint32_t imageIndex = 0;
-
-    // We acquire the next image index and store it
-    // We pass in the device, the swapchain and the timeout
-    // We can also pass in two sync objects - a semaphore and a fence -
-    // for the API to signal after the image is done loading.
-    vkAcquireNextImageKHR( context.device, context.swapchain.handle, UINT64_MAX,
-                           imageAvailableSemaphores[currentFrame],
-                           VK_NULL_HANDLE, &imageIndex );
-
-    vkResetCommandBuffer( commandBuffers[currentFrame], 0 );
-    RecordCommand( commandBuffers[currentFrame], imageIndex );
-
-    // We prepare to submit the command buffer
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    // We specify which semaphores we're waiting on, as well
-    // as which stages of the pipeline to wait
-    // In our example, we want to write out color, so we must wait
-    // for that stage to become available
-
-    VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-    VkPipelineStageFlags waitStages[]
-        = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphores;
-    submitInfo.pWaitDstStageMask = waitStages;
-
-    // We submit an array of our command buffers
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-
-    // We also pass in semaphores to be signaled when the
-    // render finishes
-    VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = signalSemaphores;
-
-    // We finally submit to the queue, passing in which queue to submit it to,
-    // an array of submit infos and a fence to be signaled when execution
-    // finishes
-    VK_ASSERT( vkQueueSubmit( context.graphicsQueue, 1, &submitInfo,
-                              inFlightFences[currentFrame] ) );
-
-    // After we rendered onto the attachment, we must
-    // present it back to the swapchain in order to
-    // see the results
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-
-    // We wait on the semaphores that the QueueSubmit
-    // will signal when done
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
-
-    // We pass in the image index...
-    presentInfo.pImageIndices = &imageIndex;
-
-    // ...and the swapchains
-    VkSwapchainKHR swapchains[] = { context.swapchain.handle };
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapchains;
-
-    // If we had used multiple swapchains, we
-    // would pass and array of VkResults to
-    // verify the output of each one
-    // Not necessary when using just one swapchain
-    // presentInfo.pResults = nullptr;
-
-    // After that, we're finally ready to show
-    // the world what we've done
-    VK_ASSERT( vkQueuePresentKHR( context.graphicsQueue, &presentInfo ) );
+    while ( !packets.TryPush( std::move( packet ) ) ) {
+      PROFILE_ZONE( "WaitForRenderThread" );
+      glfwWaitEvents();
+    }
   }
 
- private:
-  void CreateCommandPool()
+  void RenderLoop()
+  {
+    Profiler::SetThreadName( "render" );
+
+    FramePacket packet;
+    uint32_t idle = 0;
+
+    while ( true ) {
+      if ( !packets.TryPop( packet ) ) {
+        // The main thread is rarely behind, don't sleep right away
+        if ( ++idle < 1000 ) {
+          std::this_thread::yield();
+        }
+        else {
+          std::this_thread::sleep_for( std::chrono::microseconds( 100 ) );
+        }
+        continue;
+      }
+      idle = 0;
+
+      // Room for the next one
+      glfwPostEmptyEvent();
+
+      if ( packet.quit ) break;
+
+      uint64_t frameStart = Profiler::Now();
+
+      PROFILE_FRAME();
+      StartCaptureIfDue();
+      float gpuMs = renderer.Render();
+
+      RecordFrameStats( frameStart, gpuMs );
+    }
+
+    renderer.Finish();
+  }
+
+  void StartCaptureIfDue()
   {
-    VkCommandPoolCreateInfo commandPoolInfo{};
-    commandPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    // These flags allow us to specify how we're going to use the
-    // command buffers
-    // Since we're going to be re-recording them each frame, we specify
-    // the CREATE_RESET bit, as to make Vulkan optimize for frequent records
-    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    commandPoolInfo.queueFamilyIndex = context.familyIndices.graphics.value();
-
-    VK_ASSERT( vkCreateCommandPool( context.device, &commandPoolInfo, nullptr,
-                                    &commandPool ) );
+    // Frames are counted from the first one after startup
+    if ( captureCount == 0 || frameCount != captureFirst ) return;
+
+    if ( renderer.StartCapture( capturePath,
+                                static_cast<uint32_t>( captureCount ) ) ) {
+      fprintf( stderr, "[CAPTURE] Writing %llu frames to %s\n", captureCount,
+               capturePath );
+    }
+    else {
+      fprintf( stderr, "[CAPTURE] Could not write %s\n", capturePath );
+    }
   }
 
-  void AllocateCommandBuffers()
+  void RecordFrameStats( uint64_t frameStart, float gpuMs )
   {
-    VkCommandBufferAllocateInfo commandBufferInfo{};
-    commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    // A Command Buffer's level can be:
-    // - PRIMARY: It's passed directly to the command queue
-    // - SECONDARY: Can only be called from primary command
-    commandBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferInfo.commandPool = commandPool;
-
-    commandBuffers.resize( 2 );
-    // Here we specify the ammount of command buffers we will
-    // allocate VkAllocateCommandBuffers
-    commandBufferInfo.commandBufferCount = commandBuffers.size();
-    VK_ASSERT( 
-      vkAllocateCommandBuffers( 
-        context.device, 
-        &commandBufferInfo,
-        &commandBuffers[currentFrame] 
-      ) 
-    );
+    const FrameTimings& timings = renderer.GetFrameTimings();
+
+    FrameStats::Sample sample{};
+    sample.frame = frameCount++;
+    sample.ms[FrameStats::CPU_FRAME] = ( Profiler::Now() - frameStart ) / 1e6f;
+    sample.ms[FrameStats::FENCE_WAIT] = timings.fenceWaitMs;
+    sample.ms[FrameStats::ACQUIRE] = timings.acquireMs;
+    sample.ms[FrameStats::PRESENT] = timings.presentMs;
+    // Belongs to the frame that just got off the GPU, not this one,
+    // but a slow GPU shows up in it all the same
+    sample.gpuMs = gpuMs;
+    sample.renderScale = renderer.context.resolution.GetScale();
+
+    frameStats.Record( sample );
   }
 
-  void RecordCommand( VkCommandBuffer& command, uint32_t imageIndex )
+  static FILE* OpenFrameStatsLog()
   {
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    // /* Optional */ beginInfo.flags            = 0; // Specify usage, won't
-    // matter for us right now
-    // /* Optional */ beginInfo.pInheritanceInfo = nullptr; // Specify primary
-    // buffer to inherit (only for secondary buffers)
-
-    VK_ASSERT( vkBeginCommandBuffer( command, &beginInfo ) );
-
-    VkRenderPassBeginInfo passBeginInfo{};
-    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    // Render area
-    passBeginInfo.renderArea.extent = context.swapchain.extent;
-    passBeginInfo.renderArea.offset = { 0, 0 };
-    //
-    passBeginInfo.renderPass = context.pipeline.renderPass;
-    passBeginInfo.framebuffer = context.swapchain.frameBuffers[imageIndex];
-
-    VkClearValue clearColor{ { { 0.2f, 0.2f, 0.2f, 1.0f } } };
-
-    passBeginInfo.clearValueCount = 1;
-    passBeginInfo.pClearValues = &clearColor;
-
-    // The last parameter has to do with wheter we're gonna use secondary
-    // command buffers or not.
-    // If yes, we should use VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
-    // If not, we should use VK_SUBPASS_CONTENTS_INLINE
-    vkCmdBeginRenderPass( command, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
-
-    // All drawing commands begin with vkCmd*** and all return void
-    vkCmdBindPipeline( command, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                       context.pipeline.pipeline );
-
-    // VkViewport viewports[] = { GetViewport() };
-    // VkRect2D scissors[] = { GetScissor() };
-
-    VkViewport viewport = context.GetViewport();
-    vkCmdSetViewport( command, 0, 1, &viewport );
-
-    VkRect2D scissor = context.GetScissor();
-    vkCmdSetScissor( command, 0, 1, &scissor );
-
-    /* The param names are really self-explanatory
-        commandBuffer: the comand buffer
-        vertexCount: number of vertices (baked into shader, for now)
-        instanceCount: number of instances
-        firstVertex: starting vertex (defines lowest value of gl_VertexIndex)
-        firstInstance: starting instance (defines lowest value of
-       gl_InstanceIndex) */
-    vkCmdDraw( command, 3, 1, 0, 0 );
-
-    vkCmdEndRenderPass( command );
-
-    VK_ASSERT( vkEndCommandBuffer( command ) );
+    const char* path = getenv( "FRAME_STATS_LOG" );
+    if ( path == nullptr ) return stdout;
+
+    FILE* file = fopen( path, "a" );
+    if ( file == nullptr ) {
+      fprintf( stderr, "[FRAMES] Could not open %s\n", path );
+      return stdout;
+    }
+
+    return file;
   }
 
-  void CreateSyncObjects()
+  static FrameStats::Settings GetFrameStatsSettings()
   {
-    VkSemaphoreCreateInfo semaphoreInfo{};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    // We add this flag so that the fence will start as signaled
-    // This is to prevent and infinite wait time in our loop, since
-    // we wait for this fence to signal in order to proceed
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
-    imageAvailableSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
-    renderFinishedSemaphores.resize( MAX_FRAMES_IN_FLIGHT );
-    inFlightFences.resize( MAX_FRAMES_IN_FLIGHT );
-
-    for ( int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++ ) {
-      VK_ASSERT( vkCreateSemaphore( context.device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i] ) );
-      VK_ASSERT( vkCreateSemaphore( context.device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i] ) );
-      VK_ASSERT( vkCreateFence    ( context.device, &fenceInfo, nullptr, &inFlightFences[i] ) );
+    FrameStats::Settings settings;
+
+    if ( const char* multiple = getenv( "HITCH_MULTIPLE" ) ) {
+      float value = static_cast<float>( atof( multiple ) );
+      if ( value > 1.0f ) settings.hitchMultiple = value;
     }
+
+    return settings;
+  }
+
+  static GLFWwindow* OpenWindow( const char* title, int width, int height )
+  {
+    STARTUP_PHASE( "OpenWindow" );
+    return glfwCreateWindow( width, height, title, nullptr, nullptr );
+  }
+
+  // Debug builds print the breakdown, STARTUP_TRACE=<file.json>
+  // writes it out in any build
+  static void ReportStartup()
+  {
+#ifndef NDEBUG
+    Startup::Print();
+#endif
+
+    if ( const char* path = getenv( "STARTUP_TRACE" ) ) {
+      if ( !Startup::Write( path ) ) {
+        fprintf( stderr, "[STARTUP] Could not write %s\n", path );
+      }
+    }
+  }
+
+  void CreateScene()
+  {
+    // Just our triangle for now, bounded by a sphere around
+    // its clip space vertices
+    CullObject triangle{};
+    triangle.center[0] = 0.0f;
+    triangle.center[1] = 0.0f;
+    triangle.center[2] = 0.0f;
+    triangle.radius = 0.75f;
+    triangle.vertexCount = 3;
+    triangle.firstVertex = 0;
+
+    renderer.SetScene( { triangle } );
   }
 };
 
 int main()
 {
-  glfwInit();
-  glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
-  glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
+  Profiler::SetThreadName( "main" );
+
+  // One worker per core, this thread included. JOB_WORKERS=<n>
+  // overrides it
+  Jobs::Start( 0 );
+
+  // CPU_TRACE="<first frame>,<frame count>,<output.json>" writes those
+  // frames as a Chrome trace, open it in chrome://tracing or Perfetto
+  if ( const char* trace = getenv( "CPU_TRACE" ) ) {
+    unsigned long long first = 0, count = 0;
+    char path[256] = {};
+
+    if ( sscanf( trace, "%llu,%llu,%255s", &first, &count, path ) == 3 ) {
+      Profiler::RequestCapture( first, count, path );
+    }
+    else {
+      fprintf( stderr, "[PROFILER] Invalid CPU_TRACE \"%s\"\n", trace );
+    }
+  }
+
+  {
+    STARTUP_PHASE( "glfwInit" );
+    glfwInit();
+    glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
+    glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
+  }
 
   VulkanApp app( "Oi", 500, 500 );
 
   app.Run();
 
+  Jobs::Stop();
+
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,388 @@
+#include "api/vkloader.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+#include "api/vkrenderer.hpp"
+#include "api/vkutils.hpp"
+#include "api/components/vkculling.hpp"
+#include "utils/jobs.hpp"
+#include "utils/startup.hpp"
+
+using std::string;
+using std::vector;
+
+/*
+  Headless benchmark.
+
+  Renders every scene offscreen (no window, no swapchain) for a fixed
+  number of frames and prints the results as JSON, so it runs on CI
+  machines without a GPU through lavapipe:
+
+    VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json \
+      ./Benchmark --frames 500 --output results.json
+
+  Each scene gets a fresh Renderer, so startup time covers everything
+  from instance creation to the first frame being ready to record.
+*/
+
+struct Options {
+  uint32_t frames = 500;
+  // Not measured, gives the culling visibility and the
+  // driver's caches time to settle
+  uint32_t warmup = 30;
+  VkExtent2D extent = { 1280, 720 };
+  bool dynamicResolution = false;
+  bool pipelineStatistics = false;
+  vector<string> scenes;
+  const char* output = nullptr;
+};
+
+struct Scene {
+  const char* name;
+  vector<CullObject> objects;
+};
+
+struct Stats {
+  double mean = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+static CullObject MakeObject( float x, float y, float z, float radius )
+{
+  CullObject object{};
+  object.center[0] = x;
+  object.center[1] = y;
+  object.center[2] = z;
+  object.radius = radius;
+  // Every object is still the hardcoded triangle
+  object.vertexCount = 3;
+  object.firstVertex = 0;
+  return object;
+}
+
+static vector<Scene> CreateScenes()
+{
+  vector<Scene> scenes;
+
+  // What the app renders
+  scenes.push_back( { "triangle", { MakeObject( 0.0f, 0.0f, 0.0f, 0.75f ) } } );
+
+  { // Lots of visible draws, overdraw heavy
+    Scene crowd{ "crowd", {} };
+    for ( int y = 0; y < 16; y++ ) {
+      for ( int x = 0; x < 16; x++ ) {
+        crowd.objects.push_back( MakeObject(
+          -0.9f + x * 0.12f, -0.9f + y * 0.12f, 0.0f, 0.75f ) );
+      }
+    }
+    scenes.push_back( crowd );
+  }
+
+  { // One occluder and everything else hidden behind it,
+    // so nearly all the work is culling
+    Scene occluded{ "occluded", { MakeObject( 0.0f, 0.0f, 0.0f, 0.75f ) } };
+    for ( uint32_t i = 1; i < OcclusionCuller::MAX_OBJECTS; i++ ) {
+      float x = -0.1f + 0.2f * ( i % 64 ) / 63.0f;
+      float y = 0.1f + 0.3f * ( i / 64 ) / 63.0f;
+      occluded.objects.push_back( MakeObject( x, y, 0.5f, 0.01f ) );
+    }
+    scenes.push_back( occluded );
+  }
+
+  return scenes;
+}
+
+static Stats ComputeStats( vector<double> samples )
+{
+  Stats stats;
+  if ( samples.empty() ) return stats;
+
+  std::sort( samples.begin(), samples.end() );
+
+  double sum = 0.0;
+  for ( double sample : samples ) sum += sample;
+
+  // Nearest rank
+  auto percentile = [&samples]( double p ) {
+    size_t rank = static_cast<size_t>( p * ( samples.size() - 1 ) + 0.5 );
+    return samples[rank];
+  };
+
+  stats.mean = sum / samples.size();
+  stats.p50 = percentile( 0.50 );
+  stats.p95 = percentile( 0.95 );
+  stats.p99 = percentile( 0.99 );
+  stats.max = samples.back();
+  return stats;
+}
+
+// Peak resident memory of the whole process so far
+static double PeakMemoryMB()
+{
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) );
+  return counters.PeakWorkingSetSize / ( 1024.0 * 1024.0 );
+#else
+  rusage usage{};
+  getrusage( RUSAGE_SELF, &usage );
+  // Kilobytes on Linux
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+static double MsSince( std::chrono::steady_clock::time_point start )
+{
+  std::chrono::duration<double, std::milli> elapsed
+      = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static string StatsJson( const Stats& stats )
+{
+  char buffer[256];
+  snprintf( buffer, sizeof( buffer ),
+            "{\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+            stats.mean, stats.p50, stats.p95, stats.p99, stats.max );
+  return buffer;
+}
+
+// Average per frame of every pass, so overdraw shows up as
+// fragment invocations going up between runs
+static string PipelineStatisticsJson( PipelineStatistics& statistics )
+{
+  string json = "{";
+
+  for ( auto& pass : statistics.GetPasses() ) {
+    if ( pass.frames == 0 ) continue;
+
+    const auto& total = pass.total;
+    double frames = static_cast<double>( pass.frames );
+
+    char buffer[512];
+    snprintf( buffer, sizeof( buffer ),
+              "%s\"%s\":{\"inputVertices\":%.1f,\"inputPrimitives\":%.1f,"
+              "\"vertexInvocations\":%.1f,\"clippingPrimitives\":%.1f,"
+              "\"fragmentInvocations\":%.1f,\"computeInvocations\":%.1f}",
+              json.size() > 1 ? "," : "", pass.name,
+              total.inputVertices / frames, total.inputPrimitives / frames,
+              total.vertexInvocations / frames,
+              total.clippingPrimitives / frames,
+              total.fragmentInvocations / frames,
+              total.computeInvocations / frames );
+    json += buffer;
+  }
+
+  return json + "}";
+}
+
+static string RunScene( const Scene& scene, const Options& options )
+{
+  using Clock = std::chrono::steady_clock;
+
+  Startup::Reset();
+  auto startupBegin = Clock::now();
+
+  Renderer renderer( options.extent );
+
+  DynamicResolution::Settings resolutionSettings;
+  resolutionSettings.enabled = options.dynamicResolution;
+  renderer.context.resolution.SetSettings( resolutionSettings );
+
+  renderer.SetScene( scene.objects );
+
+  auto& pipelineStats = renderer.GetPipelineStatistics();
+  pipelineStats.SetEnabled( options.pipelineStatistics
+                            && pipelineStats.IsSupported() );
+
+  double startupMs = MsSince( startupBegin );
+  Startup::End();
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties( renderer.context.physicalDevice, &properties );
+
+  fprintf( stderr, "[BENCH] %s: %zu objects, %u frames on %s\n", scene.name,
+           scene.objects.size(), options.frames, properties.deviceName );
+
+  for ( uint32_t i = 0; i < options.warmup; i++ ) {
+    renderer.Render();
+  }
+  // Warmup frames still in flight must not count
+  renderer.Finish();
+  pipelineStats.ResetTotals();
+
+  vector<double> cpuTimes, gpuTimes;
+  cpuTimes.reserve( options.frames );
+  gpuTimes.reserve( options.frames );
+
+  for ( uint32_t i = 0; i < options.frames; i++ ) {
+    auto frameBegin = Clock::now();
+    // The GPU time that comes back belongs to an earlier frame,
+    // Finish picks up the ones left at the end
+    float gpuMs = renderer.Render();
+    cpuTimes.push_back( MsSince( frameBegin ) );
+
+    if ( gpuMs >= 0.0f ) gpuTimes.push_back( gpuMs );
+  }
+
+  for ( float gpuMs : renderer.Finish() ) {
+    gpuTimes.push_back( gpuMs );
+  }
+
+  string json = "{\"name\":\"" + string( scene.name ) + "\"";
+  json += ",\"device\":\"" + string( properties.deviceName ) + "\"";
+  json += ",\"objects\":" + std::to_string( scene.objects.size() );
+  json += ",\"startupMs\":" + std::to_string( startupMs );
+  json += ",\"startupPhases\":" + Startup::ToJson();
+  json += ",\"cpuFrameMs\":" + StatsJson( ComputeStats( cpuTimes ) );
+  // Null rather than zeros when the queue can't do timestamps
+  json += ",\"gpuFrameMs\":";
+  json += renderer.GetGpuProfiler().IsSupported()
+              ? StatsJson( ComputeStats( gpuTimes ) )
+              : "null";
+  json += ",\"gpuSamples\":" + std::to_string( gpuTimes.size() );
+  if ( pipelineStats.IsEnabled() ) {
+    json += ",\"pipelineStatistics\":" + PipelineStatisticsJson( pipelineStats );
+  }
+  json += ",\"peakMemoryMB\":" + std::to_string( PeakMemoryMB() );
+  json += "}";
+
+  return json;
+}
+
+static void PrintUsage()
+{
+  fprintf( stderr,
+           "Usage: Benchmark [options]\n"
+           "  --frames <n>          measured frames per scene (500)\n"
+           "  --warmup <n>          frames rendered before measuring (30)\n"
+           "  --size <w>x<h>        offscreen target size (1280x720)\n"
+           "  --scene <name>        only run this scene, can be repeated\n"
+           "  --dynamic-resolution  let the render scale follow GPU time\n"
+           "  --pipeline-stats      add per pass vertex/fragment/compute counts\n"
+           "  --device <selector>   GPU index, UUID or part of its name\n"
+           "  --output <file>       write the JSON there instead of stdout\n" );
+}
+
+static bool ParseOptions( int argc, char** argv, Options& options )
+{
+  for ( int i = 1; i < argc; i++ ) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if ( strcmp( arg, "--dynamic-resolution" ) == 0 ) {
+      options.dynamicResolution = true;
+      continue;
+    }
+    if ( strcmp( arg, "--pipeline-stats" ) == 0 ) {
+      options.pipelineStatistics = true;
+      continue;
+    }
+
+    if ( value == nullptr ) return false;
+    i++;
+
+    if ( strcmp( arg, "--frames" ) == 0 ) {
+      options.frames = static_cast<uint32_t>( strtoul( value, nullptr, 10 ) );
+    }
+    else if ( strcmp( arg, "--warmup" ) == 0 ) {
+      options.warmup = static_cast<uint32_t>( strtoul( value, nullptr, 10 ) );
+    }
+    else if ( strcmp( arg, "--size" ) == 0 ) {
+      if ( sscanf( value, "%ux%u", &options.extent.width,
+                   &options.extent.height ) != 2 ) {
+        return false;
+      }
+    }
+    else if ( strcmp( arg, "--scene" ) == 0 ) {
+      options.scenes.push_back( value );
+    }
+    else if ( strcmp( arg, "--device" ) == 0 ) {
+      // Same as VULKAN_DEVICE, but wins over it
+      VkUtils::SetDeviceSelector( value );
+    }
+    else if ( strcmp( arg, "--output" ) == 0 ) {
+      options.output = value;
+    }
+    else {
+      return false;
+    }
+  }
+
+  return options.frames > 0 && options.extent.width > 0
+         && options.extent.height > 0;
+}
+
+int main( int argc, char** argv )
+{
+  Options options;
+
+  if ( !ParseOptions( argc, argv, options ) ) {
+    PrintUsage();
+    return 1;
+  }
+
+#ifndef NDEBUG
+  fprintf( stderr, "[BENCH] Debug build, timings include validation\n" );
+#endif
+
+  // As the app does, startup compiles pipelines and decodes shaders
+  // on the job workers
+  Jobs::Start( 0 );
+
+  vector<string> results;
+
+  for ( auto& scene : CreateScenes() ) {
+    bool selected = options.scenes.empty()
+                    || std::find( options.scenes.begin(), options.scenes.end(),
+                                  scene.name ) != options.scenes.end();
+
+    if ( selected ) results.push_back( RunScene( scene, options ) );
+  }
+
+  Jobs::Stop();
+
+  if ( results.empty() ) {
+    fprintf( stderr, "[BENCH] No scene matched\n" );
+    return 1;
+  }
+
+  string json = "{\"frames\":" + std::to_string( options.frames );
+  json += ",\"warmup\":" + std::to_string( options.warmup );
+  json += ",\"width\":" + std::to_string( options.extent.width );
+  json += ",\"height\":" + std::to_string( options.extent.height );
+  json += ",\"dynamicResolution\":";
+  json += options.dynamicResolution ? "true" : "false";
+  json += ",\"scenes\":[";
+  for ( size_t i = 0; i < results.size(); i++ ) {
+    json += ( i > 0 ? ",\n" : "\n" ) + results[i];
+  }
+  json += "\n]}\n";
+
+  FILE* out = options.output ? fopen( options.output, "w" ) : stdout;
+  if ( out == nullptr ) {
+    fprintf( stderr, "[BENCH] Could not write %s\n", options.output );
+    return 1;
+  }
+
+  fputs( json.c_str(), out );
+  if ( out != stdout ) fclose( out );
+
+  return 0;
+}
@@ -0,0 +1,517 @@
+#include "api/vkloader.hpp"
+#include "GLFW/glfw3.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "api/vkrenderer.hpp"
+#include "api/vkutils.hpp"
+#include "api/components/vkculling.hpp"
+#include "api/components/vkshader.hpp"
+#include "utils/assetio.hpp"
+#include "utils/bench.hpp"
+#include "utils/debug.hpp"
+#include "utils/file.hpp"
+#include "utils/framestats.hpp"
+#include "utils/jobs.hpp"
+#include "utils/math.hpp"
+#include "utils/startup.hpp"
+#include "utils/tasks.hpp"
+#include "utils/transforms.hpp"
+
+using std::vector;
+
+/*
+  CPU side microbenchmarks of the engine's hot paths.
+
+    ./Microbench                      every case
+    ./Microbench --filter Record      only cases with "Record" in the name
+    ./Microbench --scale 0.1          a tenth of the iterations, smoke test
+
+  Prints ns/op and allocations/op per case. Iteration counts are fixed,
+  so two runs of the same build on the same machine are comparable:
+  changes to anything measured here should come with before and after
+  numbers.
+
+  A hidden window is opened when there's a display, so the surface
+  queries can be measured too. Without one, everything else still
+  runs headless.
+*/
+
+// Every allocation in the process goes through here, the Engine's too
+void* operator new( size_t size )
+{
+  Bench::CountAllocation( size );
+  if ( void* memory = malloc( size > 0 ? size : 1 ) ) return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete( void* memory ) noexcept
+{
+  free( memory );
+}
+
+void operator delete( void* memory, size_t ) noexcept
+{
+  free( memory );
+}
+
+// The array forms go through the ones above by default
+
+static CullObject MakeObject( uint32_t i )
+{
+  CullObject object{};
+  object.center[0] = -0.9f + 1.8f * ( i % 64 ) / 63.0f;
+  object.center[1] = -0.9f + 1.8f * ( i / 64 ) / 63.0f;
+  object.center[2] = 0.5f;
+  object.radius = 0.01f;
+  object.vertexCount = 3;
+  object.firstVertex = 0;
+  return object;
+}
+
+static void FileCases( VkDevice device )
+{
+  const char* path = RESOURCES "shaders/basic.vert.spv";
+
+  Bench::Run( "FileUtils::ReadBinary basic.vert", 2000, [&]() {
+    Bench::DoNotOptimize( FileUtils::ReadBinary( path ) );
+  } );
+
+  Bench::Run( "ShaderModule create+destroy basic.vert", 500, [&]() {
+    ShaderModule module( path, device );
+    module.Destroy( device );
+  } );
+
+  Bench::Run( "ShaderModule::Load+destroy basic.vert (coroutine)", 500, [&]() {
+    ShaderModule module = Tasks::SyncWait( ShaderModule::Load( path, device ) );
+    module.Destroy( device );
+  } );
+
+  // The four shaders the context loads: one after the other, then
+  // all requested at once and waited for
+  const char* shaders[] = {
+      RESOURCES "shaders/basic.vert.spv",
+      RESOURCES "shaders/basic.frag.spv",
+      RESOURCES "shaders/cull.comp.spv",
+      RESOURCES "shaders/hiz.comp.spv",
+  };
+
+  Bench::Run( "FileUtils::ReadBinary 4 shaders", 1000, [&]() {
+    for ( const char* shader : shaders ) Bench::DoNotOptimize( FileUtils::ReadBinary( shader ) );
+  } );
+
+  AssetIO::Service& service = AssetIO::GetService();
+  auto decode = []( const char* data, size_t size ) {
+    Bench::DoNotOptimize( data );
+    Bench::DoNotOptimize( size );
+  };
+  vector<AssetIO::Request> requests;
+  for ( const char* shader : shaders ) requests.push_back( { shader, decode, nullptr } );
+
+  Bench::Run( service.UsesUring() ? "AssetIO::Load 4 shaders (io_uring)"
+                                  : "AssetIO::Load 4 shaders (pread)",
+              1000, [&]() {
+                Jobs::Counter loaded;
+                for ( auto& request : requests ) request.counter = &loaded;
+                service.Load( requests );
+                Jobs::Wait( loaded );
+              } );
+}
+
+static void DeviceQueryCases( VulkanContext& context )
+{
+  // Both answer from the capability cache after the first call,
+  // that lookup is what's measured
+  Bench::Run( "VkUtils::FindQueueFamilies", 1000000, [&]() {
+    Bench::DoNotOptimize(
+      VkUtils::FindQueueFamilies( context.physicalDevice, context.surface ) );
+  } );
+
+  if ( context.surface == VK_NULL_HANDLE ) {
+    fprintf( stderr, "[MICRO] No surface, skipping FindSwapchainSupport\n" );
+    return;
+  }
+
+  Bench::Run( "VkUtils::FindSwapchainSupport", 200000, [&]() {
+    Bench::DoNotOptimize(
+      VkUtils::FindSwapchainSupport( context.physicalDevice, context.surface ) );
+  } );
+}
+
+static void DispatchCases( VulkanContext& context )
+{
+  // What every vkCmd* went through when we linked against the
+  // loader: asking the instance gives its trampoline, where our
+  // vkCmdSetScissor comes straight from the driver
+  auto trampoline = reinterpret_cast<PFN_vkCmdSetScissor>(
+    vkGetInstanceProcAddr( context.instance, "vkCmdSetScissor" ) );
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = context.familyIndices.graphics.value();
+
+  VkCommandPool pool;
+  VK_ASSERT( vkCreateCommandPool( context.device, &poolInfo, nullptr, &pool ) );
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = pool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+
+  VkCommandBuffer command;
+  VK_ASSERT( vkAllocateCommandBuffers( context.device, &allocInfo, &command ) );
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkRect2D scissor = context.GetScissor();
+
+  // A command that's cheap for the driver, so the call itself is
+  // most of what's measured
+  auto record = [&]( PFN_vkCmdSetScissor setScissor ) {
+    vkBeginCommandBuffer( command, &beginInfo );
+    for ( uint32_t i = 0; i < 1000; i++ ) {
+      setScissor( command, 0, 1, &scissor );
+    }
+    vkEndCommandBuffer( command );
+    vkResetCommandBuffer( command, 0 );
+  };
+
+  Bench::Run( "vkCmdSetScissor x1000 loader trampoline", 20000, [&]() {
+    record( trampoline );
+  } );
+  Bench::Run( "vkCmdSetScissor x1000 device dispatch", 20000, [&]() {
+    record( vkCmdSetScissor );
+  } );
+
+  vkDestroyCommandPool( context.device, pool, nullptr );
+}
+
+static void QueueCases( VulkanContext& context )
+{
+  // Batches with nothing in them, so it's the call and the wait for
+  // a queue that's measured. Every worker submits at once: behind
+  // one lock they queue up, QueueSet deals them out to the graphics
+  // queues it was given
+  const uint32_t count = 64;
+  SharedQueue& first = context.queues.Get( QueueRole::GRAPHICS );
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+  VkSubmitInfo2 submitInfo2{};
+  submitInfo2.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2;
+
+  Bench::Run( "vkQueueSubmit x64 parallel, one queue", 2000, [&]() {
+    Jobs::ParallelFor( count, 1, [&]( uint32_t begin, uint32_t end ) {
+      for ( uint32_t i = begin; i < end; i++ ) {
+        std::lock_guard<std::mutex> guard( first.lock );
+        VK_ASSERT( vkQueueSubmit( first.handle, 1, &submitInfo, VK_NULL_HANDLE ) );
+      }
+    } );
+  } );
+  vkDeviceWaitIdle( context.device );
+
+  char name[64];
+  snprintf( name, sizeof( name ), "QueueSet::Submit x64 parallel, %u queues",
+            context.queues.Count( QueueRole::GRAPHICS ) );
+  Bench::Run( name, 2000, [&]() {
+    Jobs::ParallelFor( count, 1, [&]( uint32_t begin, uint32_t end ) {
+      for ( uint32_t i = begin; i < end; i++ ) {
+        VK_ASSERT( context.queues.Submit( QueueRole::GRAPHICS, 1, &submitInfo,
+                                          VK_NULL_HANDLE ) );
+      }
+    } );
+  } );
+  vkDeviceWaitIdle( context.device );
+
+  if ( !context.sync2.IsEnabled() ) {
+    fprintf( stderr, "[MICRO] No synchronization2, skipping VkSubmitInfo2\n" );
+    return;
+  }
+
+  Bench::Run( "QueueSet::Submit VkSubmitInfo2 x64 parallel", 2000, [&]() {
+    Jobs::ParallelFor( count, 1, [&]( uint32_t begin, uint32_t end ) {
+      for ( uint32_t i = begin; i < end; i++ ) {
+        VK_ASSERT( context.queues.Submit( QueueRole::GRAPHICS, 1, &submitInfo2,
+                                          VK_NULL_HANDLE, context.sync2 ) );
+      }
+    } );
+  } );
+  vkDeviceWaitIdle( context.device );
+}
+
+static void RecordingCases( Renderer& renderer )
+{
+  renderer.SetScene( { MakeObject( 0 ) } );
+  Bench::Run( "Renderer::RecordFrame 1 object", 20000, [&]() {
+    renderer.RecordFrame();
+  } );
+
+  // Draws are indirect, so this should cost the same as one object
+  vector<CullObject> objects;
+  for ( uint32_t i = 0; i < OcclusionCuller::MAX_OBJECTS; i++ ) {
+    objects.push_back( MakeObject( i ) );
+  }
+  renderer.SetScene( objects );
+  Bench::Run( "Renderer::RecordFrame 4096 objects", 20000, [&]() {
+    renderer.RecordFrame();
+  } );
+}
+
+static void CullingCases( Renderer& renderer )
+{
+  vector<CullObject> objects;
+  for ( uint32_t i = 0; i < OcclusionCuller::MAX_OBJECTS; i++ ) {
+    objects.push_back( MakeObject( i ) );
+  }
+
+  // Nothing was submitted, so the objects buffer is free to write
+  Bench::Run( "OcclusionCuller::SetObjects 4096", 20000, [&]() {
+    renderer.context.culler.SetObjects( objects );
+  } );
+}
+
+static void FrameStatsCases()
+{
+  FrameStats::Histogram histogram;
+  uint64_t value = 16667;
+
+  Bench::Run( "FrameStats::Histogram::Record", 10000000, [&]() {
+    // Something that isn't always the same bucket
+    value = value * 1103515245 + 12345;
+    histogram.Record( 8000 + ( value >> 16 ) % 16000 );
+  } );
+  Bench::DoNotOptimize( histogram.Count() );
+}
+
+static void JobCases()
+{
+  // Submission, scheduling and completion of a job that does nothing
+  Bench::Run( "Jobs::Run+Wait empty", 200000, [&]() {
+    Jobs::Counter counter;
+    Jobs::Run( []() {}, &counter );
+    Jobs::Wait( counter );
+  } );
+
+  vector<float> values( 1 << 20 );
+  for ( size_t i = 0; i < values.size(); i++ ) values[i] = static_cast<float>( i % 97 );
+  const uint32_t count = static_cast<uint32_t>( values.size() );
+
+  auto sum = [&]( uint32_t begin, uint32_t end ) {
+    float total = 0.0f;
+    for ( uint32_t i = begin; i < end; i++ ) total += values[i] * values[i];
+    Bench::DoNotOptimize( total );
+  };
+
+  Bench::Run( "Sum of squares 1M serial", 500, [&]() { sum( 0, count ); } );
+  Bench::Run( "Sum of squares 1M Jobs::ParallelFor", 500, [&]() {
+    Jobs::ParallelFor( count, 0, sum );
+  } );
+}
+
+static Tasks::Task<int> Leaf( int value )
+{
+  co_return value;
+}
+
+static Tasks::Task<int> Hop( int value )
+{
+  co_await Tasks::Schedule();
+  co_return value;
+}
+
+static void TaskCases()
+{
+  // Frame allocation and symmetric transfer, no thread involved
+  Bench::Run( "Tasks::SyncWait task awaiting a task", 200000, [&]() {
+    Bench::DoNotOptimize( Tasks::SyncWait( []() -> Tasks::Task<int> {
+      co_return co_await Leaf( 1 );
+    }() ) );
+  } );
+
+  // One trip through the job system's shared queue and back
+  Bench::Run( "Tasks::SyncWait Schedule()", 200000, [&]() {
+    Bench::DoNotOptimize( Tasks::SyncWait( Hop( 1 ) ) );
+  } );
+}
+
+static void MathCases()
+{
+  using namespace MathUtils;
+
+  const size_t count = 4096;
+  std::vector<vec3> points( count ), transformed( count );
+  std::vector<mat4> worlds( count ), results( count );
+  for ( size_t i = 0; i < count; i++ ) {
+    float f = static_cast<float>( i );
+    points[i] = vec3( f, f * 0.5f, -f );
+    worlds[i] = Compose( points[i], Normalize( quat( 0.1f, f, 0.3f, 1.0f ) ), vec3( 1.5f ) );
+  }
+  const mat4 viewProjection = Perspective( 1.0f, 16.0f / 9.0f, 0.1f, 100.0f ) *
+                              LookAt( vec3( 0.0f, 2.0f, 5.0f ), vec3( 0.0f ), vec3( 0.0f, 1.0f, 0.0f ) );
+
+  // Each SIMD case against the scalar code it replaces
+  Bench::Run( "MathUtils::TransformPoints 4096 scalar", 5000, [&]() {
+    Scalar::TransformPoints( viewProjection, points.data(), transformed.data(), count );
+    Bench::DoNotOptimize( transformed.data() );
+  } );
+  Bench::Run( "MathUtils::TransformPoints 4096 simd", 5000, [&]() {
+    TransformPoints( viewProjection, points.data(), transformed.data(), count );
+    Bench::DoNotOptimize( transformed.data() );
+  } );
+
+  Bench::Run( "MathUtils::MultiplyMatrices 4096 scalar", 2000, [&]() {
+    Scalar::MultiplyMatrices( worlds.data(), worlds.data(), results.data(), count );
+    Bench::DoNotOptimize( results.data() );
+  } );
+  Bench::Run( "MathUtils::MultiplyMatrices 4096 simd", 2000, [&]() {
+    MultiplyMatrices( worlds.data(), worlds.data(), results.data(), count );
+    Bench::DoNotOptimize( results.data() );
+  } );
+
+  Bench::Run( "MathUtils::MultiplyMatrices viewProjection x4096 scalar", 2000, [&]() {
+    Scalar::MultiplyMatrices( viewProjection, worlds.data(), results.data(), count );
+    Bench::DoNotOptimize( results.data() );
+  } );
+  Bench::Run( "MathUtils::MultiplyMatrices viewProjection x4096 simd", 2000, [&]() {
+    MultiplyMatrices( viewProjection, worlds.data(), results.data(), count );
+    Bench::DoNotOptimize( results.data() );
+  } );
+}
+
+static void TransformCases()
+{
+  using namespace MathUtils;
+
+  // 256 roots with 8 children with 8 children each, 18688 objects
+  TransformHierarchy transforms;
+  std::vector<uint32_t> leaves;
+  for ( uint32_t root = 0; root < 256; root++ ) {
+    uint32_t rootId = transforms.Add( Translation( vec3( static_cast<float>( root ), 0.0f, 0.0f ) ) );
+    for ( uint32_t child = 0; child < 8; child++ ) {
+      uint32_t childId = transforms.Add( Compose( vec3( 0.0f, 1.0f, 0.0f ), quat(), vec3( 0.5f ) ), rootId );
+      for ( uint32_t leaf = 0; leaf < 8; leaf++ ) {
+        leaves.push_back( transforms.Add( Translation( vec3( 0.0f, 0.0f, 1.0f ) ), childId ) );
+      }
+    }
+  }
+  transforms.Update();
+
+  Bench::Run( "TransformHierarchy::Update 18688 static", 1000000, [&]() {
+    transforms.Update();
+    Bench::DoNotOptimize( transforms.Changed().size() );
+  } );
+
+  // What a mostly static scene does every frame...
+  const mat4 moved = Translation( vec3( 0.0f, 0.0f, 2.0f ) );
+  Bench::Run( "TransformHierarchy::Update 18688 with 1% moved", 2000, [&]() {
+    for ( size_t i = 0; i < leaves.size(); i += 100 ) transforms.SetLocal( leaves[i], moved );
+    transforms.Update();
+    Bench::DoNotOptimize( transforms.Changed().size() );
+  } );
+
+  // ...and what recomputing everything would cost
+  Bench::Run( "TransformHierarchy::Update 18688 all dirty", 2000, [&]() {
+    transforms.MarkAllDirty();
+    transforms.Update();
+    Bench::DoNotOptimize( transforms.Changed().size() );
+  } );
+}
+
+static void PrintUsage()
+{
+  fprintf( stderr,
+           "Usage: Microbench [options]\n"
+           "  --filter <text>   only run cases whose name contains it\n"
+           "  --scale <x>       multiply every iteration count (1.0)\n"
+           "  --repeats <n>     runs per case, the best is reported (5)\n" );
+}
+
+static bool ParseOptions( int argc, char** argv, Bench::Settings& settings )
+{
+  for ( int i = 1; i < argc; i++ ) {
+    const char* arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if ( value == nullptr ) return false;
+    i++;
+
+    if ( strcmp( arg, "--filter" ) == 0 ) {
+      settings.filter = value;
+    }
+    else if ( strcmp( arg, "--scale" ) == 0 ) {
+      settings.scale = strtod( value, nullptr );
+    }
+    else if ( strcmp( arg, "--repeats" ) == 0 ) {
+      settings.repeats = static_cast<uint32_t>( strtoul( value, nullptr, 10 ) );
+    }
+    else {
+      return false;
+    }
+  }
+
+  return settings.scale > 0.0;
+}
+
+int main( int argc, char** argv )
+{
+  if ( !ParseOptions( argc, argv, Bench::GetSettings() ) ) {
+    PrintUsage();
+    return 1;
+  }
+
+#ifndef NDEBUG
+  fprintf( stderr, "[MICRO] Debug build, numbers include validation\n" );
+#endif
+
+  // Device selection chatter would end up inside the measurements
+  VkUtils::SetVerbose( false );
+
+  GLFWwindow* window = nullptr;
+  if ( glfwInit() == GLFW_TRUE ) {
+    glfwWindowHint( GLFW_CLIENT_API, GLFW_NO_API );
+    glfwWindowHint( GLFW_RESIZABLE, GLFW_FALSE );
+    glfwWindowHint( GLFW_VISIBLE, GLFW_FALSE );
+    window = glfwCreateWindow( 1280, 720, "Microbench", nullptr, nullptr );
+  }
+
+  Jobs::Start( 0 );
+  fprintf( stderr, "[MICRO] %u job workers\n", Jobs::WorkerCount() );
+
+  std::unique_ptr<Renderer> renderer( window
+                                        ? new Renderer( window )
+                                        : new Renderer( VkExtent2D{ 1280, 720 } ) );
+  // Startup is over, shaders the cases load aren't part of it
+  Startup::End();
+
+  Bench::PrintHeader();
+
+  FrameStatsCases();
+  JobCases();
+  TaskCases();
+  MathCases();
+  TransformCases();
+  FileCases( renderer->context.device );
+  DeviceQueryCases( renderer->context );
+  DispatchCases( renderer->context );
+  QueueCases( renderer->context );
+  RecordingCases( *renderer );
+  CullingCases( *renderer );
+
+  renderer.reset();
+  Jobs::Stop();
+
+  if ( window ) glfwDestroyWindow( window );
+  glfwTerminate();
+
+  return 0;
+}
@@ -0,0 +1,221 @@
+#include "api/vkloader.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "api/vkcapture.hpp"
+#include "api/vkrenderer.hpp"
+#include "api/vkutils.hpp"
+#include "utils/framestats.hpp"
+#include "utils/jobs.hpp"
+
+using std::string;
+
+/*
+  Replays a capture (CAPTURE=... on the app, see README) offscreen,
+  with nothing throttling it: no window, no vsync, no input.
+
+    ./Replay field.lvkc --loops 10 --output replay.json
+
+  Every frame is drawn at the scale it was captured at, so the
+  command buffers match what was recorded in the field and timings
+  only depend on the machine running the replay.
+*/
+
+struct Options {
+  const char* capture = nullptr;
+  // Times the whole capture is played, more gives steadier numbers
+  uint32_t loops = 1;
+  const char* output = nullptr;
+};
+
+static string HistogramJson( const FrameStats::Histogram& histogram )
+{
+  if ( histogram.Count() == 0 ) return "null";
+
+  char buffer[256];
+  snprintf( buffer, sizeof( buffer ),
+            "{\"mean\":%.4f,\"p50\":%.4f,\"p95\":%.4f,\"p99\":%.4f,\"max\":%.4f}",
+            histogram.MeanMs(), histogram.PercentileMs( 0.50f ),
+            histogram.PercentileMs( 0.95f ), histogram.PercentileMs( 0.99f ),
+            histogram.MaxMs() );
+  return buffer;
+}
+
+static void RecordMs( FrameStats::Histogram& histogram, double ms )
+{
+  histogram.Record( static_cast<uint64_t>( ms * 1000.0 ) );
+}
+
+static string Replay( const Options& options )
+{
+  using Clock = std::chrono::steady_clock;
+
+  CaptureReader reader( options.capture );
+  const CaptureHeader& header = reader.GetHeader();
+
+  Renderer renderer( VkExtent2D{ header.width, header.height } );
+
+  // Scales come from the capture, never from our own GPU times
+  DynamicResolution::Settings resolutionSettings;
+  resolutionSettings.enabled = false;
+  resolutionSettings.minScale = 1.0f / 64.0f;
+  resolutionSettings.maxScale = 1.0f;
+  renderer.context.resolution.SetSettings( resolutionSettings );
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties( renderer.context.physicalDevice, &properties );
+
+  fprintf( stderr, "[REPLAY] %s: %u frames at %ux%u captured on %s, "
+                   "replaying on %s\n",
+           options.capture, header.frameCount, header.width, header.height,
+           header.deviceName, properties.deviceName );
+
+  FrameStats::Histogram cpu, gpu, field;
+  uint64_t frames = 0;
+  bool firstScene = true;
+
+  auto begin = Clock::now();
+
+  for ( uint32_t loop = 0; loop < options.loops; loop++ ) {
+    reader.Rewind();
+
+    CaptureReader::Command command;
+    while ( reader.Next( command ) ) {
+      if ( command.type == CAPTURE_SCENE ) {
+        // Objects can't change under a frame in flight
+        if ( !firstScene ) {
+          for ( float gpuMs : renderer.Finish() ) RecordMs( gpu, gpuMs );
+        }
+        renderer.SetScene( command.objects );
+        firstScene = false;
+        continue;
+      }
+
+      renderer.context.resolution.SetScale( command.renderScale );
+
+      auto frameBegin = Clock::now();
+      float gpuMs = renderer.Render();
+      std::chrono::duration<double, std::milli> elapsed
+          = Clock::now() - frameBegin;
+
+      RecordMs( cpu, elapsed.count() );
+      if ( gpuMs >= 0.0f ) RecordMs( gpu, gpuMs );
+      if ( loop == 0 && command.gpuMs >= 0.0f ) RecordMs( field, command.gpuMs );
+      frames++;
+    }
+  }
+
+  for ( float gpuMs : renderer.Finish() ) RecordMs( gpu, gpuMs );
+
+  std::chrono::duration<double, std::milli> total = Clock::now() - begin;
+
+  fprintf( stderr, "[REPLAY] %llu frames in %.1fms, cpu p50 %.3fms, "
+                   "gpu p50 %.3fms (captured %.3fms)\n",
+           static_cast<unsigned long long>( frames ), total.count(),
+           cpu.PercentileMs( 0.5f ), gpu.PercentileMs( 0.5f ),
+           field.PercentileMs( 0.5f ) );
+
+  string json = "{\"capture\":\"" + string( options.capture ) + "\"";
+  json += ",\"capturedOn\":\"" + string( header.deviceName ) + "\"";
+  json += ",\"device\":\"" + string( properties.deviceName ) + "\"";
+  json += ",\"width\":" + std::to_string( header.width );
+  json += ",\"height\":" + std::to_string( header.height );
+  json += ",\"loops\":" + std::to_string( options.loops );
+  json += ",\"frames\":" + std::to_string( frames );
+  json += ",\"totalMs\":" + std::to_string( total.count() );
+  json += ",\"cpuFrameMs\":" + HistogramJson( cpu );
+  // Null when the queue can't do timestamps
+  json += ",\"gpuFrameMs\":";
+  json += renderer.GetGpuProfiler().IsSupported() ? HistogramJson( gpu ) : "null";
+  json += ",\"capturedGpuFrameMs\":" + HistogramJson( field );
+  json += "}\n";
+
+  return json;
+}
+
+static void PrintUsage()
+{
+  fprintf( stderr,
+           "Usage: Replay <capture> [options]\n"
+           "  --loops <n>       times the capture is played (1)\n"
+           "  --device <text>   GPU index, UUID or part of its name\n"
+           "  --output <file>   write the JSON there instead of stdout\n" );
+}
+
+static bool ParseOptions( int argc, char** argv, Options& options )
+{
+  for ( int i = 1; i < argc; i++ ) {
+    const char* arg = argv[i];
+
+    if ( arg[0] != '-' ) {
+      if ( options.capture != nullptr ) return false;
+      options.capture = arg;
+      continue;
+    }
+
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if ( value == nullptr ) return false;
+    i++;
+
+    if ( strcmp( arg, "--loops" ) == 0 ) {
+      options.loops = static_cast<uint32_t>( strtoul( value, nullptr, 10 ) );
+    }
+    else if ( strcmp( arg, "--device" ) == 0 ) {
+      // Same as VULKAN_DEVICE, but wins over it
+      VkUtils::SetDeviceSelector( value );
+    }
+    else if ( strcmp( arg, "--output" ) == 0 ) {
+      options.output = value;
+    }
+    else {
+      return false;
+    }
+  }
+
+  return options.capture != nullptr && options.loops > 0;
+}
+
+int main( int argc, char** argv )
+{
+  Options options;
+
+  if ( !ParseOptions( argc, argv, options ) ) {
+    PrintUsage();
+    return 1;
+  }
+
+#ifndef NDEBUG
+  fprintf( stderr, "[REPLAY] Debug build, timings include validation\n" );
+#endif
+
+  // Same job workers as the app
+  Jobs::Start( 0 );
+
+  string json;
+  try {
+    json = Replay( options );
+  }
+  catch ( const std::runtime_error& error ) {
+    Jobs::Stop();
+    fprintf( stderr, "[REPLAY] %s\n", error.what() );
+    return 1;
+  }
+
+  Jobs::Stop();
+
+  FILE* out = options.output ? fopen( options.output, "w" ) : stdout;
+  if ( out == nullptr ) {
+    fprintf( stderr, "[REPLAY] Could not write %s\n", options.output );
+    return 1;
+  }
+
+  fputs( json.c_str(), out );
+  if ( out != stdout ) fclose( out );
+
+  return 0;
+}
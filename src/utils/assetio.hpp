@@ -0,0 +1,554 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#include "jobs.hpp"
+#include "profiler.hpp"
+
+/*
+  Asynchronous file loading, off the calling thread.
+
+    std::vector<AssetIO::Request> requests;
+    requests.push_back({ path, [](const char* data, size_t size) {
+      // A job: parse, convert, create the GPU object...
+    }, &loaded });
+    AssetIO::GetService().Load(requests);
+    ...
+    Jobs::Wait(loaded);
+
+  Reads go through io_uring: a single I/O thread keeps up to
+  `queueDepth` of them in flight with one syscall per batch, which
+  is what it takes to keep an NVMe drive busy. Where io_uring isn't
+  available (old kernels, containers that block it), ASSET_IO=pread
+  is set or it fails later on, a few threads do blocking pread()s
+  instead.
+
+  Files are read into staging slots allocated once up front, bigger
+  ones get their own allocation. Each finished read becomes a job
+  (see jobs.hpp) running the request's `decode`, with data == nullptr
+  if the file couldn't be read. The slot is reused once it returns,
+  so keep a copy of anything needed later.
+*/
+namespace AssetIO {
+  struct Request {
+    std::string path;
+    std::function<void(const char* data, size_t size)> decode;
+    // Optional, one per request, back down once its decode ran
+    Jobs::Counter* counter;
+  };
+
+#ifdef __linux__
+  // The few io_uring bits we need, straight on the syscalls (no liburing)
+  class Uring {
+  private:
+    int fd = -1;
+
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+
+    unsigned* sqHead = nullptr;
+    unsigned* sqTail = nullptr;
+    unsigned* sqMask = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqEntries = 0;
+    // Prepared but not submitted yet
+    unsigned localTail = 0;
+    unsigned toSubmit = 0;
+
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned* cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+
+  public:
+    Uring() = default;
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    ~Uring() { Close(); }
+
+    // The kernel cancels whatever it hadn't started yet
+    void Close() {
+      if(sqes != MAP_FAILED) munmap(sqes, sqesSize);
+      if(cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqRingSize);
+      if(sqRing != MAP_FAILED) munmap(sqRing, sqRingSize);
+      if(fd >= 0) close(fd);
+
+      sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+      sqRing = cqRing = MAP_FAILED;
+      fd = -1;
+    }
+
+    bool Init(unsigned entries) {
+      io_uring_params params{};
+      fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+      if(fd < 0) return false;
+
+      sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+      // 5.4+ maps both rings at once
+      bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+      if(singleMap) sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+      sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+      if(sqRing == MAP_FAILED) return false;
+
+      cqRing = singleMap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+      if(cqRing == MAP_FAILED) return false;
+
+      sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+      sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+      if(sqes == MAP_FAILED) return false;
+
+      char* sq = static_cast<char*>(sqRing);
+      sqHead  = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+      sqTail  = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      sqMask  = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      sqEntries = params.sq_entries;
+      localTail = *sqTail;
+
+      char* cq = static_cast<char*>(cqRing);
+      cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      cqMask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      cqes   = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+      return true;
+    }
+
+    // Null when the submission queue is full
+    io_uring_sqe* Next() {
+      unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+      if(localTail - head >= sqEntries) return nullptr;
+
+      unsigned index = localTail & *sqMask;
+      sqArray[index] = index;
+      localTail++;
+      toSubmit++;
+
+      io_uring_sqe* sqe = &sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      return sqe;
+    }
+
+    // Submits what was prepared, and waits for `waitFor` completions
+    int Submit(unsigned waitFor) {
+      __atomic_store_n(sqTail, localTail, __ATOMIC_RELEASE);
+
+      int result = static_cast<int>(syscall(
+        __NR_io_uring_enter, fd, toSubmit, waitFor,
+        waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0
+      ));
+      if(result >= 0) toSubmit -= std::min(toSubmit, static_cast<unsigned>(result));
+      return result;
+    }
+
+    bool Complete(io_uring_cqe& out) {
+      unsigned head = *cqHead;
+      if(head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) return false;
+
+      out = cqes[head & *cqMask];
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+  };
+
+#endif
+
+  class Service {
+  public:
+    struct Settings {
+      // Staging memory is slots * slotSize, files up to slotSize use it
+      uint32_t slots = 16;
+      size_t slotSize = 4 << 20;
+      // Reads in flight with io_uring
+      uint32_t queueDepth = 64;
+      // Threads for the pread() fallback
+      uint32_t fallbackThreads = 4;
+      bool forceFallback = false;
+    };
+
+  private:
+    struct Pending {
+      Request request;
+      Service* owner;
+
+      int fd = -1;
+      size_t size = 0;
+      size_t done = 0;
+      char* data = nullptr;
+      // -1 when not in a staging slot
+      int slot = -1;
+      std::unique_ptr<char[]> ownMemory;
+      bool failed = false;
+
+      iovec vector{};
+    };
+
+    Settings settings;
+    std::unique_ptr<char[]> staging;
+    std::vector<uint32_t> freeSlots;
+
+    std::mutex lock;
+    // New requests and freed slots
+    std::condition_variable changed;
+    std::deque<Pending*> queue;
+    bool stopping = false;
+
+#ifdef __linux__
+    Uring uring;
+#endif
+    // Goes false if io_uring fails on us, see FallBack
+    std::atomic<bool> useUring{ false };
+    std::vector<std::thread> threads;
+
+  public:
+    Service(Settings settings) : settings(settings) {
+      staging.reset(new char[settings.slots * settings.slotSize]);
+      for(uint32_t i = 0; i < settings.slots; i++) freeSlots.push_back(i);
+
+      const char* mode = getenv("ASSET_IO");
+      bool forcePread = settings.forceFallback || (mode != nullptr && strcmp(mode, "pread") == 0);
+
+#ifdef __linux__
+      useUring = !forcePread && uring.Init(settings.queueDepth);
+      if(useUring) threads.emplace_back(&Service::UringLoop, this);
+#else
+      (void)forcePread;
+#endif
+
+      if(!useUring) {
+        for(uint32_t i = 0; i < std::max(1u, settings.fallbackThreads); i++) {
+          threads.emplace_back(&Service::PreadLoop, this);
+        }
+      }
+    }
+
+    Service(const Service&) = delete;
+    Service& operator=(const Service&) = delete;
+
+    // Whatever was queued is still read and decoded first
+    ~Service() {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+      }
+      changed.notify_all();
+
+      // The io_uring thread may add pread ones until it sees `stopping`
+      for(size_t i = 0;; i++) {
+        std::thread thread;
+        {
+          std::lock_guard<std::mutex> guard(lock);
+          if(i == threads.size()) break;
+          thread = std::move(threads[i]);
+        }
+        thread.join();
+      }
+    }
+
+    bool UsesUring() { return useUring; }
+
+    void Load(const std::vector<Request>& requests) {
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        for(const Request& request : requests) {
+          if(request.counter != nullptr) {
+            request.counter->pending.fetch_add(1, std::memory_order_relaxed);
+          }
+
+          Pending* pending = new Pending();
+          pending->request = request;
+          pending->owner = this;
+          queue.push_back(pending);
+        }
+      }
+      changed.notify_all();
+    }
+
+  private:
+    // Outside the lock, open() can wait on the disk as well
+    void Open(Pending* pending) {
+      if(pending->fd >= 0 || pending->failed) return;
+
+      pending->fd = open(pending->request.path.c_str(), O_RDONLY | O_CLOEXEC);
+
+      struct stat info;
+      if(pending->fd < 0 || fstat(pending->fd, &info) != 0) {
+        pending->failed = true;
+      }
+      else {
+        pending->size = static_cast<size_t>(info.st_size);
+      }
+    }
+
+    // Finds an opened file somewhere to go, under the lock. False if
+    // it can't start yet, for lack of a staging slot
+    bool Place(Pending* pending) {
+      if(pending->failed || pending->data != nullptr) return true;
+
+      if(pending->size > settings.slotSize) {
+        pending->ownMemory.reset(new char[std::max<size_t>(pending->size, 1)]);
+        pending->data = pending->ownMemory.get();
+        return true;
+      }
+
+      if(freeSlots.empty()) return false;
+
+      pending->slot = static_cast<int>(freeSlots.back());
+      freeSlots.pop_back();
+      pending->data = staging.get() + pending->slot * settings.slotSize;
+      return true;
+    }
+
+    // The read is over, one way or another, on to decoding
+    void Finish(Pending* pending) {
+      if(pending->fd >= 0) close(pending->fd);
+      pending->fd = -1;
+
+      Jobs::Run([pending]() { pending->owner->Decode(pending); });
+    }
+
+    void Decode(Pending* pending) {
+      {
+        PROFILE_ZONE("AssetIO::Decode");
+        if(pending->request.decode) {
+          bool ok = !pending->failed && pending->done == pending->size;
+          pending->request.decode(ok ? pending->data : nullptr, ok ? pending->size : 0);
+        }
+      }
+
+      Jobs::Counter* counter = pending->request.counter;
+
+      if(pending->slot >= 0) {
+        std::lock_guard<std::mutex> guard(lock);
+        freeSlots.push_back(static_cast<uint32_t>(pending->slot));
+      }
+      changed.notify_all();
+
+      delete pending;
+      if(counter != nullptr) Jobs::Finish(*counter);
+    }
+
+#ifdef __linux__
+    void UringLoop() {
+      Profiler::SetThreadName("asset io");
+
+      // Submitted, not completed yet
+      std::vector<Pending*> reading;
+      // Off the queue and opened, waiting on a staging slot
+      std::deque<Pending*> opened;
+
+      while(true) {
+        std::vector<Pending*> taken;
+        std::vector<Pending*> ready;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+
+          // Nothing to wait for from the ring, so wait for work
+          if(reading.empty()) {
+            changed.wait(guard, [&]() {
+              return !queue.empty() || (!opened.empty() && !freeSlots.empty()) || (stopping && opened.empty());
+            });
+            if(stopping && queue.empty() && opened.empty()) return;
+          }
+
+          while(!opened.empty() && Place(opened.front())) {
+            ready.push_back(opened.front());
+            opened.pop_front();
+          }
+
+          // Never more than fits in the ring
+          while(!queue.empty() && reading.size() + ready.size() + opened.size() + taken.size() < settings.queueDepth) {
+            taken.push_back(queue.front());
+            queue.pop_front();
+          }
+        }
+
+        if(!taken.empty()) {
+          for(Pending* pending : taken) Open(pending);
+
+          std::lock_guard<std::mutex> guard(lock);
+          for(Pending* pending : taken) {
+            // In order, nothing jumps ahead of one waiting on a slot
+            if(opened.empty() && Place(pending)) ready.push_back(pending);
+            else opened.push_back(pending);
+          }
+        }
+
+        for(Pending* pending : ready) {
+          if(pending->failed || pending->size == 0) {
+            Finish(pending);
+          }
+          else if(Queue(pending)) {
+            reading.push_back(pending);
+          }
+          else {
+            // Can't happen, there's never more than queueDepth of them
+            pending->failed = true;
+            Finish(pending);
+          }
+        }
+        if(reading.empty()) continue;
+
+        {
+          PROFILE_ZONE("AssetIO::Submit");
+          if(uring.Submit(1) < 0 && errno != EINTR && errno != EBUSY) {
+            FallBack(reading, opened);
+            return;
+          }
+        }
+
+        io_uring_cqe completion;
+        while(uring.Complete(completion)) {
+          Pending* pending = reinterpret_cast<Pending*>(completion.user_data);
+
+          if(completion.res <= 0) {
+            pending->failed = completion.res < 0 || pending->done < pending->size;
+          }
+          else {
+            pending->done += static_cast<size_t>(completion.res);
+          }
+
+          // Short read, ask for the rest
+          if(!pending->failed && pending->done < pending->size) {
+            if(Queue(pending)) continue;
+            pending->failed = true;
+          }
+
+          reading.erase(std::find(reading.begin(), reading.end(), pending));
+          Finish(pending);
+        }
+      }
+    }
+
+    // io_uring_enter failed for good. What the ring had is lost, the
+    // rest goes to pread() threads, this one included
+    void FallBack(std::vector<Pending*>& reading, std::deque<Pending*>& opened) {
+      fprintf(stderr, "[ASSETS] io_uring_enter failed (%s), falling back to pread\n", strerror(errno));
+
+      // Before their memory goes back to other reads
+      uring.Close();
+      for(Pending* pending : reading) {
+        pending->failed = true;
+        Finish(pending);
+      }
+
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.insert(queue.begin(), opened.begin(), opened.end());
+        useUring = false;
+
+        if(!stopping) {
+          for(uint32_t i = 1; i < std::max(1u, settings.fallbackThreads); i++) {
+            threads.emplace_back(&Service::PreadLoop, this);
+          }
+        }
+      }
+      changed.notify_all();
+
+      PreadLoop();
+    }
+
+    bool Queue(Pending* pending) {
+      io_uring_sqe* sqe = uring.Next();
+      if(sqe == nullptr) return false;
+
+      pending->vector.iov_base = pending->data + pending->done;
+      pending->vector.iov_len = pending->size - pending->done;
+
+      // READV rather than READ, it goes back to the very first
+      // io_uring kernels
+      sqe->opcode = IORING_OP_READV;
+      sqe->fd = pending->fd;
+      sqe->addr = reinterpret_cast<uint64_t>(&pending->vector);
+      sqe->len = 1;
+      sqe->off = pending->done;
+      sqe->user_data = reinterpret_cast<uint64_t>(pending);
+      return true;
+    }
+
+#endif
+
+    void PreadLoop() {
+      Profiler::SetThreadName("asset io");
+
+      while(true) {
+        Pending* pending = nullptr;
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          changed.wait(guard, [&]() { return !queue.empty() || stopping; });
+          if(queue.empty()) return;
+
+          pending = queue.front();
+          queue.pop_front();
+        }
+
+        Open(pending);
+        {
+          std::unique_lock<std::mutex> guard(lock);
+          while(!Place(pending)) changed.wait(guard);
+        }
+
+        {
+          PROFILE_ZONE("AssetIO::pread");
+          while(!pending->failed && pending->done < pending->size) {
+            ssize_t result = pread(
+              pending->fd,
+              pending->data + pending->done,
+              pending->size - pending->done,
+              static_cast<off_t>(pending->done)
+            );
+
+            if(result < 0 && errno == EINTR) continue;
+            if(result <= 0) pending->failed = true;
+            else pending->done += static_cast<size_t>(result);
+          }
+        }
+
+        Finish(pending);
+      }
+    }
+  };
+
+  // Shared by the whole engine, started on first use
+  inline Service& GetService() {
+    static Service service{ Service::Settings() };
+    return service;
+  }
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "profiler.hpp"
+
+/*
+  Fixed iteration microbenchmarks, for the CPU side of the engine.
+
+    Bench::Run("FindQueueFamilies", 100000, [&]() {
+      Bench::DoNotOptimize(VkUtils::FindQueueFamilies(device, surface));
+    });
+
+  Every case runs the same number of iterations on every machine, a few
+  times over, and reports the best run's ns/op (the least disturbed by
+  the OS) next to how many allocations each op made.
+
+  Allocations are only counted if the executable replaces the global
+  operator new and calls `CountAllocation` from it, the way
+  tools/microbench.cpp does. Otherwise they just read as zero.
+*/
+namespace Bench {
+  struct Counters {
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+  };
+
+  inline Counters& GetCounters() {
+    static Counters counters;
+    return counters;
+  }
+
+  inline void CountAllocation(size_t size) {
+    Counters& counters = GetCounters();
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+
+  // Keeps the compiler from throwing away a result nobody reads
+  template<typename T>
+  inline void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+  }
+
+  struct Result {
+    const char* name;
+    uint64_t iterations;
+    double nsPerOp;
+    double allocationsPerOp;
+    double bytesPerOp;
+  };
+
+  struct Settings {
+    // Runs per case, the fastest one is reported
+    uint32_t repeats = 5;
+    // Multiplies every case's iteration count, for quick smoke runs
+    double scale = 1.0;
+    // Only cases whose name contains this run, null runs everything
+    const char* filter = nullptr;
+  };
+
+  inline Settings& GetSettings() {
+    static Settings settings;
+    return settings;
+  }
+
+  inline void PrintHeader(FILE* out = stdout) {
+    fprintf(out, "[MICRO] %-44s %10s %12s %10s %10s\n",
+      "case", "iterations", "ns/op", "allocs/op", "B/op");
+  }
+
+  inline void Print(const Result& result, FILE* out = stdout) {
+    fprintf(out, "[MICRO] %-44s %10llu %12.1f %10.2f %10.1f\n",
+      result.name,
+      static_cast<unsigned long long>(result.iterations),
+      result.nsPerOp, result.allocationsPerOp, result.bytesPerOp);
+    fflush(out);
+  }
+
+  // Returns false (and prints nothing) when filtered out
+  template<typename F>
+  bool Run(const char* name, uint64_t iterations, F&& op, Result* out = nullptr) {
+    const Settings& settings = GetSettings();
+    if(settings.filter != nullptr && strstr(name, settings.filter) == nullptr) {
+      return false;
+    }
+
+    iterations = static_cast<uint64_t>(iterations * settings.scale);
+    if(iterations == 0) iterations = 1;
+
+    // Fills caches and lets lazy initialization happen before anything
+    // is measured
+    uint64_t warmup = iterations / 10 > 0 ? iterations / 10 : 1;
+    for(uint64_t i = 0; i < warmup; i++) op();
+
+    Counters& counters = GetCounters();
+    uint64_t allocations = counters.allocations.load(std::memory_order_relaxed);
+    uint64_t bytes = counters.bytes.load(std::memory_order_relaxed);
+
+    uint64_t best = UINT64_MAX;
+    uint32_t repeats = settings.repeats > 0 ? settings.repeats : 1;
+
+    for(uint32_t r = 0; r < repeats; r++) {
+      uint64_t start = Profiler::Now();
+      for(uint64_t i = 0; i < iterations; i++) op();
+      uint64_t elapsed = Profiler::Now() - start;
+
+      if(elapsed < best) best = elapsed;
+    }
+
+    double ops = static_cast<double>(iterations) * repeats;
+
+    Result result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = static_cast<double>(best) / iterations;
+    result.allocationsPerOp =
+      (counters.allocations.load(std::memory_order_relaxed) - allocations) / ops;
+    result.bytesPerOp =
+      (counters.bytes.load(std::memory_order_relaxed) - bytes) / ops;
+
+    Print(result);
+    if(out != nullptr) *out = result;
+    return true;
+  }
+}
@@ -6,7 +6,7 @@
 #include <fstream>
 
 namespace FileUtils {
-  std::vector<char> ReadBinary(const char* path) {
+  inline std::vector<char> ReadBinary(const char* path) {
     using namespace std;
     // ios::ate -> start At The End (so we can get the size later)
     ifstream file(path, ios::ate | ios::binary);
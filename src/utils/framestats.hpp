@@ -0,0 +1,251 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/*
+  Always-on frame time statistics, cheap enough to leave running in
+  release builds.
+
+  Every frame, the app hands a Sample (CPU frame time and how much of it
+  went to the fence wait, acquire and present) to a Monitor, which
+  keeps it in log-linear histograms and:
+  - flags a hitch when the frame took more than `hitchMultiple` times
+    the median, logging what that frame's time was spent on
+  - writes a percentile summary every `summaryInterval` seconds
+*/
+namespace FrameStats {
+  /*
+    HDR style histogram of microsecond values: exact below 64us, then
+    32 buckets per power of two, so any percentile is within ~3% of the
+    real value. Fixed size, recording is a few shifts and an increment.
+  */
+  class Histogram {
+  public:
+    static const uint32_t SUB_BITS = 5;
+    static const uint32_t SUB_COUNT = 1 << SUB_BITS;
+    // Anything above 2^36us (~19 hours) lands in the last bucket
+    static const uint32_t MAX_BITS = 36;
+    static const uint32_t BUCKET_COUNT = SUB_COUNT * (MAX_BITS - SUB_BITS + 1);
+
+  private:
+    uint32_t counts[BUCKET_COUNT];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    static uint32_t BucketOf(uint64_t value) {
+      if(value < 2 * SUB_COUNT) return static_cast<uint32_t>(value);
+
+      uint32_t msb = 0;
+      for(uint64_t v = value; v > 1; v >>= 1) msb++;
+
+      if(msb >= MAX_BITS) return BUCKET_COUNT - 1;
+
+      uint32_t shift = msb - SUB_BITS;
+      return SUB_COUNT * shift + static_cast<uint32_t>(value >> shift);
+    }
+
+    // Middle of the values the bucket holds
+    static uint64_t ValueOf(uint32_t bucket) {
+      if(bucket < 2 * SUB_COUNT) return bucket;
+
+      uint32_t shift = bucket / SUB_COUNT - 1;
+      uint64_t lower = static_cast<uint64_t>(bucket % SUB_COUNT + SUB_COUNT) << shift;
+      return lower + (1ull << shift) / 2;
+    }
+
+  public:
+    Histogram() { Reset(); }
+
+    void Reset() {
+      for(auto& bucketCount : counts) bucketCount = 0;
+      count = 0;
+      sum = 0;
+      max = 0;
+    }
+
+    void Record(uint64_t us) {
+      counts[BucketOf(us)]++;
+      count++;
+      sum += us;
+      if(us > max) max = us;
+    }
+
+    uint64_t Count() const { return count; }
+
+    float MeanMs() const {
+      return count == 0 ? 0.0f : sum / (count * 1000.0f);
+    }
+
+    float MaxMs() const { return max / 1000.0f; }
+
+    // `p` in [0, 1]
+    float PercentileMs(float p) const {
+      if(count == 0) return 0.0f;
+
+      uint64_t rank = static_cast<uint64_t>(p * (count - 1)) + 1;
+      uint64_t seen = 0;
+
+      for(uint32_t i = 0; i < BUCKET_COUNT; i++) {
+        seen += counts[i];
+        if(seen >= rank) {
+          // The top bucket is wide, the real max is better
+          uint64_t value = ValueOf(i);
+          return (value < max ? value : max) / 1000.0f;
+        }
+      }
+
+      return MaxMs();
+    }
+  };
+
+  enum Metric {
+    CPU_FRAME = 0,
+    FENCE_WAIT,
+    ACQUIRE,
+    PRESENT,
+    METRIC_COUNT
+  };
+
+  inline const char* MetricName(Metric metric) {
+    const char* names[METRIC_COUNT] = { "cpu", "fence", "acquire", "present" };
+    return names[metric];
+  }
+
+  struct Sample {
+    uint64_t frame;
+    // Indexed by Metric
+    float ms[METRIC_COUNT];
+    // Context for hitch reports, negative when unknown
+    float gpuMs;
+    float renderScale;
+  };
+
+  struct Settings {
+    // A frame this many times slower than the median is a hitch
+    float hitchMultiple = 2.0f;
+    // Seconds between summaries, 0 disables them
+    float summaryInterval = 30.0f;
+    // Hitches logged per summary interval, the rest are only counted
+    uint32_t maxHitchReports = 8;
+    // Frames needed before the median is trusted
+    uint32_t warmupFrames = 60;
+  };
+
+  class Monitor {
+  private:
+    Settings settings;
+    FILE* log;
+
+    // Since the last summary
+    Histogram histograms[METRIC_COUNT];
+    // Whole run, only the CPU frame time
+    Histogram lifetime;
+
+    // Median of the last full interval, what hitches are measured against
+    float referenceMs;
+    uint32_t hitches;
+    uint64_t totalHitches;
+
+    std::chrono::steady_clock::time_point lastSummary;
+
+  public:
+    Monitor(Settings settings = Settings(), FILE* log = stdout)
+      : settings(settings),
+        log(log),
+        referenceMs(0.0f),
+        hitches(0),
+        totalHitches(0),
+        lastSummary(std::chrono::steady_clock::now()) {}
+
+    void Record(const Sample& sample) {
+      for(int i = 0; i < METRIC_COUNT; i++) {
+        float ms = sample.ms[i] > 0.0f ? sample.ms[i] : 0.0f;
+        histograms[i].Record(static_cast<uint64_t>(ms * 1000.0f));
+      }
+      lifetime.Record(static_cast<uint64_t>(sample.ms[CPU_FRAME] * 1000.0f));
+
+      // Until the first summary, go by everything so far
+      if(referenceMs == 0.0f && lifetime.Count() >= settings.warmupFrames) {
+        referenceMs = lifetime.PercentileMs(0.5f);
+      }
+
+      if(referenceMs > 0.0f
+        && sample.ms[CPU_FRAME] > referenceMs * settings.hitchMultiple) {
+        ReportHitch(sample);
+      }
+
+      if(settings.summaryInterval <= 0.0f) return;
+
+      auto now = std::chrono::steady_clock::now();
+      std::chrono::duration<float> elapsed = now - lastSummary;
+
+      if(elapsed.count() >= settings.summaryInterval) {
+        Summary(elapsed.count());
+        lastSummary = now;
+      }
+    }
+
+    const Histogram& Get(Metric metric) const { return histograms[metric]; }
+    const Histogram& GetLifetime() const { return lifetime; }
+    uint64_t GetHitchCount() const { return totalHitches; }
+
+    // Writes the interval's percentiles and starts a new interval
+    void Summary(float seconds) {
+      const Histogram& cpu = histograms[CPU_FRAME];
+      if(cpu.Count() == 0) return;
+
+      fprintf(log, "[FRAMES] %llu frames in %.1fs, %u hitches",
+        static_cast<unsigned long long>(cpu.Count()), seconds, hitches);
+
+      for(int i = 0; i < METRIC_COUNT; i++) {
+        const Histogram& h = histograms[i];
+        fprintf(log, " | %s p50 %.2f p95 %.2f p99 %.2f max %.2f",
+          MetricName(static_cast<Metric>(i)),
+          h.PercentileMs(0.5f), h.PercentileMs(0.95f),
+          h.PercentileMs(0.99f), h.MaxMs());
+      }
+      fprintf(log, "\n");
+      fflush(log);
+
+      if(cpu.Count() >= settings.warmupFrames) {
+        referenceMs = cpu.PercentileMs(0.5f);
+      }
+
+      for(auto& h : histograms) h.Reset();
+      hitches = 0;
+    }
+
+  private:
+    void ReportHitch(const Sample& sample) {
+      hitches++;
+      totalHitches++;
+
+      if(hitches > settings.maxHitchReports) return;
+
+      // Whatever the fence, acquire and present didn't take was
+      // spent on our side: recording, submitting, polling events
+      float other = sample.ms[CPU_FRAME] - sample.ms[FENCE_WAIT]
+        - sample.ms[ACQUIRE] - sample.ms[PRESENT];
+
+      fprintf(log,
+        "[HITCH] frame %llu: %.2fms (%.1fx median %.2fms)"
+        " | fence %.2f acquire %.2f present %.2f other %.2f",
+        static_cast<unsigned long long>(sample.frame),
+        sample.ms[CPU_FRAME], sample.ms[CPU_FRAME] / referenceMs, referenceMs,
+        sample.ms[FENCE_WAIT], sample.ms[ACQUIRE], sample.ms[PRESENT],
+        other > 0.0f ? other : 0.0f);
+
+      if(sample.gpuMs >= 0.0f) fprintf(log, " | gpu %.2fms", sample.gpuMs);
+      if(sample.renderScale > 0.0f) fprintf(log, " scale %.2f", sample.renderScale);
+
+      if(hitches == settings.maxHitchReports) {
+        fprintf(log, " (further hitches until the next summary are only counted)");
+      }
+      fprintf(log, "\n");
+      fflush(log);
+    }
+  };
+}
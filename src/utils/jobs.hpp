@@ -0,0 +1,509 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "debug.hpp"
+#include "profiler.hpp"
+
+/*
+  Work-stealing job system.
+
+    Jobs::Start(0);                 // one worker per core
+
+    Jobs::Counter decoded;
+    for(auto& asset : assets) {
+      Jobs::Run([&asset]() { asset.Decode(); }, &decoded);
+    }
+    // Starts once every decode is done
+    Jobs::Counter uploaded;
+    Jobs::RunAfter(decoded, [&]() { UploadAll(assets); }, &uploaded);
+
+    Jobs::ParallelFor(objectCount, 256, [&](uint32_t begin, uint32_t end) {
+      ...
+    });
+
+    Jobs::Wait(uploaded);           // runs jobs itself meanwhile
+
+  Every worker owns a Chase-Lev deque: it pushes and pops its end
+  without contention, idle workers steal from the other end. The
+  thread that called Start() is worker 0, threads outside the pool
+  hand their jobs over through a shared queue.
+
+  Counters are what dependencies are made of: a job adds one to its
+  counter when submitted and takes it back when done, jobs run after
+  a counter go out when it reaches zero. A counter must outlive its
+  jobs, and only be reused once it's back at zero.
+
+  Jobs are stored without allocating, in a per thread ring (up to
+  MAX_JOBS in flight per submitting thread) with room for a lambda
+  capturing a few pointers. When a thread has that many in flight,
+  what it submits next runs right there instead. Before Start() (or
+  after Stop()) jobs simply run where they're submitted.
+
+  Post() is for when that would be wrong, resuming a coroutine from
+  inside a callback for one: it always queues, and before Start() the
+  job waits for some thread's Wait() to run it.
+*/
+namespace Jobs {
+  // Chase-Lev deque, fixed capacity: the owner pushes and pops the
+  // bottom, thieves take from the top ("Correct and Efficient
+  // Work-Stealing for Weak Memory Models", Lê et al. 2013)
+  template<typename T, uint32_t CAPACITY>
+  class Deque {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "Capacity must be a power of 2");
+    static_assert(std::is_pointer<T>::value, "Holds pointers");
+
+  private:
+    std::atomic<int64_t> top{ 0 };
+    std::atomic<int64_t> bottom{ 0 };
+    std::atomic<T> items[CAPACITY];
+
+  public:
+    // Owner only. False when full
+    bool Push(T item) {
+      int64_t b = bottom.load(std::memory_order_relaxed);
+      int64_t t = top.load(std::memory_order_acquire);
+      if(b - t >= static_cast<int64_t>(CAPACITY)) return false;
+
+      items[b & (CAPACITY - 1)].store(item, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return true;
+    }
+
+    // Owner only, newest first. Null when empty
+    T Pop() {
+      int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+      bottom.store(b, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t t = top.load(std::memory_order_relaxed);
+
+      if(t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+      }
+
+      T item = items[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+      if(t == b) {
+        // Last one, a thief may be after it too
+        if(!top.compare_exchange_strong(t, t + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+          item = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+      }
+      return item;
+    }
+
+    // Any thread, oldest first. Null when empty or when losing a race
+    T Steal() {
+      int64_t t = top.load(std::memory_order_acquire);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      int64_t b = bottom.load(std::memory_order_acquire);
+
+      if(t >= b) return nullptr;
+
+      T item = items[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+      if(!top.compare_exchange_strong(t, t + 1,
+          std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+      }
+      return item;
+    }
+  };
+
+  struct Job;
+
+  struct Counter {
+    std::atomic<uint32_t> pending{ 0 };
+
+    // Jobs waiting for `pending` to reach zero
+    std::mutex lock;
+    std::vector<Job*> waiting;
+
+    bool Done() const { return pending.load(std::memory_order_acquire) == 0; }
+  };
+
+  struct Job {
+    static const size_t STORAGE = 64;
+
+    alignas(std::max_align_t) unsigned char storage[STORAGE];
+    // Calls, then destroys, whatever is in `storage`
+    void (*invoke)(void* storage);
+    Counter* counter;
+    // Cleared once it ran, the slot can then be reused
+    std::atomic<bool> inUse{ false };
+    // Not from a ring (Post() with a full one), deleted once it ran
+    bool heap = false;
+  };
+
+  const uint32_t MAX_JOBS = 4096;
+
+  struct Worker {
+    Deque<Job*, MAX_JOBS> deque;
+  };
+
+  struct State {
+    // [0] belongs to the thread that called Start()
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{ false };
+
+    // Jobs submitted from outside the pool
+    std::mutex injectedLock;
+    std::deque<Job*> injected;
+
+    // Submitted and not yet picked up, idle workers sleep while zero
+    std::atomic<int64_t> queued{ 0 };
+    std::atomic<uint32_t> sleeping{ 0 };
+    std::mutex sleepLock;
+    std::condition_variable wake;
+  };
+
+  inline State& GetState() {
+    static State state;
+    return state;
+  }
+
+  // Into State::workers, -1 outside the pool
+  inline int& WorkerIndex() {
+    thread_local int index = -1;
+    return index;
+  }
+
+  // Null when every slot is still in flight
+  inline Job* Allocate() {
+    struct Ring {
+      Job jobs[MAX_JOBS];
+      uint32_t next = 0;
+    };
+    // Never freed, jobs of a thread that exited may still be running
+    thread_local Ring* ring = new Ring();
+
+    // Jobs mostly finish in the order they were submitted, so the next
+    // slot is usually free. One that runs long, or waits on a counter,
+    // is stepped over rather than holding up the others
+    for(uint32_t i = 0; i < MAX_JOBS; i++) {
+      Job& job = ring->jobs[ring->next++ % MAX_JOBS];
+      if(job.inUse.load(std::memory_order_acquire)) continue;
+
+      job.inUse.store(true, std::memory_order_relaxed);
+      return &job;
+    }
+    return nullptr;
+  }
+
+  inline void Schedule(Job* job);
+
+  inline void Finish(Counter& counter) {
+    // Not the last one, nothing else to do
+    uint32_t pending = counter.pending.load(std::memory_order_relaxed);
+    while(pending > 1) {
+      if(counter.pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel)) return;
+    }
+
+    // The last one reaches zero under the lock, Wait() takes it after
+    // seeing zero, so the counter can't go away while we're still here
+    std::vector<Job*> ready;
+    {
+      std::lock_guard<std::mutex> lock(counter.lock);
+      counter.pending.fetch_sub(1, std::memory_order_acq_rel);
+      ready.swap(counter.waiting);
+    }
+    for(Job* job : ready) Schedule(job);
+  }
+
+  inline void Execute(Job* job) {
+    job->invoke(job->storage);
+
+    Counter* counter = job->counter;
+    if(job->heap) delete job;
+    else job->inUse.store(false, std::memory_order_release);
+
+    if(counter != nullptr) Finish(*counter);
+  }
+
+  // One more job queued, for an idle worker to pick up
+  inline void Wake(State& state) {
+    // Both sides of the sleep handshake are seq_cst: either we see
+    // the worker going to sleep, or it sees this job
+    state.queued.fetch_add(1);
+
+    if(state.sleeping.load() > 0) {
+      // Taking the lock means a worker about to sleep sees `queued`
+      std::lock_guard<std::mutex> lock(state.sleepLock);
+      state.wake.notify_one();
+    }
+  }
+
+  // Through the shared queue, whichever thread we're on
+  inline void Inject(Job* job) {
+    State& state = GetState();
+    {
+      std::lock_guard<std::mutex> lock(state.injectedLock);
+      state.injected.push_back(job);
+    }
+    Wake(state);
+  }
+
+  inline void Schedule(Job* job) {
+    State& state = GetState();
+
+    if(!state.running.load(std::memory_order_acquire)) {
+      Execute(job);
+      return;
+    }
+
+    int index = WorkerIndex();
+    if(index < 0) {
+      Inject(job);
+      return;
+    }
+
+    if(!state.workers[index]->deque.Push(job)) {
+      // Ours is full, run it now rather than wait for room
+      Execute(job);
+      return;
+    }
+
+    Wake(state);
+  }
+
+  // Runs one job if there's any: ours first, then submitted from
+  // outside, then stolen. False if there was nothing
+  inline bool RunOne() {
+    State& state = GetState();
+
+    // Not started, only Post() leaves anything to run
+    bool running = state.running.load(std::memory_order_acquire);
+    int index = running ? WorkerIndex() : -1;
+    uint32_t count = running ? static_cast<uint32_t>(state.workers.size()) : 0;
+    Job* job = nullptr;
+
+    if(index >= 0) job = state.workers[index]->deque.Pop();
+
+    if(job == nullptr) {
+      std::lock_guard<std::mutex> lock(state.injectedLock);
+      if(!state.injected.empty()) {
+        job = state.injected.front();
+        state.injected.pop_front();
+      }
+    }
+
+    // Starting from the next worker, so thieves spread out
+    uint32_t first = static_cast<uint32_t>(index + 1);
+    for(uint32_t i = 0; job == nullptr && i < count; i++) {
+      uint32_t victim = (first + i) % count;
+      if(static_cast<int>(victim) == index) continue;
+      job = state.workers[victim]->deque.Steal();
+    }
+
+    if(job == nullptr) return false;
+
+    state.queued.fetch_sub(1, std::memory_order_relaxed);
+    Execute(job);
+    return true;
+  }
+
+  inline void WorkerLoop(int index) {
+    WorkerIndex() = index;
+    Profiler::SetThreadName(("job worker " + std::to_string(index)).c_str());
+
+    State& state = GetState();
+    uint32_t idle = 0;
+
+    while(state.running.load(std::memory_order_acquire)) {
+      if(RunOne()) {
+        idle = 0;
+        continue;
+      }
+
+      // Jobs tend to come in bursts, don't sleep right away
+      if(++idle < 64) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(state.sleepLock);
+      state.sleeping.fetch_add(1);
+      state.wake.wait(lock, [&]() {
+        return state.queued.load() > 0
+            || !state.running.load(std::memory_order_acquire);
+      });
+      state.sleeping.fetch_sub(1, std::memory_order_acq_rel);
+      idle = 0;
+    }
+  }
+
+  // Workers including the caller, 0 for one per core. Call from the
+  // thread that will be worker 0, before any job is submitted
+  inline void Start(uint32_t workers) {
+    State& state = GetState();
+    if(state.running.load()) return;
+
+    if(workers == 0) {
+      workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // JOB_WORKERS=<n> wins over whatever the caller asked for
+    if(const char* value = getenv("JOB_WORKERS")) {
+      int requested = atoi(value);
+      if(requested > 0) workers = static_cast<uint32_t>(requested);
+    }
+
+    state.workers.clear();
+    for(uint32_t i = 0; i < workers; i++) {
+      state.workers.push_back(std::make_unique<Worker>());
+    }
+
+    WorkerIndex() = 0;
+    state.running.store(true, std::memory_order_release);
+
+    for(uint32_t i = 1; i < workers; i++) {
+      state.threads.emplace_back(WorkerLoop, static_cast<int>(i));
+    }
+  }
+
+  // Everything submitted must have been waited for
+  inline void Stop() {
+    State& state = GetState();
+    if(!state.running.load()) return;
+
+    {
+      std::lock_guard<std::mutex> lock(state.sleepLock);
+      state.running.store(false, std::memory_order_release);
+      state.wake.notify_all();
+    }
+
+    for(auto& thread : state.threads) thread.join();
+    state.threads.clear();
+    state.workers.clear();
+    WorkerIndex() = -1;
+  }
+
+  // 1 when not started
+  inline uint32_t WorkerCount() {
+    State& state = GetState();
+    return state.running.load() ? static_cast<uint32_t>(state.workers.size()) : 1;
+  }
+
+  template<typename F>
+  void Prepare(Job* job, F&& function, Counter* counter) {
+    using Function = typename std::decay<F>::type;
+    static_assert(sizeof(Function) <= Job::STORAGE, "Capture less, or capture a pointer");
+    static_assert(alignof(Function) <= alignof(std::max_align_t), "Over-aligned capture");
+
+    new (job->storage) Function(std::forward<F>(function));
+    job->invoke = [](void* storage) {
+      Function& stored = *static_cast<Function*>(storage);
+      stored();
+      stored.~Function();
+    };
+    job->counter = counter;
+
+    if(counter != nullptr) counter->pending.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // `function()` on some worker, `counter` (if any) tracks it
+  template<typename F>
+  void Run(F&& function, Counter* counter = nullptr) {
+    Job* job = Allocate();
+    if(job == nullptr) {
+      // Our ring is full, this one doesn't get to wait for room
+      function();
+      return;
+    }
+
+    Prepare(job, std::forward<F>(function), counter);
+    Schedule(job);
+  }
+
+  // `function()` on some worker, never the calling thread. Before
+  // Start(), on whichever thread next runs a Wait()
+  template<typename F>
+  void Post(F&& function) {
+    Job* job = Allocate();
+    if(job == nullptr) {
+      job = new Job();
+      job->heap = true;
+    }
+
+    Prepare(job, std::forward<F>(function), nullptr);
+    Inject(job);
+  }
+
+  inline void Wait(Counter& counter);
+
+  // Same, once `dependency` reaches zero
+  template<typename F>
+  void RunAfter(Counter& dependency, F&& function, Counter* counter = nullptr) {
+    Job* job = Allocate();
+    if(job == nullptr) {
+      // Same, helping with other jobs until it could run
+      Wait(dependency);
+      function();
+      return;
+    }
+
+    Prepare(job, std::forward<F>(function), counter);
+
+    {
+      std::lock_guard<std::mutex> lock(dependency.lock);
+      // Finish() takes the lock before scheduling the waiting jobs,
+      // so either it sees this one or we see zero
+      if(!dependency.Done()) {
+        dependency.waiting.push_back(job);
+        return;
+      }
+    }
+
+    Schedule(job);
+  }
+
+  // Runs other jobs until `counter` is back at zero
+  inline void Wait(Counter& counter) {
+    while(!counter.Done()) {
+      if(!RunOne()) std::this_thread::yield();
+    }
+    // Until the last Finish() is done with it too
+    std::lock_guard<std::mutex> lock(counter.lock);
+  }
+
+  // function(begin, end) over [0, count) in chunks of about `grain`
+  // (0 picks one), returns when they're all done
+  template<typename F>
+  void ParallelFor(uint32_t count, uint32_t grain, F&& function) {
+    if(count == 0) return;
+
+    if(grain == 0) {
+      // A few chunks per worker, so the load evens out by stealing
+      grain = std::max(1u, count / (WorkerCount() * 4));
+    }
+    // No more chunks than fit in our ring
+    grain = std::max(grain, (count + MAX_JOBS - 1) / MAX_JOBS);
+
+    Counter counter;
+    for(uint32_t begin = grain; begin < count; begin += grain) {
+      uint32_t end = std::min(count, begin + grain);
+      Run([&function, begin, end]() { function(begin, end); }, &counter);
+    }
+
+    // The first chunk is ours
+    function(0u, std::min(count, grain));
+    Wait(counter);
+  }
+}
@@ -1,5 +1,39 @@
 #pragma once
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+    Vectors, matrices and quaternions, SIMD where it pays.
+
+        mat4 world = Compose(position, rotation, vec3(2.0f));
+        mat4 mvp = viewProjection * world;
+        TransformPoints(mvp, corners, clipCorners, 8);
+
+    Every type is 16 bytes aligned (vec3 has a padding float) so it's
+    one SIMD register. Construction and the scalar operators are
+    constexpr. Matrix products and the batch kernels use SSE (AVX2+FMA
+    when the compiler targets it, see ENGINE_AVX2 in CMakeLists.txt)
+    or NEON on AArch64, and the Scalar versions elsewhere, in constant
+    expressions, or with MATH_NO_SIMD defined.
+
+    Matrices are column-major like GLSL: columns[3] is the
+    translation, and `m * v` transforms v.
+*/
+
+#if !defined(MATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+    #define MATH_SSE 1
+    #include <immintrin.h>
+    #if defined(__AVX2__) && defined(__FMA__)
+        #define MATH_AVX2 1
+    #endif
+#elif !defined(MATH_NO_SIMD) && defined(__ARM_NEON) && defined(__aarch64__)
+    #define MATH_NEON 1
+    #include <arm_neon.h>
+#endif
+
 namespace MathUtils {
     template<typename T>
     T clamp(T val, T min, T max) {
@@ -7,4 +41,471 @@ namespace MathUtils {
         if(val > max) return max;
         return val;
     }
-}
\ No newline at end of file
+
+    struct alignas(16) vec3 {
+        float x, y, z;
+        // So it loads as one register, whatever is in it is ignored
+        float pad;
+
+        constexpr vec3() : x(0.0f), y(0.0f), z(0.0f), pad(0.0f) {}
+        constexpr explicit vec3(float s) : x(s), y(s), z(s), pad(0.0f) {}
+        constexpr vec3(float x, float y, float z) : x(x), y(y), z(z), pad(0.0f) {}
+    };
+
+    struct alignas(16) vec4 {
+        float x, y, z, w;
+
+        constexpr vec4() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
+        constexpr explicit vec4(float s) : x(s), y(s), z(s), w(s) {}
+        constexpr vec4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+        constexpr vec4(const vec3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+
+        constexpr vec3 xyz() const { return vec3(x, y, z); }
+    };
+
+    // x, y, z is the axis times sin(angle / 2), w is cos(angle / 2)
+    struct alignas(16) quat {
+        float x, y, z, w;
+
+        constexpr quat() : x(0.0f), y(0.0f), z(0.0f), w(1.0f) {}
+        constexpr quat(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+    };
+
+    struct alignas(16) mat4 {
+        vec4 columns[4];
+
+        // Identity
+        constexpr mat4()
+            : columns{
+                vec4(1.0f, 0.0f, 0.0f, 0.0f),
+                vec4(0.0f, 1.0f, 0.0f, 0.0f),
+                vec4(0.0f, 0.0f, 1.0f, 0.0f),
+                vec4(0.0f, 0.0f, 0.0f, 1.0f)
+            } {}
+
+        constexpr mat4(const vec4& c0, const vec4& c1, const vec4& c2, const vec4& c3)
+            : columns{ c0, c1, c2, c3 } {}
+
+        constexpr vec4& operator[](int column) { return columns[column]; }
+        constexpr const vec4& operator[](int column) const { return columns[column]; }
+
+        // 16 floats, column after column (what shaders expect)
+        const float* Data() const { return &columns[0].x; }
+    };
+
+    // vec3
+
+    constexpr vec3 operator+(const vec3& a, const vec3& b) { return vec3(a.x + b.x, a.y + b.y, a.z + b.z); }
+    constexpr vec3 operator-(const vec3& a, const vec3& b) { return vec3(a.x - b.x, a.y - b.y, a.z - b.z); }
+    constexpr vec3 operator*(const vec3& a, const vec3& b) { return vec3(a.x * b.x, a.y * b.y, a.z * b.z); }
+    constexpr vec3 operator*(const vec3& a, float s) { return vec3(a.x * s, a.y * s, a.z * s); }
+    constexpr vec3 operator*(float s, const vec3& a) { return a * s; }
+    constexpr vec3 operator/(const vec3& a, float s) { return vec3(a.x / s, a.y / s, a.z / s); }
+    constexpr vec3 operator-(const vec3& a) { return vec3(-a.x, -a.y, -a.z); }
+
+    constexpr vec3& operator+=(vec3& a, const vec3& b) { return a = a + b; }
+    constexpr vec3& operator-=(vec3& a, const vec3& b) { return a = a - b; }
+    constexpr vec3& operator*=(vec3& a, float s) { return a = a * s; }
+
+    constexpr float Dot(const vec3& a, const vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+    constexpr vec3 Cross(const vec3& a, const vec3& b) {
+        return vec3(
+            a.y * b.z - a.z * b.y,
+            a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x
+        );
+    }
+
+    inline float Length(const vec3& a) { return std::sqrt(Dot(a, a)); }
+    inline vec3 Normalize(const vec3& a) { return a / Length(a); }
+
+    constexpr vec3 Lerp(const vec3& a, const vec3& b, float t) { return a + (b - a) * t; }
+
+    // vec4
+
+    constexpr vec4 operator+(const vec4& a, const vec4& b) { return vec4(a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w); }
+    constexpr vec4 operator-(const vec4& a, const vec4& b) { return vec4(a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w); }
+    constexpr vec4 operator*(const vec4& a, const vec4& b) { return vec4(a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w); }
+    constexpr vec4 operator*(const vec4& a, float s) { return vec4(a.x * s, a.y * s, a.z * s, a.w * s); }
+    constexpr vec4 operator*(float s, const vec4& a) { return a * s; }
+    constexpr vec4 operator/(const vec4& a, float s) { return vec4(a.x / s, a.y / s, a.z / s, a.w / s); }
+    constexpr vec4 operator-(const vec4& a) { return vec4(-a.x, -a.y, -a.z, -a.w); }
+
+    constexpr vec4& operator+=(vec4& a, const vec4& b) { return a = a + b; }
+    constexpr vec4& operator-=(vec4& a, const vec4& b) { return a = a - b; }
+    constexpr vec4& operator*=(vec4& a, float s) { return a = a * s; }
+
+    constexpr float Dot(const vec4& a, const vec4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+    inline float Length(const vec4& a) { return std::sqrt(Dot(a, a)); }
+    inline vec4 Normalize(const vec4& a) { return a / Length(a); }
+
+    constexpr vec4 Lerp(const vec4& a, const vec4& b, float t) { return a + (b - a) * t; }
+
+    // quat
+
+    // Rotates by b, then by a
+    constexpr quat operator*(const quat& a, const quat& b) {
+        return quat(
+            a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+            a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+            a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+            a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+        );
+    }
+
+    constexpr quat Conjugate(const quat& q) { return quat(-q.x, -q.y, -q.z, q.w); }
+
+    inline quat Normalize(const quat& q) {
+        float length = std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        return quat(q.x / length, q.y / length, q.z / length, q.w / length);
+    }
+
+    // `axis` must be normalized
+    inline quat AxisAngle(const vec3& axis, float radians) {
+        float s = std::sin(radians * 0.5f);
+        return quat(axis.x * s, axis.y * s, axis.z * s, std::cos(radians * 0.5f));
+    }
+
+    constexpr vec3 Rotate(const quat& q, const vec3& v) {
+        vec3 axis(q.x, q.y, q.z);
+        vec3 t = Cross(axis, v) * 2.0f;
+        return v + t * q.w + Cross(axis, t);
+    }
+
+    // Normalized linear interpolation, along the shortest way
+    inline quat Nlerp(const quat& a, const quat& b, float t) {
+        float sign = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f ? -1.0f : 1.0f;
+        return Normalize(quat(
+            a.x + (b.x * sign - a.x) * t,
+            a.y + (b.y * sign - a.y) * t,
+            a.z + (b.z * sign - a.z) * t,
+            a.w + (b.w * sign - a.w) * t
+        ));
+    }
+
+    // Reference versions of everything that has a SIMD one, they're
+    // what the others fall back to and get measured against
+    namespace Scalar {
+        constexpr vec4 Multiply(const mat4& m, const vec4& v) {
+            return m[0] * v.x + m[1] * v.y + m[2] * v.z + m[3] * v.w;
+        }
+
+        constexpr mat4 Multiply(const mat4& a, const mat4& b) {
+            return mat4(
+                Multiply(a, b[0]),
+                Multiply(a, b[1]),
+                Multiply(a, b[2]),
+                Multiply(a, b[3])
+            );
+        }
+
+        inline void TransformPoints(const mat4& m, const vec3* in, vec3* out, size_t count) {
+            for(size_t i = 0; i < count; i++) {
+                out[i] = Multiply(m, vec4(in[i], 1.0f)).xyz();
+            }
+        }
+
+        inline void MultiplyMatrices(const mat4* a, const mat4* b, mat4* out, size_t count) {
+            for(size_t i = 0; i < count; i++) out[i] = Multiply(a[i], b[i]);
+        }
+
+        inline void MultiplyMatrices(const mat4& a, const mat4* b, mat4* out, size_t count) {
+            for(size_t i = 0; i < count; i++) out[i] = Multiply(a, b[i]);
+        }
+    }
+
+#if defined(MATH_SSE)
+    namespace Simd {
+        typedef __m128 Register;
+
+        inline Register Load(const vec4& v) { return _mm_load_ps(&v.x); }
+        inline Register Load(const vec3& v) { return _mm_load_ps(&v.x); }
+        inline void Store(vec4& out, Register r) { _mm_store_ps(&out.x, r); }
+
+        // Drops w, so a vec3's padding stays zero
+        inline void Store(vec3& out, Register r) {
+            const Register xyz = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+            _mm_store_ps(&out.x, _mm_and_ps(r, xyz));
+        }
+
+        template<int LANE>
+        inline Register Splat(Register r) {
+            return _mm_shuffle_ps(r, r, _MM_SHUFFLE(LANE, LANE, LANE, LANE));
+        }
+
+        // a * b + c
+        inline Register MulAdd(Register a, Register b, Register c) {
+    #if defined(__FMA__)
+            return _mm_fmadd_ps(a, b, c);
+    #else
+            return _mm_add_ps(_mm_mul_ps(a, b), c);
+    #endif
+        }
+    }
+#elif defined(MATH_NEON)
+    namespace Simd {
+        typedef float32x4_t Register;
+
+        inline Register Load(const vec4& v) { return vld1q_f32(&v.x); }
+        inline Register Load(const vec3& v) { return vld1q_f32(&v.x); }
+        inline void Store(vec4& out, Register r) { vst1q_f32(&out.x, r); }
+
+        inline void Store(vec3& out, Register r) {
+            vst1q_f32(&out.x, vsetq_lane_f32(0.0f, r, 3));
+        }
+
+        template<int LANE>
+        inline Register Splat(Register r) { return vdupq_laneq_f32(r, LANE); }
+
+        inline Register MulAdd(Register a, Register b, Register c) { return vfmaq_f32(c, a, b); }
+    }
+#endif
+
+#if defined(MATH_SSE) || defined(MATH_NEON)
+    namespace Simd {
+        // A matrix's columns, loaded once for a whole batch
+        struct Columns {
+            Register c0, c1, c2, c3;
+
+            explicit Columns(const mat4& m)
+                : c0(Load(m[0])), c1(Load(m[1])), c2(Load(m[2])), c3(Load(m[3])) {}
+
+            Register Multiply(Register v) const {
+                return MulAdd(c0, Splat<0>(v), MulAdd(c1, Splat<1>(v), MulAdd(c2, Splat<2>(v), MulAdd(c3, Splat<3>(v), Zero()))));
+            }
+
+            // Same, w taken as 1
+            Register MultiplyPoint(Register v) const {
+                return MulAdd(c0, Splat<0>(v), MulAdd(c1, Splat<1>(v), MulAdd(c2, Splat<2>(v), c3)));
+            }
+
+            static Register Zero() {
+    #if defined(MATH_SSE)
+                return _mm_setzero_ps();
+    #else
+                return vdupq_n_f32(0.0f);
+    #endif
+            }
+        };
+
+        inline vec4 Multiply(const mat4& m, const vec4& v) {
+            vec4 result;
+            Store(result, Columns(m).Multiply(Load(v)));
+            return result;
+        }
+
+        inline mat4 Multiply(const mat4& a, const mat4& b) {
+            Columns columns(a);
+            mat4 result;
+            for(int i = 0; i < 4; i++) Store(result[i], columns.Multiply(Load(b[i])));
+            return result;
+        }
+    }
+#endif
+
+    constexpr vec4 operator*(const mat4& m, const vec4& v) {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if(!std::is_constant_evaluated()) return Simd::Multiply(m, v);
+#endif
+        return Scalar::Multiply(m, v);
+    }
+
+    constexpr mat4 operator*(const mat4& a, const mat4& b) {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        if(!std::is_constant_evaluated()) return Simd::Multiply(a, b);
+#endif
+        return Scalar::Multiply(a, b);
+    }
+
+    constexpr mat4& operator*=(mat4& a, const mat4& b) { return a = a * b; }
+
+    // (p, 1), without the divide
+    constexpr vec3 TransformPoint(const mat4& m, const vec3& p) { return (m * vec4(p, 1.0f)).xyz(); }
+    // (v, 0), directions and normals (with the inverse transpose)
+    constexpr vec3 TransformVector(const mat4& m, const vec3& v) { return (m * vec4(v, 0.0f)).xyz(); }
+
+    // out[i] = m * (in[i], 1). `out` may be `in`
+    inline void TransformPoints(const mat4& m, const vec3* in, vec3* out, size_t count) {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        size_t i = 0;
+
+    #if defined(MATH_AVX2)
+        // Two points per register, each half of it a 128 bit lane
+        // that shuffles independently, like two SSE registers
+        const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m[0]));
+        const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m[1]));
+        const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m[2]));
+        const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&m[3]));
+        const __m256 xyz = _mm256_castsi256_ps(_mm256_set_epi32(0, -1, -1, -1, 0, -1, -1, -1));
+
+        for(; i + 2 <= count; i += 2) {
+            __m256 p = _mm256_loadu_ps(&in[i].x);
+            __m256 r = _mm256_fmadd_ps(c2, _mm256_shuffle_ps(p, p, 0xAA), c3);
+            r = _mm256_fmadd_ps(c1, _mm256_shuffle_ps(p, p, 0x55), r);
+            r = _mm256_fmadd_ps(c0, _mm256_shuffle_ps(p, p, 0x00), r);
+            _mm256_storeu_ps(&out[i].x, _mm256_and_ps(r, xyz));
+        }
+    #endif
+
+        Simd::Columns columns(m);
+        for(; i < count; i++) {
+            Simd::Store(out[i], columns.MultiplyPoint(Simd::Load(in[i])));
+        }
+#else
+        Scalar::TransformPoints(m, in, out, count);
+#endif
+    }
+
+    // out[i] = a[i] * b[i]. `out` may be `a` or `b`
+    inline void MultiplyMatrices(const mat4* a, const mat4* b, mat4* out, size_t count) {
+#if defined(MATH_AVX2)
+        for(size_t i = 0; i < count; i++) {
+            const __m256 c0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][0]));
+            const __m256 c1 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][1]));
+            const __m256 c2 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][2]));
+            const __m256 c3 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(&a[i][3]));
+
+            // Two columns of b at a time
+            for(int j = 0; j < 4; j += 2) {
+                __m256 v = _mm256_loadu_ps(&b[i][j].x);
+                __m256 r = _mm256_mul_ps(c3, _mm256_shuffle_ps(v, v, 0xFF));
+                r = _mm256_fmadd_ps(c2, _mm256_shuffle_ps(v, v, 0xAA), r);
+                r = _mm256_fmadd_ps(c1, _mm256_shuffle_ps(v, v, 0x55), r);
+                r = _mm256_fmadd_ps(c0, _mm256_shuffle_ps(v, v, 0x00), r);
+                _mm256_storeu_ps(&out[i][j].x, r);
+            }
+        }
+#elif defined(MATH_SSE) || defined(MATH_NEON)
+        for(size_t i = 0; i < count; i++) {
+            Simd::Columns columns(a[i]);
+            for(int j = 0; j < 4; j++) {
+                Simd::Store(out[i][j], columns.Multiply(Simd::Load(b[i][j])));
+            }
+        }
+#else
+        Scalar::MultiplyMatrices(a, b, out, count);
+#endif
+    }
+
+    // out[i] = a * b[i]. `out` may be `b`
+    inline void MultiplyMatrices(const mat4& a, const mat4* b, mat4* out, size_t count) {
+#if defined(MATH_SSE) || defined(MATH_NEON)
+        Simd::Columns columns(a);
+        for(size_t i = 0; i < count; i++) {
+            for(int j = 0; j < 4; j++) {
+                Simd::Store(out[i][j], columns.Multiply(Simd::Load(b[i][j])));
+            }
+        }
+#else
+        Scalar::MultiplyMatrices(a, b, out, count);
+#endif
+    }
+
+    // Building matrices
+
+    constexpr mat4 Translation(const vec3& t) {
+        mat4 m;
+        m[3] = vec4(t, 1.0f);
+        return m;
+    }
+
+    constexpr mat4 Scale(const vec3& s) {
+        mat4 m;
+        m[0].x = s.x;
+        m[1].y = s.y;
+        m[2].z = s.z;
+        return m;
+    }
+
+    // `q` must be normalized
+    constexpr mat4 Rotation(const quat& q) {
+        float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+        return mat4(
+            vec4(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy), 0.0f),
+            vec4(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx), 0.0f),
+            vec4(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy), 0.0f),
+            vec4(0.0f, 0.0f, 0.0f, 1.0f)
+        );
+    }
+
+    // Translation * Rotation * Scale, without the two products
+    constexpr mat4 Compose(const vec3& translation, const quat& rotation, const vec3& scale) {
+        mat4 m = Rotation(rotation);
+        m[0] *= scale.x;
+        m[1] *= scale.y;
+        m[2] *= scale.z;
+        m[3] = vec4(translation, 1.0f);
+        return m;
+    }
+
+    constexpr mat4 Transpose(const mat4& m) {
+        return mat4(
+            vec4(m[0].x, m[1].x, m[2].x, m[3].x),
+            vec4(m[0].y, m[1].y, m[2].y, m[3].y),
+            vec4(m[0].z, m[1].z, m[2].z, m[3].z),
+            vec4(m[0].w, m[1].w, m[2].w, m[3].w)
+        );
+    }
+
+    // Any invertible matrix, cofactors over the determinant
+    inline mat4 Inverse(const mat4& matrix) {
+        const float* m = matrix.Data();
+        float inv[16];
+
+        inv[0]  =  m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+        inv[4]  = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+        inv[8]  =  m[4] * m[9]  * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+        inv[12] = -m[4] * m[9]  * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+        inv[1]  = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+        inv[5]  =  m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+        inv[9]  = -m[0] * m[9]  * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+        inv[13] =  m[0] * m[9]  * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+        inv[2]  =  m[1] * m[6]  * m[15] - m[1] * m[7]  * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7]  - m[13] * m[3] * m[6];
+        inv[6]  = -m[0] * m[6]  * m[15] + m[0] * m[7]  * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7]  + m[12] * m[3] * m[6];
+        inv[10] =  m[0] * m[5]  * m[15] - m[0] * m[7]  * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7]  - m[12] * m[3] * m[5];
+        inv[14] = -m[0] * m[5]  * m[14] + m[0] * m[6]  * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6]  + m[12] * m[2] * m[5];
+        inv[3]  = -m[1] * m[6]  * m[11] + m[1] * m[7]  * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9]  * m[2] * m[7]  + m[9]  * m[3] * m[6];
+        inv[7]  =  m[0] * m[6]  * m[11] - m[0] * m[7]  * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8]  * m[2] * m[7]  - m[8]  * m[3] * m[6];
+        inv[11] = -m[0] * m[5]  * m[11] + m[0] * m[7]  * m[9]  + m[4] * m[1] * m[11] - m[4] * m[3] * m[9]  - m[8]  * m[1] * m[7]  + m[8]  * m[3] * m[5];
+        inv[15] =  m[0] * m[5]  * m[10] - m[0] * m[6]  * m[9]  - m[4] * m[1] * m[10] + m[4] * m[2] * m[9]  + m[8]  * m[1] * m[6]  - m[8]  * m[2] * m[5];
+
+        float det = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+        float scale = 1.0f / det;
+
+        mat4 result;
+        for(int c = 0; c < 4; c++) {
+            result[c] = vec4(inv[c * 4], inv[c * 4 + 1], inv[c * 4 + 2], inv[c * 4 + 3]) * scale;
+        }
+        return result;
+    }
+
+    // Right-handed, looking down -Z, into Vulkan's clip space
+    // (y down, depth from 0 at `near` to 1 at `far`)
+    inline mat4 Perspective(float fovY, float aspect, float near, float far) {
+        float f = 1.0f / std::tan(fovY * 0.5f);
+        return mat4(
+            vec4(f / aspect, 0.0f, 0.0f, 0.0f),
+            vec4(0.0f, -f, 0.0f, 0.0f),
+            vec4(0.0f, 0.0f, far / (near - far), -1.0f),
+            vec4(0.0f, 0.0f, near * far / (near - far), 0.0f)
+        );
+    }
+
+    inline mat4 LookAt(const vec3& eye, const vec3& target, const vec3& up) {
+        vec3 f = Normalize(target - eye);
+        vec3 s = Normalize(Cross(f, up));
+        vec3 u = Cross(s, f);
+
+        return mat4(
+            vec4(s.x, u.x, -f.x, 0.0f),
+            vec4(s.y, u.y, -f.y, 0.0f),
+            vec4(s.z, u.z, -f.z, 0.0f),
+            vec4(-Dot(s, eye), -Dot(u, eye), Dot(f, eye), 1.0f)
+        );
+    }
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+  CPU zones for frame profiling.
+
+    void Render() {
+      PROFILE_ZONE("Render");
+      ...
+    }
+
+  Every thread writes its zones into its own ring buffer, so recording
+  is just a few relaxed stores with no locks or allocations. Once per
+  frame, `Profiler::FrameMark()` (main thread) moves whatever was
+  recorded into a capture, if one is running, and writes it out as
+  Chrome trace-event JSON when it's done (chrome://tracing, Perfetto).
+
+  Like ASSERT, it can be compiled out, with NO_PROFILER.
+*/
+namespace Profiler {
+  inline uint64_t Now() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+      steady_clock::now().time_since_epoch()
+    ).count();
+  }
+
+  struct Event {
+    // Zone names are expected to be string literals
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  // Single producer (the owning thread), single consumer (FrameMark).
+  // Slots are atomics so the consumer can safely read a slot the
+  // producer is overwriting, it then notices `head` moved past it
+  // and throws the copy away.
+  struct ThreadBuffer {
+    static const uint64_t CAPACITY = 1 << 14;
+
+    struct Slot {
+      std::atomic<const char*> name;
+      std::atomic<uint64_t> begin;
+      std::atomic<uint64_t> end;
+    };
+
+    Slot slots[CAPACITY];
+    std::atomic<uint64_t> head{ 0 };
+    // Only touched by the consumer
+    uint64_t tail = 0;
+
+    uint32_t threadId;
+    std::string threadName;
+
+    void Push(const char* name, uint64_t begin, uint64_t end) {
+      uint64_t index = head.load(std::memory_order_relaxed);
+      Slot& slot = slots[index % CAPACITY];
+
+      // Pairs with the acquire fence in Drain: a consumer that sees
+      // any of these stores also sees `head` at `index` or later
+      std::atomic_thread_fence(std::memory_order_release);
+
+      slot.name.store(name, std::memory_order_relaxed);
+      slot.begin.store(begin, std::memory_order_relaxed);
+      slot.end.store(end, std::memory_order_relaxed);
+
+      // Publishes the slot
+      head.store(index + 1, std::memory_order_release);
+    }
+
+    // Appends everything recorded since the last drain to `out`
+    void Drain(std::vector<Event>& out) {
+      uint64_t last = head.load(std::memory_order_acquire);
+
+      // We fell more than a whole ring behind, the oldest are gone
+      if(last - tail > CAPACITY) tail = last - CAPACITY;
+
+      for(; tail < last; tail++) {
+        Slot& slot = slots[tail % CAPACITY];
+        Event event{
+          slot.name.load(std::memory_order_relaxed),
+          slot.begin.load(std::memory_order_relaxed),
+          slot.end.load(std::memory_order_relaxed)
+        };
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Overwritten while we were reading it
+        if(head.load(std::memory_order_relaxed) - tail >= CAPACITY) continue;
+
+        out.push_back(event);
+      }
+    }
+  };
+
+  struct CaptureEvent {
+    Event event;
+    uint32_t threadId;
+  };
+
+  // Shared state, only FrameMark and thread registration touch it
+  struct State {
+    std::mutex mutex;
+    // Never freed, so zones of threads that already exited can
+    // still make it into a capture
+    std::vector<ThreadBuffer*> buffers;
+
+    uint64_t frame = 0;
+    // Thread calling FrameMark, frame markers go on its track
+    uint32_t frameThreadId = 0;
+
+    bool capturing = false;
+    uint64_t captureFirst = 0;
+    uint64_t captureLast = 0;
+    std::string capturePath;
+
+    std::vector<CaptureEvent> events;
+    std::vector<uint64_t> frameStarts;
+  };
+
+  inline State& GetState() {
+    static State state;
+    return state;
+  }
+
+  inline ThreadBuffer& GetThreadBuffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+
+    if(buffer == nullptr) {
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+
+      buffer = new ThreadBuffer();
+      buffer->threadId = static_cast<uint32_t>(state.buffers.size());
+      buffer->threadName = "thread " + std::to_string(buffer->threadId);
+      buffer->tail = 0;
+
+      state.buffers.push_back(buffer);
+    }
+
+    return *buffer;
+  }
+
+  inline void SetThreadName(const char* name) {
+    ThreadBuffer& buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(GetState().mutex);
+    buffer.threadName = name;
+  }
+
+  class Zone {
+  private:
+    const char* name;
+    uint64_t begin;
+  public:
+    Zone(const char* name) : name(name), begin(Now()) {}
+    ~Zone() { GetThreadBuffer().Push(name, begin, Now()); }
+  };
+
+  // Frames [firstFrame, firstFrame + frameCount) will be written to `path`
+  inline void RequestCapture(
+    uint64_t firstFrame,
+    uint64_t frameCount,
+    const char* path
+  ) {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.captureFirst = firstFrame;
+    state.captureLast = firstFrame + frameCount;
+    state.capturePath = path;
+    state.capturing = false;
+    state.events.clear();
+    state.frameStarts.clear();
+  }
+
+  inline void WriteCapture(State& state) {
+    std::ofstream file(state.capturePath);
+
+    if(!file.is_open()) {
+      fprintf(stderr, "[PROFILER] Could not write %s\n", state.capturePath.c_str());
+      return;
+    }
+
+    // Chrome wants microseconds, relative to anything we like
+    uint64_t origin = state.frameStarts.empty() ? 0 : state.frameStarts[0];
+    auto us = [](uint64_t ns) {
+      return std::to_string(ns / 1000) + "." + std::to_string(ns % 1000 / 100);
+    };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    // Every entry but the first is preceded by a comma
+    const char* separator = "\n";
+    auto entry = [&file, &separator]() -> std::ofstream& {
+      file << separator;
+      separator = ",\n";
+      return file;
+    };
+
+    for(auto* buffer : state.buffers) {
+      entry()
+        << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+        << buffer->threadId << ",\"args\":{\"name\":\""
+        << buffer->threadName << "\"}}";
+    }
+
+    for(size_t i = 0; i < state.frameStarts.size(); i++) {
+      entry()
+        << "{\"name\":\"Frame " << (state.captureFirst + i)
+        << "\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":"
+        << state.frameThreadId << ",\"ts\":" << us(state.frameStarts[i] - origin) << "}";
+    }
+
+    for(auto& captured : state.events) {
+      // Zones that were already open when the capture started
+      // get cut at its beginning
+      uint64_t begin = std::max(captured.event.begin, origin);
+      uint64_t end = std::max(captured.event.end, begin);
+
+      entry()
+        << "{\"name\":\"" << captured.event.name
+        << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << captured.threadId
+        << ",\"ts\":" << us(begin - origin)
+        << ",\"dur\":" << us(end - begin) << "}";
+    }
+
+    file << "\n]}\n";
+
+    printf("[PROFILER] Wrote %zu zones to %s\n",
+      state.events.size(), state.capturePath.c_str());
+  }
+
+  // Call once per frame, on the thread that owns the frame loop
+  inline void FrameMark() {
+    // Registers this thread before we take the lock ourselves
+    uint32_t threadId = GetThreadBuffer().threadId;
+
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.frameThreadId = threadId;
+
+    uint64_t now = Now();
+    uint64_t frame = state.frame++;
+
+    if(state.capturePath.empty()) {
+      // No capture coming, just keep the rings from lapping
+      for(auto* buffer : state.buffers) {
+        buffer->tail = buffer->head.load(std::memory_order_acquire);
+      }
+      return;
+    }
+
+    if(frame == state.captureFirst) {
+      // Anything before this point doesn't belong to the capture
+      for(auto* buffer : state.buffers) {
+        buffer->tail = buffer->head.load(std::memory_order_acquire);
+      }
+      state.capturing = true;
+    }
+
+    if(!state.capturing) return;
+
+    std::vector<Event> drained;
+    for(auto* buffer : state.buffers) {
+      drained.clear();
+      buffer->Drain(drained);
+
+      for(auto& event : drained) {
+        state.events.push_back({ event, buffer->threadId });
+      }
+    }
+
+    if(frame == state.captureLast) {
+      WriteCapture(state);
+      state.capturing = false;
+      state.capturePath.clear();
+      state.events.clear();
+      state.frameStarts.clear();
+      return;
+    }
+
+    state.frameStarts.push_back(now);
+  }
+}
+
+#ifndef NO_PROFILER
+  #define PROFILE_CONCAT_(a, b) a##b
+  #define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+  #define PROFILE_ZONE(name) \
+    Profiler::Zone PROFILE_CONCAT(profileZone, __LINE__)(name)
+  #define PROFILE_FRAME() Profiler::FrameMark()
+#else
+  #define PROFILE_ZONE(name)
+  #define PROFILE_FRAME()
+#endif
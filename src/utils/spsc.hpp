@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+/*
+  Bounded single-producer, single-consumer queue, lock-free.
+
+    SpscQueue<FramePacket, 2> packets;
+    packets.TryPush(std::move(packet));   // producer thread only
+    packets.TryPop(packet);               // consumer thread only
+
+  Neither side ever waits on the other, a full or empty queue just
+  says so and the caller decides what to do. Each side keeps a copy
+  of the other's index and only reads the shared one when that copy
+  says full/empty, so the two rarely touch the same cache line.
+*/
+template<typename T, uint32_t CAPACITY>
+class SpscQueue {
+  static_assert(CAPACITY > 0, "Needs room for something");
+
+private:
+  // Next slot to read, written by the consumer
+  alignas(64) std::atomic<uint64_t> head{ 0 };
+  uint64_t cachedTail = 0;
+
+  // Next slot to write, written by the producer
+  alignas(64) std::atomic<uint64_t> tail{ 0 };
+  uint64_t cachedHead = 0;
+
+  alignas(64) T items[CAPACITY];
+
+public:
+  // Producer only. False, leaving `item` alone, when full
+  bool TryPush(T&& item) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+
+    if(t - cachedHead == CAPACITY) {
+      cachedHead = head.load(std::memory_order_acquire);
+      if(t - cachedHead == CAPACITY) return false;
+    }
+
+    items[t % CAPACITY] = std::move(item);
+    tail.store(t + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. False when empty
+  bool TryPop(T& item) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+
+    if(h == cachedTail) {
+      cachedTail = tail.load(std::memory_order_acquire);
+      if(h == cachedTail) return false;
+    }
+
+    item = std::move(items[h % CAPACITY]);
+    head.store(h + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Either side, already outdated when it returns
+  uint32_t Size() {
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t t = tail.load(std::memory_order_acquire);
+    return static_cast<uint32_t>(t - h);
+  }
+};
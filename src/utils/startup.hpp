@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "profiler.hpp"
+
+/*
+  Wall time of every startup step, to find out what our time to first
+  frame is spent on.
+
+    void VulkanContext::CreateInstance() {
+      STARTUP_PHASE("CreateInstance");
+      ...
+    }
+
+  Phases opened while another is running on the same thread become
+  its children, so the report reads as a tree. The ones opened on
+  other threads (job workers) run alongside it, they're listed but
+  don't add to the total.
+
+  Every phase allocates and takes a lock, which is nothing next to
+  the work it measures but too much for the frame loop. Startup::End()
+  once the first frame is out turns them into no-ops, for code that
+  runs both during startup and after it (shader loads).
+*/
+namespace Startup {
+  struct Phase {
+    std::string name;
+    // Nesting level on its thread, 0 for top level phases
+    uint32_t depth;
+    std::thread::id thread;
+    uint64_t begin;
+    // 0 while the phase is still running
+    uint64_t end;
+  };
+
+  struct State {
+    std::mutex mutex;
+    std::vector<Phase> phases;
+    std::atomic<bool> ended{ false };
+  };
+
+  inline State& GetState() {
+    static State state;
+    return state;
+  }
+
+  inline uint32_t& GetDepth() {
+    thread_local uint32_t depth = 0;
+    return depth;
+  }
+
+  class Scope {
+  private:
+    static constexpr size_t NONE = SIZE_MAX;
+    size_t index = NONE;
+  public:
+    // The name is `name` followed by `detail`, only put together
+    // before Startup::End()
+    Scope(const char* name, const char* detail = "") {
+      State& state = GetState();
+      if(state.ended.load(std::memory_order_acquire)) return;
+
+      std::lock_guard<std::mutex> lock(state.mutex);
+      index = state.phases.size();
+      state.phases.push_back({
+        std::string(name) + detail, GetDepth()++, std::this_thread::get_id(), Profiler::Now(), 0
+      });
+    }
+
+    ~Scope() {
+      if(index == NONE) return;
+
+      State& state = GetState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+
+      // Unless Reset() dropped it in the meantime
+      if(index < state.phases.size()) state.phases[index].end = Profiler::Now();
+      GetDepth()--;
+    }
+  };
+
+  // Startup is over, phases opened from now on aren't recorded
+  inline void End() {
+    GetState().ended.store(true, std::memory_order_release);
+  }
+
+  // Forgets everything recorded and starts recording again, for tools
+  // that start up more than once
+  inline void Reset() {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.phases.clear();
+    state.ended.store(false, std::memory_order_release);
+  }
+
+  inline std::vector<Phase> GetPhases() {
+    State& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.phases;
+  }
+
+  inline double DurationMs(const Phase& phase) {
+    return phase.end > phase.begin ? (phase.end - phase.begin) / 1e6 : 0.0;
+  }
+
+  // Whether it was opened on the thread that opened the very first
+  // phase, the one starting up. The others overlap it
+  inline bool OnStartingThread(const std::vector<Phase>& phases, const Phase& phase) {
+    return phase.thread == phases[0].thread;
+  }
+
+  // Sum of the starting thread's top level phases
+  inline double TotalMs() {
+    auto phases = GetPhases();
+
+    double total = 0.0;
+    for(auto& phase : phases) {
+      if(phase.depth == 0 && OnStartingThread(phases, phase)) total += DurationMs(phase);
+    }
+    return total;
+  }
+
+  inline void Print(FILE* out = stdout) {
+    auto phases = GetPhases();
+    fprintf(out, "[STARTUP] %.2fms\n", TotalMs());
+
+    for(auto& phase : phases) {
+      bool elsewhere = !OnStartingThread(phases, phase);
+      // Under whatever was running when they started
+      uint32_t depth = phase.depth + (elsewhere ? 1 : 0);
+
+      fprintf(out, "[STARTUP] %*s%-*s %8.2fms%s\n",
+        depth * 2, "",
+        static_cast<int>(40 - depth * 2), phase.name.c_str(),
+        DurationMs(phase), elsewhere ? " (worker)" : "");
+    }
+  }
+
+  // Flat array, in the order the phases started
+  inline std::string ToJson() {
+    auto phases = GetPhases();
+    uint64_t origin = phases.empty() ? 0 : phases[0].begin;
+
+    std::string json = "[";
+    char buffer[128];
+
+    for(size_t i = 0; i < phases.size(); i++) {
+      auto& phase = phases[i];
+
+      json += i > 0 ? ",{\"name\":\"" : "{\"name\":\"";
+      // Names are paths at worst, escaping backslashes is enough
+      for(char c : phase.name) {
+        if(c == '\\' || c == '"') json += '\\';
+        json += c;
+      }
+
+      snprintf(buffer, sizeof(buffer),
+        "\",\"depth\":%u,\"worker\":%s,\"startMs\":%.3f,\"durationMs\":%.3f}",
+        phase.depth, OnStartingThread(phases, phase) ? "false" : "true",
+        (phase.begin - origin) / 1e6, DurationMs(phase));
+      json += buffer;
+    }
+
+    return json + "]";
+  }
+
+  inline bool Write(const char* path) {
+    FILE* file = fopen(path, "w");
+    if(file == nullptr) return false;
+
+    fprintf(file, "{\"totalMs\":%.3f,\"phases\":%s}\n",
+      TotalMs(), ToJson().c_str());
+    fclose(file);
+    return true;
+  }
+}
+
+#define STARTUP_CONCAT_(a, b) a##b
+#define STARTUP_CONCAT(a, b) STARTUP_CONCAT_(a, b)
+#define STARTUP_PHASE(...) \
+  Startup::Scope STARTUP_CONCAT(startupPhase, __LINE__)(__VA_ARGS__)
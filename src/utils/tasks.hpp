@@ -0,0 +1,264 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "assetio.hpp"
+#include "jobs.hpp"
+
+/*
+  Coroutines on top of the job system, for work that spends most of
+  its time waiting: loading, streaming, compiling.
+
+    Tasks::Task<ShaderModule> LoadShader(std::string path, VkDevice device) {
+      std::vector<char> code = co_await Tasks::ReadFile(path);
+      co_return ShaderModule(code, device);
+    }
+
+    Tasks::Task<void> LoadLevel() {
+      ShaderModule shader = co_await LoadShader(path, device);
+      VkPipeline pipeline = co_await Tasks::Async([&]() { return Compile(shader); });
+      co_await timelines.Wait(semaphore, uploadDone);   // see vktimeline.hpp
+      ...
+    }
+
+    Tasks::Spawn(LoadLevel(), &levelLoaded);   // or Tasks::SyncWait(LoadLevel())
+
+  A Task does nothing until it's awaited (or spawned), and then runs
+  on whatever thread awaited it. Every awaitable here suspends it
+  without blocking that thread, and resumes it on a job worker once
+  the read, compile or GPU work is done: a thread never waits on I/O
+  or the GPU, there is always another job to run.
+
+  Exceptions go up through co_await as they would through calls.
+  Spawned tasks have nowhere to send them, throwing out of one
+  terminates.
+*/
+namespace Tasks {
+  template<typename T>
+  class Task;
+
+  namespace Detail {
+    // Resumes whoever awaited the task, without growing the stack
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+
+      template<typename Promise>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+        std::coroutine_handle<> continuation = handle.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+      }
+
+      void await_resume() noexcept {}
+    };
+
+    struct PromiseBase {
+      std::coroutine_handle<> continuation;
+      std::exception_ptr error;
+
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      FinalAwaiter final_suspend() noexcept { return {}; }
+      void unhandled_exception() { error = std::current_exception(); }
+    };
+
+    template<typename T>
+    struct Promise : PromiseBase {
+      std::optional<T> value;
+
+      Task<T> get_return_object();
+      void return_value(T result) { value.emplace(std::move(result)); }
+
+      T Take() {
+        if(error) std::rethrow_exception(error);
+        return std::move(*value);
+      }
+    };
+
+    template<>
+    struct Promise<void> : PromiseBase {
+      Task<void> get_return_object();
+      void return_void() {}
+
+      void Take() {
+        if(error) std::rethrow_exception(error);
+      }
+    };
+
+    // Starts right away and cleans up after itself, for Spawn and SyncWait
+    struct Detached {
+      struct promise_type {
+        Detached get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+      };
+    };
+  }
+
+  template<typename T>
+  class Task {
+  public:
+    using promise_type = Detail::Promise<T>;
+
+  private:
+    std::coroutine_handle<promise_type> handle;
+
+  public:
+    Task() = default;
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+      if(this != &other) {
+        if(handle) handle.destroy();
+        handle = std::exchange(other.handle, nullptr);
+      }
+      return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+      if(handle) handle.destroy();
+    }
+
+    // Runs it until its first suspension, then carries on with the
+    // awaiting coroutine once it's done
+    auto operator co_await() && noexcept {
+      struct Awaiter {
+        std::coroutine_handle<promise_type> handle;
+
+        bool await_ready() noexcept { return !handle || handle.done(); }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+          handle.promise().continuation = awaiting;
+          return handle;
+        }
+
+        T await_resume() { return handle.promise().Take(); }
+      };
+      return Awaiter{ handle };
+    }
+  };
+
+  template<typename T>
+  Task<T> Detail::Promise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+  }
+
+  inline Task<void> Detail::Promise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+  }
+
+  // co_await Schedule() carries on on a job worker
+  inline auto Schedule() {
+    struct Awaiter {
+      bool await_ready() noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        // Post, not Run: Run may call it right here. A worker may
+        // resume (and finish) it before Post returns, nothing may
+        // touch `this` after it
+        Jobs::Post([handle]() { handle.resume(); });
+      }
+
+      void await_resume() noexcept {}
+    };
+    return Awaiter{};
+  }
+
+  // co_await Async(f) is f() run on a job worker, pipeline
+  // compiles for one
+  template<typename F>
+  auto Async(F function) -> Task<std::invoke_result_t<F&>> {
+    co_await Schedule();
+    co_return function();
+  }
+
+  // The whole file, empty if it couldn't be read (as FileUtils::ReadBinary)
+  inline auto ReadFile(std::string path) {
+    struct Awaiter {
+      std::string path;
+      std::vector<char> data;
+
+      bool await_ready() noexcept { return false; }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+        auto decode = [this, handle](const char* bytes, size_t size) {
+          if(bytes != nullptr) data.assign(bytes, bytes + size);
+          // Not from in here, the staging slot is only released
+          // once this returns (hence Post, never inline)
+          Jobs::Post([handle]() { handle.resume(); });
+        };
+        AssetIO::GetService().Load({ AssetIO::Request{ path, decode, nullptr } });
+      }
+
+      std::vector<char> await_resume() { return std::move(data); }
+    };
+    return Awaiter{ std::move(path), {} };
+  }
+
+  namespace Detail {
+    inline Detached Run(Task<void> task, Jobs::Counter* counter) {
+      co_await Schedule();
+      co_await std::move(task);
+      if(counter != nullptr) Jobs::Finish(*counter);
+    }
+
+    template<typename T>
+    Detached Store(Task<T> task, std::optional<T>& result, std::exception_ptr& error, Jobs::Counter& done) {
+      try {
+        result.emplace(co_await std::move(task));
+      }
+      catch(...) {
+        error = std::current_exception();
+      }
+      Jobs::Finish(done);
+    }
+
+    inline Detached Store(Task<void> task, std::exception_ptr& error, Jobs::Counter& done) {
+      try {
+        co_await std::move(task);
+      }
+      catch(...) {
+        error = std::current_exception();
+      }
+      Jobs::Finish(done);
+    }
+  }
+
+  // Starts `task` on a job worker, `counter` (if any) tracks it to the end
+  inline void Spawn(Task<void> task, Jobs::Counter* counter = nullptr) {
+    if(counter != nullptr) counter->pending.fetch_add(1, std::memory_order_relaxed);
+    Detail::Run(std::move(task), counter);
+  }
+
+  // Runs `task` from a thread that isn't a coroutine, running other
+  // jobs until it's done
+  template<typename T>
+  T SyncWait(Task<T> task) {
+    Jobs::Counter done;
+    done.pending.store(1, std::memory_order_relaxed);
+    std::exception_ptr error;
+
+    if constexpr(std::is_void_v<T>) {
+      Detail::Store(std::move(task), error, done);
+      Jobs::Wait(done);
+      if(error) std::rethrow_exception(error);
+    }
+    else {
+      std::optional<T> result;
+      Detail::Store(std::move(task), result, error, done);
+      Jobs::Wait(done);
+      if(error) std::rethrow_exception(error);
+      return std::move(*result);
+    }
+  }
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include "utils/debug.hpp"
+#include "utils/math.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+/*
+  Local and world matrices of every object in the scene, with parents.
+
+    TransformHierarchy transforms;
+    uint32_t car = transforms.Add(Translation(position));
+    uint32_t wheel = transforms.Add(Translation(offset), car);
+    ...
+    transforms.SetLocal(car, Translation(newPosition));
+    transforms.Update();
+    // Changed() is now car and wheel, CopyChanged() their world matrices
+
+  Most objects never move, so Update() only recomputes the world
+  matrices of what SetLocal() touched and everything under it, and
+  does nothing at all when nothing did. What it recomputed is listed
+  in Changed(), which is all that needs uploading to the GPU.
+
+  The matrices are kept structure-of-arrays, sorted by depth with
+  siblings next to each other: parents are always done before their
+  children, and a dirty parent's children are one contiguous run,
+  done with one MathUtils::MultiplyMatrices call. Adding objects
+  re-sorts on the next Update(), ids don't change.
+*/
+class TransformHierarchy {
+public:
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+private:
+  // By id
+  std::vector<uint32_t> parentOf;
+  std::vector<uint32_t> slotOf;
+
+  // By slot, the sorted order
+  std::vector<uint32_t> ids;
+  std::vector<uint32_t> parents;
+  std::vector<MathUtils::mat4> locals;
+  std::vector<MathUtils::mat4> worlds;
+  std::vector<uint8_t> dirty;
+  // Depth d is slots [levels[d], levels[d + 1])
+  std::vector<uint32_t> levels;
+
+  std::vector<uint32_t> changed;
+  std::vector<uint32_t> changedSlots;
+
+  // Nodes marked dirty since the last Update()
+  uint32_t dirtyCount = 0;
+  bool sorted = true;
+
+  // Breadth first from the roots, in id order
+  void Sort() {
+    uint32_t count = Count();
+
+    // Children by id, as offsets into one array
+    std::vector<uint32_t> firstChild(count + 1, 0);
+    for(uint32_t parent : parentOf) {
+      if(parent != NONE) firstChild[parent + 1]++;
+    }
+    for(uint32_t id = 0; id < count; id++) firstChild[id + 1] += firstChild[id];
+
+    std::vector<uint32_t> children(firstChild[count]);
+    std::vector<uint32_t> filled(firstChild.begin(), firstChild.end() - 1);
+    for(uint32_t id = 0; id < count; id++) {
+      if(parentOf[id] != NONE) children[filled[parentOf[id]]++] = id;
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(count);
+    for(uint32_t id = 0; id < count; id++) {
+      if(parentOf[id] == NONE) order.push_back(id);
+    }
+
+    levels.clear();
+    levels.push_back(0);
+    for(uint32_t begin = 0; begin < order.size();) {
+      uint32_t end = static_cast<uint32_t>(order.size());
+      levels.push_back(end);
+
+      for(uint32_t i = begin; i < end; i++) {
+        uint32_t id = order[i];
+        order.insert(order.end(), children.begin() + firstChild[id], children.begin() + firstChild[id + 1]);
+      }
+      begin = end;
+    }
+
+    std::vector<MathUtils::mat4> sortedLocals(count), sortedWorlds(count);
+    std::vector<uint8_t> sortedDirty(count);
+    for(uint32_t slot = 0; slot < count; slot++) {
+      uint32_t previous = slotOf[order[slot]];
+      sortedLocals[slot] = locals[previous];
+      sortedWorlds[slot] = worlds[previous];
+      sortedDirty[slot] = dirty[previous];
+    }
+    locals.swap(sortedLocals);
+    worlds.swap(sortedWorlds);
+    dirty.swap(sortedDirty);
+
+    ids = order;
+    for(uint32_t slot = 0; slot < count; slot++) slotOf[ids[slot]] = slot;
+    for(uint32_t slot = 0; slot < count; slot++) {
+      uint32_t parent = parentOf[ids[slot]];
+      parents[slot] = parent == NONE ? NONE : slotOf[parent];
+    }
+
+    sorted = true;
+  }
+
+public:
+  // `parent` must have been added before
+  uint32_t Add(const MathUtils::mat4& local, uint32_t parent = NONE) {
+    ASSERT(parent == NONE || parent < Count(), "TransformHierarchy::Add with an unknown parent");
+
+    uint32_t id = Count();
+    parentOf.push_back(parent);
+    slotOf.push_back(id);
+
+    // Goes at the end until the next Update() sorts it in
+    ids.push_back(id);
+    parents.push_back(NONE);
+    locals.push_back(local);
+    worlds.emplace_back();
+    dirty.push_back(1);
+
+    dirtyCount++;
+    sorted = false;
+    return id;
+  }
+
+  void SetLocal(uint32_t id, const MathUtils::mat4& local) {
+    uint32_t slot = slotOf[id];
+    locals[slot] = local;
+    if(!dirty[slot]) {
+      dirty[slot] = 1;
+      dirtyCount++;
+    }
+  }
+
+  // Everything is recomputed by the next Update()
+  void MarkAllDirty() {
+    std::fill(dirty.begin(), dirty.end(), 1);
+    dirtyCount = Count();
+  }
+
+  uint32_t Count() const { return static_cast<uint32_t>(parentOf.size()); }
+  uint32_t Parent(uint32_t id) const { return parentOf[id]; }
+  const MathUtils::mat4& Local(uint32_t id) const { return locals[slotOf[id]]; }
+  // As of the last Update()
+  const MathUtils::mat4& World(uint32_t id) const { return worlds[slotOf[id]]; }
+
+  void Update() {
+    changed.clear();
+    changedSlots.clear();
+    if(dirtyCount == 0) return;
+
+    if(!sorted) Sort();
+
+    for(size_t level = 0; level + 1 < levels.size(); level++) {
+      uint32_t begin = levels[level];
+      uint32_t end = levels[level + 1];
+
+      // Parents are a level up, already final
+      for(uint32_t slot = begin; slot < end; slot++) {
+        if(!dirty[slot] && parents[slot] != NONE && dirty[parents[slot]]) dirty[slot] = 1;
+      }
+
+      for(uint32_t slot = begin; slot < end;) {
+        if(!dirty[slot]) {
+          slot++;
+          continue;
+        }
+
+        // Dirty siblings, all the same parent matrix
+        uint32_t parent = parents[slot];
+        uint32_t runEnd = slot + 1;
+        while(runEnd < end && dirty[runEnd] && parents[runEnd] == parent) runEnd++;
+
+        if(parent == NONE) {
+          std::copy(locals.begin() + slot, locals.begin() + runEnd, worlds.begin() + slot);
+        }
+        else {
+          MathUtils::MultiplyMatrices(worlds[parent], &locals[slot], &worlds[slot], runEnd - slot);
+        }
+
+        for(uint32_t i = slot; i < runEnd; i++) {
+          changed.push_back(ids[i]);
+          changedSlots.push_back(i);
+        }
+        slot = runEnd;
+      }
+    }
+
+    // Only once every level has seen its parents' flags
+    for(uint32_t slot : changedSlots) dirty[slot] = 0;
+    dirtyCount = 0;
+  }
+
+  // Ids whose world matrix the last Update() recomputed, parents first
+  const std::vector<uint32_t>& Changed() const { return changed; }
+
+  // The world matrices of Changed(), packed in the same order, e.g.
+  // into a staging buffer. `destination` holds Changed().size()
+  void CopyChanged(MathUtils::mat4* destination) const {
+    for(size_t i = 0; i < changedSlots.size(); i++) destination[i] = worlds[changedSlots[i]];
+  }
+};